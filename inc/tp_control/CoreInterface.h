@@ -8,14 +8,24 @@
 #include "json.hpp"
 
 #include <functional>
+#include <memory>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 namespace tp_control
 {
 
 class CoreInterface;
 class CoreInterfaceData;
+class CoreInterfaceHandle;
+class CoreInterfaceHistory;
 struct CoreInterfacePayloadPrivate;
+class CoreInterfaceStateSource;
+class CoreInterfaceTaskWrites;
+struct CoreInterfaceStats;
+class CoreInterfaceWatchdog;
+class WorkStealingPool;
 
 //##################################################################################################
 //! The callback for changes in the list of channels.
@@ -29,6 +39,47 @@ typedef std::function<void(const tp_utils::StringID& typeID, const tp_utils::Str
 //! The callback for signals.
 typedef std::function<void(const tp_utils::StringID& typeID, const CoreInterfaceData* data)> SignalCallback;
 
+//##################################################################################################
+//! Computes the value of a derived channel from its inputs, the caller takes ownership of the result.
+typedef std::function<CoreInterfaceData*(const std::vector<CoreInterfaceHandle>& inputs)> DerivedChannelFunction;
+
+//##################################################################################################
+//! A channel task, reads its declared inputs and stages changes to its declared outputs.
+typedef std::function<void(CoreInterfaceTaskWrites& writes)> ChannelTaskFunction;
+
+//##################################################################################################
+//! The types of callback fan-out performed by a core interface
+enum class DispatchKind
+{
+  ChannelList, //!< ChannelListChangedCallback called from CoreInterface::handle().
+  Channel,     //!< ChannelChangedCallback called from CoreInterface::setChannelData().
+  Signal       //!< SignalCallback called from CoreInterface::sendSignal().
+};
+
+//##################################################################################################
+//! Limits how often a channel changed or signal callback is called
+/*!
+A throttled callback is called at most once per interval. A debounced callback is called once a
+burst of events has been quiet for the interval.
+
+With leading set the first event of a burst is delivered straight away, with trailing set the last
+event suppressed in a burst is delivered when the interval ends. Trailing events are delivered from
+CoreInterface::serviceTimers().
+*/
+struct RateLimit
+{
+  enum class Mode
+  {
+    Throttle, //!< At most one call per interval.
+    Debounce  //!< One call after the events stop for the interval.
+  };
+
+  Mode mode{Mode::Throttle};
+  int64_t intervalNS{0};
+  bool leading{true};
+  bool trailing{true};
+};
+
 //##################################################################################################
 //! The payload for signals and channels
 class TP_CONTROL_SHARED_EXPORT CoreInterfaceData
@@ -36,6 +87,25 @@ class TP_CONTROL_SHARED_EXPORT CoreInterfaceData
 public:
   //################################################################################################
   virtual ~CoreInterfaceData()=default;
+
+  //################################################################################################
+  //! Compare with the current data of a channel
+  /*!
+  If this returns true CoreInterface::setChannelData() will discard the new data and skip the channel
+  changed callbacks, the default implementation always returns false.
+
+  \param other - The data currently held by the channel, this will not be nullptr.
+  \return True if this holds the same value as other.
+  */
+  virtual bool equals(const CoreInterfaceData* other) const;
+
+  //################################################################################################
+  //! Returns a copy of this data or nullptr if it can't be copied
+  /*!
+  This is used where a signal payload needs to outlive sendSignal(), for example the trailing edge
+  of a rate limited signal callback. The default implementation returns nullptr.
+  */
+  virtual CoreInterfaceData* clone() const;
 };
 
 //##################################################################################################
@@ -43,6 +113,7 @@ public:
 class TP_CONTROL_SHARED_EXPORT CoreInterfaceHandle
 {
   friend class CoreInterface;
+  friend struct CoreInterfacePayloadPrivate;
   CoreInterfacePayloadPrivate* m_payload{nullptr};
   tp_utils::StringID m_typeID;
   tp_utils::StringID m_nameID;
@@ -72,7 +143,9 @@ public:
   //################################################################################################
   //! Compare handles
   /*!
-  Returns true if both handles are valid and pointing to the same channel in the same interface.
+  Returns true if both handles are valid and pointing to the same channel in the same interface. A
+  handle from deferred channel creation has no channel yet, it matches handles with the same type
+  and name.
 
   \param other - The handle to compare with this.
   \return True if the handles are valid and match.
@@ -82,10 +155,26 @@ public:
   //################################################################################################
   //! Returns the channel data
   /*!
-  This returns the data that this channel holds, or an inalid variant if there was a problem.
+  This returns the data that this channel holds, or an inalid variant if there was a problem. This
+  is only safe to call on the thread that owns the interface, see CoreInterfaceSeqlockChannel for
+  values that need to be read from other threads.
+  \return The data for the channel.
+  */
+  CoreInterfaceData* data() const;
+
+  //################################################################################################
+  //! Returns a shared reference to the channel data
+  /*!
+  The data is kept alive for as long as the reference is held, even after the channel has been set
+  to new data, so it can be handed to other threads without copying. Data held by a channel should
+  not be modified once it has been set.
   \return The data for the channel.
   */
-  CoreInterfaceData* data() const;  
+  std::shared_ptr<const CoreInterfaceData> sharedData() const;
+
+  //################################################################################################
+  //! Returns the number of times this channel's data has been set or derived
+  uint64_t version() const;
 
   //################################################################################################
   nlohmann::json saveState() const;
@@ -105,6 +194,113 @@ This will sort handles based on there nameID
 */
 bool TP_CONTROL_SHARED_EXPORT lessThanCoreInterfaceHandle(const CoreInterfaceHandle& lhs, const CoreInterfaceHandle& rhs);
 
+//##################################################################################################
+//! The type and name of a channel as plain strings, with a precomputed hash
+/*!
+This is used to find existing channels without constructing StringIDs, which would take the global
+intern lock. The hash is computed in the constructor and is a constant expression when the strings
+are, so a key built from literals costs nothing at runtime. The strings are not copied and must
+outlive the key.
+*/
+struct CoreInterfaceChannelKey
+{
+  std::string_view typeID;
+  std::string_view nameID;
+  uint64_t hash;
+
+  //################################################################################################
+  constexpr CoreInterfaceChannelKey(std::string_view typeID_, std::string_view nameID_):
+    typeID(typeID_),
+    nameID(nameID_),
+    hash(hashOf(typeID_, nameID_))
+  {
+
+  }
+
+  //################################################################################################
+  //! FNV-1a over the type, a separator, and the name
+  static constexpr uint64_t hashOf(std::string_view typeID, std::string_view nameID)
+  {
+    uint64_t h = 14695981039346656037ull;
+    for(char c : typeID)
+      h = (h ^ uint8_t(c)) * 1099511628211ull;
+    h = (h ^ 0xFFu) * 1099511628211ull;
+    for(char c : nameID)
+      h = (h ^ uint8_t(c)) * 1099511628211ull;
+    return h;
+  }
+};
+
+//##################################################################################################
+//! Collects the channel data set by a channel task
+/*!
+A task may run on a worker thread so it can't set channels directly, the data is staged here and
+set on the owner thread once the tasks that run alongside it have completed.
+*/
+class TP_CONTROL_SHARED_EXPORT CoreInterfaceTaskWrites
+{
+  friend class CoreInterface;
+  const std::vector<CoreInterfaceHandle>* m_declared{nullptr};
+  std::vector<std::pair<CoreInterfaceHandle, std::unique_ptr<CoreInterfaceData>>> m_writes;
+
+public:
+  //################################################################################################
+  //! Stage new data for a channel, the channel must be in the task's declared writes
+  /*!
+  \param handle - The channel to set.
+  \param data - The new value for the channel, this will take ownership.
+  */
+  void setChannelData(const CoreInterfaceHandle& handle, CoreInterfaceData* data);
+};
+
+//##################################################################################################
+//! A source of saved channel data that is only decoded when a channel is first read
+/*!
+When a channel is created by CoreInterface::handle() the source is asked if it holds data for the
+channel, if it does the data is loaded the first time that CoreInterfaceHandle::data() or
+sharedData() is called. Setting the channel before it is read discards the saved data unread.
+*/
+class TP_CONTROL_SHARED_EXPORT CoreInterfaceStateSource
+{
+public:
+  //################################################################################################
+  virtual ~CoreInterfaceStateSource()=default;
+
+  //################################################################################################
+  //! Returns a token for the saved data of a channel, or 0 if there is none
+  virtual uint64_t find(const tp_utils::StringID& typeID, const tp_utils::StringID& nameID) const=0;
+
+  //################################################################################################
+  //! Decode the data for a token returned by find(), the caller takes ownership
+  virtual CoreInterfaceData* load(const tp_utils::StringID& typeID, uint64_t token) const=0;
+};
+
+//##################################################################################################
+//! Observes the traffic passing through a core interface
+/*!
+Observers are called before the callbacks for each event so that the order that they see events in
+matches the order that they were made in. Use CoreInterface::dispatchDepth() to tell if an event was
+caused by a callback.
+*/
+class TP_CONTROL_SHARED_EXPORT CoreInterfaceObserver
+{
+public:
+  //################################################################################################
+  virtual ~CoreInterfaceObserver()=default;
+
+  //################################################################################################
+  //! Called when handle() creates a new channel
+  virtual void handleCreated(const CoreInterfaceHandle& handle);
+
+  //################################################################################################
+  //! Called when setChannelData() is called with a valid handle
+  virtual void channelDataSet(const CoreInterfaceHandle& handle, const CoreInterfaceData* data);
+
+  //################################################################################################
+  //! Called when sendSignal() is called
+  virtual void signalSent(const tp_utils::StringID& typeID, const CoreInterfaceData* data);
+};
+
 //##################################################################################################
 //! This defines an interface that can be used to communicate between components
 /*!
@@ -172,17 +368,60 @@ public:
   */
   void unregisterCallback(const ChannelListChangedCallback* callback);
 
+  //################################################################################################
+  //! Hold back channel list changed callbacks until endChannelListChanges()
+  /*!
+  Calls nest, and when the outermost endChannelListChanges() is called the callbacks are called once
+  if any channels were created in between. This turns creating many channels at startup from one
+  list rebuild per channel into a single rebuild. Observers are still told about each new channel
+  as it is created.
+
+  Prefer CoreInterfaceChannelListChanges which calls these from its constructor and destructor.
+  */
+  void beginChannelListChanges();
+
+  //################################################################################################
+  //! End a call to beginChannelListChanges()
+  void endChannelListChanges();
+
   //################################################################################################
   //! Get a handle for a channel
   /*!
   The type of a channel usually relates to the data type that channel will contain.
 
+  If the channel does not exist it is created and the channel list changed callbacks are called,
+  unless setDeferChannelCreation() is enabled.
+
   \param typeID - The type of the channel.
   \param nameID - The name of the channel.
   \return The handle for type and name.
   */
   CoreInterfaceHandle handle(const tp_utils::StringID& typeID, const tp_utils::StringID& nameID);
 
+  //################################################################################################
+  //! Find an existing channel
+  /*!
+  Unlike handle() this never creates a channel, so it can be used to probe for channels without
+  changing the channel list.
+
+  \param typeID - The type of the channel.
+  \param nameID - The name of the channel.
+  \return The handle for the channel, or an invalid handle if it does not exist.
+  */
+  CoreInterfaceHandle findHandle(const tp_utils::StringID& typeID, const tp_utils::StringID& nameID) const;
+
+  //################################################################################################
+  //! Find an existing channel by plain strings
+  /*!
+  This never creates a channel and does not construct StringIDs, the key is looked up in an index
+  of channel names by its precomputed hash. For a lookup that is repeated at the same call site see
+  CoreInterfaceCachedHandle.
+
+  \param key - The type and name of the channel.
+  \return The handle for the channel, or an invalid handle if it does not exist.
+  */
+  CoreInterfaceHandle findHandle(const CoreInterfaceChannelKey& key) const;
+
   //################################################################################################
   //! Register a callback that will be called when a channel changes
   /*!
@@ -200,6 +439,37 @@ public:
   */
   void registerCallback(const ChannelChangedCallback* callback);
 
+  //################################################################################################
+  //! Register a channel changed callback that is rate limited
+  /*!
+  The rate limit is applied to each channel separately, so a change to one channel does not hide a
+  change to another. A trailing call passes the data that the channel holds at the time of the call.
+
+  Callbacks registered without a rate limit are not affected, they are called for every change.
+
+  \param callback - A pointer to the function that you want to be called.
+  \param rateLimit - How often the callback may be called.
+  */
+  void registerCallback(const ChannelChangedCallback* callback, const RateLimit& rateLimit);
+
+  //################################################################################################
+  //! Register a callback that is only called when a single channel changes
+  /*!
+  Unlike the global channel callbacks the callback is held by the channel itself, so changes to
+  other channels do not have to visit it. It is called after the global callbacks. It is safe to
+  unregister any callback of the channel from inside the callback.
+
+  \param callback - A pointer to the function that you want to be called.
+  \param handle - The channel to watch.
+
+  \sa unregisterCallback()
+  */
+  void registerCallback(const ChannelChangedCallback* callback, const CoreInterfaceHandle& handle);
+
+  //################################################################################################
+  //! Unregister a callback that was registered for a single channel
+  void unregisterCallback(const ChannelChangedCallback* callback, const CoreInterfaceHandle& handle);
+
   //################################################################################################
   //! Unregister a channel changed callback
   /*!
@@ -211,13 +481,211 @@ public:
   //################################################################################################
   //! Set the alue held by a channel
   /*!
-  This will set the value of a channel and cause the channel changed callbacks to be called.
+  This will set the value of a channel and cause the channel changed callbacks to be called. If the
+  new data reports that it equals the current data via CoreInterfaceData::equals() the new data is
+  deleted and nothing else happens.
 
   \param handle - The handle of the channel that you want to set.
   \param data - The new value for that channel, this will take ownership.
   */
   void setChannelData(const CoreInterfaceHandle& handle, CoreInterfaceData* data);
 
+  //################################################################################################
+  //! Set the value held by a channel from data that may be shared with other owners
+  /*!
+  This behaves the same as the raw pointer version but lets a producer keep its own reference to
+  the data, for example to publish the same immutable payload to several channels. The raw pointer
+  version does not allocate a shared_ptr control block unless sharedData() is later called for the
+  value, prefer it when the data is not shared.
+
+  \param handle - The handle of the channel that you want to set.
+  \param data - The new value for that channel.
+  */
+  void setChannelData(const CoreInterfaceHandle& handle, std::shared_ptr<CoreInterfaceData> data);
+
+
+  //################################################################################################
+  //## Derived Channels ############################################################################
+  //################################################################################################
+
+  //################################################################################################
+  //! Make a channel a function of other channels
+  /*!
+  A derived channel is recomputed lazily, when its data() is read the inputs are brought up to date
+  and the function is only called if the version of an input has changed since it was last called.
+  Derived channels can be inputs to other derived channels, so in a diamond each channel is computed
+  once, and channels that are never read are never computed.
+
+  Derived channels with recomputeOnFlush set are also brought up to date by flushDerivedChannels()
+  which will call the channel changed callbacks for each one that changed.
+
+  \param handle - The channel to derive, any existing derived function is replaced.
+  \param inputs - The channels that the function reads.
+  \param function - Computes the new data for the channel from the inputs.
+  \param recomputeOnFlush - Recompute and notify from flushDerivedChannels().
+  \return False if the inputs would create a cycle, or if it is called while the channel is being
+  computed, from its own function or from the function of one of its inputs.
+  */
+  bool setDerivedChannel(const CoreInterfaceHandle& handle,
+                         const std::vector<CoreInterfaceHandle>& inputs,
+                         const DerivedChannelFunction& function,
+                         bool recomputeOnFlush=false);
+
+  //################################################################################################
+  //! Stop deriving a channel, it keeps its current data
+  /*!
+  This is ignored with a warning if it is called while the channel is being computed, for example
+  from its own function or from the function of one of its inputs.
+  */
+  void removeDerivedChannel(const CoreInterfaceHandle& handle);
+
+  //################################################################################################
+  //! Recompute stale derived channels that were set with recomputeOnFlush
+  /*!
+  Channels are visited in dependency order, the channel changed callbacks are called for each one
+  that was recomputed.
+  */
+  void flushDerivedChannels();
+
+
+  //################################################################################################
+  //## Channel Tasks ###############################################################################
+  //################################################################################################
+
+  //################################################################################################
+  //! Register a task that runs when the channels it reads change
+  /*!
+  Tasks are run by flushChannelTasks(), they are ordered by their declared reads and writes. A task
+  that writes a channel runs before the tasks that read it, and tasks that write the same channel
+  run in the order they were registered. Tasks that don't conflict run at the same time on the
+  signal pool if one is set, see setSignalPool().
+
+  While it runs a task may read the data of the channels in reads, it must not call into the
+  interface or read other channels. Changes to the channels in writes are staged in the
+  CoreInterfaceTaskWrites and set once the tasks running alongside it have completed, so the result
+  does not depend on the number of threads.
+
+  \param task - The function to call, this is also used to unregister the task.
+  \param reads - The channels that the task reads, a change to any of them schedules the task.
+  \param writes - The channels that the task may set.
+  */
+  void registerChannelTask(const ChannelTaskFunction* task,
+                           const std::vector<CoreInterfaceHandle>& reads,
+                           const std::vector<CoreInterfaceHandle>& writes);
+
+  //################################################################################################
+  void unregisterChannelTask(const ChannelTaskFunction* task);
+
+  //################################################################################################
+  //! Run the tasks affected by the channels that have changed since the last flush
+  /*!
+  The tasks that read changed channels, and the tasks that read what those write, are run in
+  waves. Each wave holds tasks that don't conflict, once it completes the staged writes are set in
+  registration order, calling the channel changed callbacks, and the next wave is started. A task
+  runs at most once per flush and is skipped if none of its reads changed.
+
+  If the declared reads and writes form a cycle it is broken in registration order, and writes that
+  a task in the cycle has already missed are left for the next flush.
+
+  \return The number of tasks that were run.
+  */
+  size_t flushChannelTasks();
+
+
+  //################################################################################################
+  //## History #####################################################################################
+  //################################################################################################
+
+  //################################################################################################
+  //! Keep a time stamped history of the values of a channel
+  /*!
+  Once enabled each call to setChannelData() that changes the channel adds an entry to the history,
+  along with each recompute of a derived channel. The history starts with the next value set, if the
+  capacity is changed the newest entries that fit are kept.
+
+  \param handle - The channel to keep a history for.
+  \param capacity - The maximum number of entries to keep, 0 removes the history.
+  */
+  void setHistoryCapacity(const CoreInterfaceHandle& handle, size_t capacity);
+
+  //################################################################################################
+  //! Returns the history of a channel or nullptr if it does not have one
+  /*!
+  The history is owned by the interface and is valid until setHistoryCapacity() is called again for
+  the channel.
+  */
+  const CoreInterfaceHistory* history(const CoreInterfaceHandle& handle) const;
+
+
+  //################################################################################################
+  //## Lazy Loading ################################################################################
+  //################################################################################################
+
+  //################################################################################################
+  //! Set the source that channels created by handle() are lazily loaded from
+  /*!
+  The source is not owned and must stay valid while any channel has unread data from it. Channels
+  that have not been created with handle() are not listed by channels().
+
+  Replacing or removing the source loads any data that is still unread from the old source, so that
+  the old source can be destroyed.
+
+  \param source - The source to load from, or nullptr.
+  */
+  void setStateSource(const CoreInterfaceStateSource* source);
+
+  //################################################################################################
+  //! The number of channels that have saved data that has not been read yet
+  size_t unloadedChannelCount() const;
+
+
+  //################################################################################################
+  //! Defer creating channels until they are first set
+  /*!
+  While this is enabled handle() does not create missing channels, instead it returns a handle that
+  has a type and name but no data. The channel is created, and the channel list changed callbacks
+  are called, the first time that handle is passed to setChannelData(). Until then the handle is not
+  listed by channels() and data() returns nullptr. Channels that a state source holds data for are
+  created straight away.
+
+  The handle passed to setChannelData() is not updated, call handle() again to get a handle to the
+  created channel so that later sets do not need to look it up. Passing one of these handles to
+  setHistoryCapacity(), setDerivedChannel() or registerChannelTask() also creates the channel.
+
+  Handles without a channel are only usable while this is enabled, once it is disabled they are
+  rejected with a warning.
+  */
+  void setDeferChannelCreation(bool defer);
+
+  //################################################################################################
+  bool deferChannelCreation() const;
+
+
+  //################################################################################################
+  //## Dirty Tracking ##############################################################################
+  //################################################################################################
+
+  //################################################################################################
+  //! Keep a list of the channels that have been set since the list was last cleared
+  /*!
+  This lets incremental checkpoints write only the channels that changed, see
+  writeCheckpointDelta(). Tracking costs a flag check per setChannelData() and is off by default.
+  */
+  void setDirtyTracking(bool enabled);
+
+  //################################################################################################
+  bool dirtyTracking() const;
+
+  //################################################################################################
+  //! The channels that have been set since clearDirtyChannels() was last called
+  /*!
+  Each channel appears once, in the order that it was first set.
+  */
+  const std::vector<CoreInterfaceHandle>& dirtyChannels() const;
+
+  //################################################################################################
+  void clearDirtyChannels();
+
 
   //################################################################################################
   //## Signals #####################################################################################
@@ -237,6 +705,18 @@ public:
  */
   void registerCallback(const SignalCallback* callback, const tp_utils::StringID& typeID);
 
+  //################################################################################################
+  //! Register a signal callback that is rate limited
+  /*!
+  The payload of a trailing call is a copy made with CoreInterfaceData::clone() of the last signal
+  that was suppressed, if the payload can't be cloned the trailing call is passed nullptr.
+
+  \param callback - The function pointer that will be called when a signal is sent.
+  \param typeID - The type of signal that you are interested in.
+  \param rateLimit - How often the callback may be called.
+  */
+  void registerCallback(const SignalCallback* callback, const tp_utils::StringID& typeID, const RateLimit& rateLimit);
+
   //################################################################################################
   //! Unregister a signal callback
   /*!
@@ -249,19 +729,235 @@ public:
   //! Send a signal
   /*!
   This will send a signal to all callbacks registered to receive signals of this type. Once the
-  signal is despatched to all the callbacks it is forgotten.
+  signal is despatched to all the callbacks it is forgotten. Parallel callbacks are run on the signal
+  pool and have all completed when this returns.
+
+  As with sendSignalAt() and setChannelData() the payload is owned by the interface, it is deleted
+  once the callbacks have returned so they must not keep a pointer to it. Use sendSignalAsync() to
+  share a payload that must outlive the call.
 
   \param typeID The type of signal.
   \param data The payload of the signal or nullptr, this will take ownership.
   */
   void sendSignal(const tp_utils::StringID& typeID, CoreInterfaceData* data);
 
+
+  //################################################################################################
+  //## Parallel Signals ############################################################################
+  //################################################################################################
+
+  //################################################################################################
+  //! Register a signal callback that is safe to run in parallel with the other callbacks
+  /*!
+  When a signal pool is set these callbacks are run on the pool, concurrently with each other and
+  with the callbacks on the owner thread. They must only read the payload and must not call into the
+  interface. They are not timed by the watchdog or the per callback instrumentation.
+
+  Remove them with unregisterCallback(), this waits for any that are still running.
+
+  \param callback - The function pointer that will be called when a signal is sent.
+  \param typeID - The type of signal that you are interested in.
+  */
+  void registerParallelCallback(const SignalCallback* callback, const tp_utils::StringID& typeID);
+
+  //################################################################################################
+  //! Set the pool that parallel callbacks are run on
+  /*!
+  Without a pool parallel callbacks are run one after another on the owner thread. The pool is not
+  owned and must outlive the interface or be replaced. If tp_control was built with
+  TP_CONTROL_SINGLE_THREADED the pool is ignored with a warning.
+
+  \param pool - The pool, or nullptr.
+  */
+  void setSignalPool(WorkStealingPool* pool);
+
+  //################################################################################################
+  //! Send a signal without waiting for the parallel callbacks
+  /*!
+  The other callbacks are called before this returns, the parallel callbacks may still be running
+  and hold a reference to the payload until they are done. Call waitForSignals() to join them.
+  */
+  void sendSignalAsync(const tp_utils::StringID& typeID, const std::shared_ptr<CoreInterfaceData>& data);
+
+  //################################################################################################
+  //! Wait for the parallel callbacks started by sendSignalAsync(), running pool tasks while waiting
+  void waitForSignals();
+
+
+  //################################################################################################
+  //## Timers ######################################################################################
+  //################################################################################################
+
+  //################################################################################################
+  //! Send a signal at a time in the future
+  /*!
+  Timers are kept in a TimerWheel with a resolution of 1ms and are fired by serviceTimers(), which
+  the owner thread should call from its tick. Timers that fall due in the same tick are sent together.
+
+  \param typeID - The type of signal.
+  \param data - The payload of the signal or nullptr, this will take ownership.
+  \param deadlineNS - When to send the signal, in the clock of nowNS().
+  \return An ID that can be passed to cancelTimer().
+  */
+  uint64_t sendSignalAt(const tp_utils::StringID& typeID, CoreInterfaceData* data, int64_t deadlineNS);
+
+  //################################################################################################
+  //! Send a signal repeatedly
+  /*!
+  The same payload is sent each time. If serviceTimers() is called late any missed periods are
+  skipped rather than sent in a burst.
+
+  \param typeID - The type of signal.
+  \param data - The payload of the signal or nullptr, this will take ownership.
+  \param periodNS - The interval between signals.
+  \param firstDeadlineNS - When to send the first signal, or 0 to send it after one period.
+  \return An ID that can be passed to cancelTimer().
+  */
+  uint64_t sendSignalPeriodic(const tp_utils::StringID& typeID, CoreInterfaceData* data, int64_t periodNS, int64_t firstDeadlineNS=0);
+
+  //################################################################################################
+  //! Cancel a timer, returns false if it has already fired or been cancelled
+  bool cancelTimer(uint64_t id);
+
+  //################################################################################################
+  //! Send the signals whose timers are due, call this regularly from the owner thread
+  /*!
+  \return The number of signals sent.
+  */
+  size_t serviceTimers();
+
+  //################################################################################################
+  //! Send the signals whose timers are due at nowNS, for callers that keep their own clock
+  /*!
+  Time does not go backwards, a nowNS before the last serviced time is treated as that time. New
+  timers such as rate limit intervals are measured from the later of nowNS() and the last serviced
+  time, so a caller can step time forward explicitly, for example in tests.
+
+  \return The number of signals sent.
+  */
+  size_t serviceTimers(int64_t nowNS);
+
+  //################################################################################################
+  //! The monotonic clock used for timers and history timestamps, in nanoseconds
+  static int64_t nowNS();
+
+
+  //################################################################################################
+  //## Observers ###################################################################################
+  //################################################################################################
+
+  //################################################################################################
+  //! Register an observer that will be notified of all traffic through this interface
+  /*!
+  The observer is not owned by the interface and should be unregistered before it is destroyed.
+  */
+  void registerObserver(CoreInterfaceObserver* observer);
+
+  //################################################################################################
+  void unregisterObserver(CoreInterfaceObserver* observer);
+
+  //################################################################################################
+  //! The number of callback fan-outs currently on the stack, 0 outside of callbacks
+  size_t dispatchDepth() const;
+
+
+  //################################################################################################
+  //## Instrumentation #############################################################################
+  //################################################################################################
+
+  //################################################################################################
+  //! Give a callback a human readable name for stats and reports
+  /*!
+  \param callback - A pointer to any of the callback types registered with this interface.
+  \param tag - The name to report the callback as, pass an empty string to remove the tag.
+  */
+  void setCallbackTag(const void* callback, const std::string& tag);
+
+  //################################################################################################
+  //! Returns the tag set with setCallbackTag() or an empty string
+  std::string callbackTag(const void* callback) const;
+
+  //################################################################################################
+  //! Set the watchdog that times callbacks, this is called by CoreInterfaceWatchdog
+  void setWatchdog(CoreInterfaceWatchdog* watchdog);
+
+  //################################################################################################
+  //! Returns a copy of the instrumentation counters
+  /*!
+  The counters are only collected if tp_control was built with TP_CONTROL_INSTRUMENTATION defined,
+  see instrumentationEnabled().
+  */
+  CoreInterfaceStats stats() const;
+
+  //################################################################################################
+  //! Reset all of the instrumentation counters to zero
+  void resetStats();
+
 private:
+  //################################################################################################
+  //! Returns the handle for a channel, creating it if it does not exist
+  CoreInterfaceHandle createHandle(const tp_utils::StringID& typeID, const tp_utils::StringID& nameID);
+
+  //################################################################################################
+  //! Returns the channel for a handle from deferred channel creation, creating it
+  /*!
+  Other handles are returned unchanged. If channel creation is no longer deferred a warning is
+  logged and an invalid handle is returned.
+  */
+  CoreInterfaceHandle resolveHandle(const CoreInterfaceHandle& handle, const char* caller);
+
   struct Private;
   friend struct Private;
+  friend class CoreInterfaceCachedHandle;
   Private* d;
 };
 
+//##################################################################################################
+//! Coalesces the channel list changed callbacks of the channels created in a scope
+/*!
+See CoreInterface::beginChannelListChanges(), scopes can be nested.
+*/
+class TP_CONTROL_SHARED_EXPORT CoreInterfaceChannelListChanges
+{
+  TP_NONCOPYABLE(CoreInterfaceChannelListChanges);
+  CoreInterface* m_coreInterface;
+public:
+  //################################################################################################
+  CoreInterfaceChannelListChanges(CoreInterface* coreInterface);
+
+  //################################################################################################
+  ~CoreInterfaceChannelListChanges();
+};
+
+//##################################################################################################
+//! Caches the result of CoreInterface::findHandle() at a call site
+/*!
+Declare this as a thread_local static next to code that looks up the same channel each time it runs,
+the lookup is done once per thread and repeated only if a different interface is passed in. Misses
+are not cached so the channel is picked up once it has been created.
+
+get() updates the cache without any synchronization, so an instance must not be shared between
+threads. A plain function-local static is only safe where a single thread runs the code.
+*/
+class TP_CONTROL_SHARED_EXPORT CoreInterfaceCachedHandle
+{
+  CoreInterfaceChannelKey m_key;
+  uint64_t m_instanceID{0};
+  CoreInterfaceHandle m_handle;
+
+public:
+  //################################################################################################
+  /*!
+  \param typeID - The type of the channel, this is not copied.
+  \param nameID - The name of the channel, this is not copied.
+  */
+  CoreInterfaceCachedHandle(std::string_view typeID, std::string_view nameID);
+
+  //################################################################################################
+  //! Returns the handle in coreInterface, or an invalid handle if the channel does not exist
+  const CoreInterfaceHandle& get(const CoreInterface* coreInterface);
+};
+
 }
 
 #endif
@@ -0,0 +1,116 @@
+#ifndef tp_control_CoreInterfaceBridge_h
+#define tp_control_CoreInterfaceBridge_h
+
+#include "tp_control/CoreInterface.h"
+
+namespace tp_control
+{
+class CoreInterfaceCodecs;
+
+//##################################################################################################
+//! Replicates channels and signals between core interfaces in different processes
+/*!
+The bridge subscribes to the local CoreInterface using the normal callbacks and sends the chosen
+channel types and signal types to a peer bridge over a Unix domain socket. Updates received from the
+peer are applied to the local interface, and are not sent back.
+
+Updates are queued and sent in batches by poll(). While a channel update is waiting to be sent
+further updates to the same channel replace it, so a slow peer sees the latest value rather than
+every value. Signals are never coalesced. If more than maxPendingBytes are waiting for the socket,
+further batches are held back and channels keep coalescing, and signals that arrive are dropped and
+counted.
+
+When a peer connects, and when a channel type is added while connected, the current value of each
+channel of the bridged types is queued so that the peer starts in sync. Nothing is queued while
+there is no peer, signals sent then are not delivered or counted as dropped, and updates still
+waiting when the connection closes are discarded.
+
+Frames are a 4 byte length followed by a kind byte, the typeID, the nameID and the payload encoded
+with the codecs. Updates that would make a frame larger than maxPendingBytes are not sent, and a
+received frame that is larger than that or is malformed closes the connection. Frames received
+before the peer closes the connection are applied before poll() reports it closed.
+
+All methods should be called from the owner thread of the interface, typically poll() is called
+from the same tick that services other IO.
+*/
+class TP_CONTROL_SHARED_EXPORT CoreInterfaceBridge
+{
+  TP_NONCOPYABLE(CoreInterfaceBridge);
+public:
+  //################################################################################################
+  /*!
+  \param coreInterface - The local interface, this must outlive the bridge.
+  \param codecs - Used to encode and decode payloads, this must outlive the bridge.
+  */
+  CoreInterfaceBridge(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs);
+
+  //################################################################################################
+  ~CoreInterfaceBridge();
+
+  //################################################################################################
+  //! Listen on a socket path, the first peer to connect is accepted by poll()
+  bool listen(const std::string& path);
+
+  //################################################################################################
+  //! Connect to a bridge that is listening on path
+  bool connect(const std::string& path);
+
+  //################################################################################################
+  //! Use an already connected socket, for example one end of a socketpair(), takes ownership
+  bool attach(int fd);
+
+  //################################################################################################
+  //! Close the connection and any listening socket
+  void close();
+
+  //################################################################################################
+  bool isConnected() const;
+
+  //################################################################################################
+  //! Replicate channels of this type to the peer, existing channels with data are queued
+  void addChannelType(const tp_utils::StringID& typeID);
+
+  //################################################################################################
+  //! Replicate signals of this type to the peer
+  void addSignalType(const tp_utils::StringID& typeID);
+
+  //################################################################################################
+  //! The amount of unsent data that causes the bridge to apply backpressure
+  /*!
+  This is also the largest frame that will be sent or accepted, so both ends should use the same
+  value, the default is 1MB.
+  */
+  void setMaxPendingBytes(size_t maxPendingBytes);
+
+  //################################################################################################
+  //! Send queued updates and apply received updates
+  /*!
+  \return False if the connection was lost.
+  */
+  bool poll();
+
+  //################################################################################################
+  //! The number of bytes waiting for the socket
+  size_t pendingBytes() const;
+
+  //################################################################################################
+  //! The number of signals dropped due to backpressure
+  size_t droppedSignals() const;
+
+  //################################################################################################
+  //! The number of updates that have been applied from the peer
+  size_t receivedCount() const;
+
+  //################################################################################################
+  //! The socket, can be used to wait for data in an event loop, or -1
+  int fileDescriptor() const;
+
+private:
+  struct Private;
+  friend struct Private;
+  Private* d;
+};
+
+}
+
+#endif
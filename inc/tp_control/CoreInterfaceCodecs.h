@@ -0,0 +1,83 @@
+#ifndef tp_control_CoreInterfaceCodecs_h
+#define tp_control_CoreInterfaceCodecs_h
+
+#include "tp_control/Globals.h"
+
+#include "tp_utils/StringID.h"
+
+#include "json.hpp"
+
+#include <functional>
+#include <unordered_map>
+#include <string>
+
+namespace tp_control
+{
+class CoreInterfaceData;
+
+//##################################################################################################
+//! Converts the payload of a channel or signal type to and from bytes
+struct CoreInterfaceCodec
+{
+  //! Append the encoded form of data to result, data will not be nullptr.
+  std::function<void(const CoreInterfaceData* data, std::string& result)> encode;
+
+  //! Create a new payload from encoded bytes, the caller takes ownership.
+  std::function<CoreInterfaceData*(const char* encoded, size_t size)> decode;
+
+  //! Optional, convert data to JSON for saveCoreInterfaceState(), data will not be nullptr.
+  std::function<nlohmann::json(const CoreInterfaceData* data)> saveState;
+
+  //! Optional, create a new payload from JSON, the caller takes ownership.
+  std::function<CoreInterfaceData*(const nlohmann::json& j)> loadState;
+};
+
+//##################################################################################################
+//! A registry of codecs indexed by channel or signal typeID
+/*!
+CoreInterfaceData is opaque to tp_control so anything that needs to write payloads to disk or send
+them to another process needs a codec for each type. Types without a codec are written as empty
+payloads and read back as nullptr.
+*/
+class TP_CONTROL_SHARED_EXPORT CoreInterfaceCodecs
+{
+public:
+  //################################################################################################
+  void addCodec(const tp_utils::StringID& typeID, const CoreInterfaceCodec& codec);
+
+  //################################################################################################
+  void removeCodec(const tp_utils::StringID& typeID);
+
+  //################################################################################################
+  //! Returns the codec for a type or nullptr if there is no codec for that type
+  const CoreInterfaceCodec* codec(const tp_utils::StringID& typeID) const;
+
+  //################################################################################################
+  //! Append the encoded data to result
+  /*!
+  \return True if there was a codec for typeID and data was not null.
+  */
+  bool encode(const tp_utils::StringID& typeID, const CoreInterfaceData* data, std::string& result) const;
+
+  //################################################################################################
+  //! Decode data or return nullptr if there is no codec for typeID
+  CoreInterfaceData* decode(const tp_utils::StringID& typeID, const char* encoded, size_t size) const;
+
+  //################################################################################################
+  //! Convert data to JSON
+  /*!
+  \return True if there was a JSON codec for typeID and data was not null.
+  */
+  bool saveState(const tp_utils::StringID& typeID, const CoreInterfaceData* data, nlohmann::json& j) const;
+
+  //################################################################################################
+  //! Create data from JSON or return nullptr if there is no JSON codec for typeID
+  CoreInterfaceData* loadState(const tp_utils::StringID& typeID, const nlohmann::json& j) const;
+
+private:
+  std::unordered_map<tp_utils::StringID, CoreInterfaceCodec> m_codecs;
+};
+
+}
+
+#endif
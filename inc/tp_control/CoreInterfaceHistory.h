@@ -0,0 +1,85 @@
+#ifndef tp_control_CoreInterfaceHistory_h
+#define tp_control_CoreInterfaceHistory_h
+
+#include "tp_control/CoreInterface.h"
+
+namespace tp_control
+{
+
+//##################################################################################################
+//! A value of a channel and the time that it was set
+struct TP_CONTROL_SHARED_EXPORT CoreInterfaceHistoryEntry
+{
+  int64_t timestampNS{0};                     //!< CoreInterfaceHistory::nowNS() when the data was set.
+  std::shared_ptr<const CoreInterfaceData> data; //!< The data, this may be null.
+};
+
+//##################################################################################################
+//! A bounded history of the values of a channel
+/*!
+The entries are held in a ring that is allocated up front, once it is full each new value replaces
+the oldest one. The data is shared with the channel so keeping a history does not copy values.
+
+Timestamps are taken from a monotonic clock so entries are always in time order, queries use a
+binary search over the ring.
+
+Histories are created with CoreInterface::setHistoryCapacity() and are updated by
+CoreInterface::setChannelData(), they should only be read from the thread that owns the interface.
+*/
+class TP_CONTROL_SHARED_EXPORT CoreInterfaceHistory
+{
+  TP_NONCOPYABLE(CoreInterfaceHistory);
+public:
+  //################################################################################################
+  CoreInterfaceHistory(size_t capacity);
+
+  //################################################################################################
+  ~CoreInterfaceHistory();
+
+  //################################################################################################
+  //! The maximum number of entries that are kept
+  size_t capacity() const;
+
+  //################################################################################################
+  //! The number of entries currently held
+  size_t size() const;
+
+  //################################################################################################
+  //! Returns an entry by index, 0 is the oldest and size()-1 is the newest
+  const CoreInterfaceHistoryEntry& at(size_t index) const;
+
+  //################################################################################################
+  //! Add an entry, timestamps must not go backwards
+  void append(int64_t timestampNS, const std::shared_ptr<const CoreInterfaceData>& data);
+
+  //################################################################################################
+  void clear();
+
+  //################################################################################################
+  //! Returns the index of the first entry at or after tNS, size() if there is none
+  size_t lowerBound(int64_t tNS) const;
+
+  //################################################################################################
+  //! Returns the entries with timestamps in the range [t0NS, t1NS]
+  std::vector<CoreInterfaceHistoryEntry> range(int64_t t0NS, int64_t t1NS) const;
+
+  //################################################################################################
+  //! Returns the value that the channel held at time tNS
+  /*!
+  \return The newest entry at or before tNS, or null if tNS is before the oldest entry.
+  */
+  std::shared_ptr<const CoreInterfaceData> valueAt(int64_t tNS) const;
+
+  //################################################################################################
+  //! The clock used to timestamp entries, this is CoreInterface::nowNS()
+  static int64_t nowNS();
+
+private:
+  struct Private;
+  friend struct Private;
+  Private* d;
+};
+
+}
+
+#endif
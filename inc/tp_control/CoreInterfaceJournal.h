@@ -0,0 +1,224 @@
+#ifndef tp_control_CoreInterfaceJournal_h
+#define tp_control_CoreInterfaceJournal_h
+
+#include "tp_control/CoreInterface.h"
+
+namespace tp_control
+{
+class CoreInterfaceCodecs;
+
+//##################################################################################################
+//! A write-ahead journal of channel changes used to rebuild an interface after a crash
+/*!
+The state is kept in two files, a checkpoint that holds the value of every channel when it was
+written, and a journal that each call to setChannelData() is appended to. To recover, the checkpoint
+is mapped and applied and then the tail of the journal is replayed over it.
+
+Only channels with a codec in the registry are persisted. Both files are written through memory
+mappings so the journal costs a memcpy per change and survives the process crashing, call sync() to
+also survive the machine going down. Checkpoints are synced, along with their directory, before the
+journal that they replace is truncated.
+
+Each record carries a CRC, recovery stops at the first record that does not match so a damaged
+tail is not replayed.
+
+When the journal grows past the compaction size compaction becomes due, and the next call to
+compact() writes a new checkpoint alongside the old one, renames it over it, and starts the journal
+again. This rewrites and syncs every persisted channel, so it is left to the owner to call compact()
+at a convenient time, for example from an idle handler, rather than stalling setChannelData(). A crash at any point during compaction leaves
+either the old or the new checkpoint in place, replaying a journal over a newer checkpoint is
+harmless as the newest value of each channel is in both.
+
+At startup call recover() and then open() with the same path.
+
+The journal checkpoints the channels listed by CoreInterface::channels(), so it should not be used
+with a CoreInterfaceLazyCheckpoint as channels that were never requested would be dropped.
+*/
+class TP_CONTROL_SHARED_EXPORT CoreInterfaceJournal : public CoreInterfaceObserver
+{
+  TP_NONCOPYABLE(CoreInterfaceJournal);
+public:
+  //################################################################################################
+  /*!
+  \param coreInterface - The interface to persist, this must outlive the journal.
+  \param codecs - Used to encode and decode payloads, this must outlive the journal.
+  */
+  CoreInterfaceJournal(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs);
+
+  //################################################################################################
+  ~CoreInterfaceJournal() override;
+
+  //################################################################################################
+  //! Restore the state saved at path into the interface
+  /*!
+  This sets each persisted channel, so channel changed callbacks will be called. It should be called
+  before open().
+
+  \param path - The base path, the files are path.checkpoint and path.journal.
+  \return The number of channel values that were applied.
+  */
+  size_t recover(const std::string& path);
+
+  //################################################################################################
+  //! Write a checkpoint of the current state and start journaling changes
+  /*!
+  \param path - The base path, the files are path.checkpoint and path.journal.
+  \param compactionBytes - Compact the journal into a new checkpoint when it grows past this.
+  \return True if the files were opened.
+  */
+  bool open(const std::string& path, size_t compactionBytes=size_t(64)<<20);
+
+  //################################################################################################
+  //! Stop journaling, the files are left in place so that they can be recovered
+  void close();
+
+  //################################################################################################
+  bool isOpen() const;
+
+  //################################################################################################
+  //! Write a new checkpoint and start the journal again
+  bool checkpoint();
+
+  //################################################################################################
+  //! Write a new checkpoint if the journal has grown past the compaction size
+  /*!
+  Call this regularly from the owner thread. If the checkpoint fails the compaction size is doubled
+  so that a failing disk is not retried on every call.
+
+  \return True if the journal was compacted.
+  */
+  bool compact();
+
+  //################################################################################################
+  //! Returns true if the journal has grown past the compaction size and compact() would compact it
+  bool compactionDue() const;
+
+  //################################################################################################
+  //! Write the journal through to the disk
+  /*!
+  This blocks until the changes journaled so far are on the storage device, so they survive the
+  machine going down as well as the process crashing.
+
+  \return True if the journal is on disk.
+  */
+  bool sync();
+
+  //################################################################################################
+  //! The number of bytes used in the journal
+  size_t journalBytes() const;
+
+  //################################################################################################
+  void channelDataSet(const CoreInterfaceHandle& handle, const CoreInterfaceData* data) override;
+
+private:
+  struct Private;
+  friend struct Private;
+  Private* d;
+};
+
+//##################################################################################################
+//! Write the value of every channel that has a codec to a checkpoint file
+/*!
+The file is written next to path and renamed over it once complete. If dirty tracking is enabled
+the dirty list is cleared, so that the next delta holds the changes since this checkpoint.
+
+\param coreInterface - The interface to save.
+\param codecs - Used to encode payloads, channels without a codec are not saved.
+\param path - The file to write.
+\return True if the checkpoint was written.
+*/
+bool TP_CONTROL_SHARED_EXPORT writeCheckpoint(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs, const std::string& path);
+
+//##################################################################################################
+//! Write only the channels that have changed since the last checkpoint or delta
+/*!
+This requires CoreInterface::setDirtyTracking() to be enabled, the cost of a delta depends on the
+number of channels that changed rather than the total number of channels. A sequence of deltas can
+be folded into a checkpoint with mergeCheckpointDeltas().
+
+\param coreInterface - The interface to save.
+\param codecs - Used to encode payloads, channels without a codec are not saved.
+\param path - The file to write.
+\return True if the delta was written, on failure the channels remain dirty.
+*/
+bool TP_CONTROL_SHARED_EXPORT writeCheckpointDelta(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs, const std::string& path);
+
+//##################################################################################################
+//! Fold a sequence of deltas into a checkpoint
+/*!
+Payloads are copied as bytes so no codecs are needed. The output may be the same file as the base.
+
+\param basePath - A checkpoint written by writeCheckpoint() or a previous merge.
+\param deltaPaths - Deltas written by writeCheckpointDelta(), oldest first.
+\param outputPath - The checkpoint to write.
+\return True if the output was written.
+*/
+bool TP_CONTROL_SHARED_EXPORT mergeCheckpointDeltas(const std::string& basePath, const std::vector<std::string>& deltaPaths, const std::string& outputPath);
+
+//##################################################################################################
+//! Set the channels saved in a checkpoint or delta file
+/*!
+\return The number of channels that were set.
+*/
+size_t TP_CONTROL_SHARED_EXPORT loadCheckpoint(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs, const std::string& path);
+
+//##################################################################################################
+//! Restores channels from a checkpoint the first time that they are read
+/*!
+Rather than decoding every channel up front the checkpoint is mapped and a sorted index of its
+records is built alongside it, the index is kept and reused while the checkpoint is unchanged.
+Pass this to CoreInterface::setStateSource() and a channel is looked up in the index when handle()
+creates it and decoded when its data is first read.
+
+Channels that are never requested are not listed by CoreInterface::channels() so writeCheckpoint()
+will not save them. To keep them enable dirty tracking, write deltas with writeCheckpointDelta(),
+and fold the deltas into the checkpoint with mergeCheckpointDeltas().
+*/
+class TP_CONTROL_SHARED_EXPORT CoreInterfaceLazyCheckpoint : public CoreInterfaceStateSource
+{
+  TP_NONCOPYABLE(CoreInterfaceLazyCheckpoint);
+public:
+  //################################################################################################
+  /*!
+  \param codecs - Used to decode payloads, this must outlive the checkpoint.
+  */
+  CoreInterfaceLazyCheckpoint(const CoreInterfaceCodecs* codecs);
+
+  //################################################################################################
+  ~CoreInterfaceLazyCheckpoint() override;
+
+  //################################################################################################
+  //! Map a checkpoint and its index, building the index if it is missing or out of date
+  /*!
+  \param path - A checkpoint written by writeCheckpoint() or mergeCheckpointDeltas().
+  \param indexPath - Where the index is kept, if this is empty path.index is used. The index records
+  the inode, modification time, size, and a sample hash of the checkpoint it was built from, and is
+  rebuilt if any of these differ, so an index at any path is safe to reuse after the checkpoint has
+  been replaced. An index with entries that point outside the checkpoint is also rebuilt.
+  \return True if the checkpoint was opened.
+  */
+  bool open(const std::string& path, const std::string& indexPath=std::string());
+
+  //################################################################################################
+  //! Unmap the files, this must not be the state source of an interface with unread channels
+  void close();
+
+  //################################################################################################
+  //! The number of channels in the checkpoint
+  size_t size() const;
+
+  //################################################################################################
+  uint64_t find(const tp_utils::StringID& typeID, const tp_utils::StringID& nameID) const override;
+
+  //################################################################################################
+  CoreInterfaceData* load(const tp_utils::StringID& typeID, uint64_t token) const override;
+
+private:
+  struct Private;
+  friend struct Private;
+  Private* d;
+};
+
+}
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef tp_control_CoreInterfaceRecorder_h
+#define tp_control_CoreInterfaceRecorder_h
+
+#include "tp_control/CoreInterface.h"
+
+namespace tp_control
+{
+class CoreInterfaceCodecs;
+
+//##################################################################################################
+//! Records the traffic through a core interface to an append only memory mapped log
+/*!
+Each handle creation, setChannelData() and sendSignal() is written to the log with a timestamp.
+Strings are written once and then referenced by index, and the log is written through a memory
+mapping so recording does not make a syscall per event. Payloads are encoded using the codecs, types
+without a codec are recorded without their payload.
+
+The log can be played back into another CoreInterface using CoreInterfaceReplayer.
+*/
+class TP_CONTROL_SHARED_EXPORT CoreInterfaceRecorder : public CoreInterfaceObserver
+{
+  TP_NONCOPYABLE(CoreInterfaceRecorder);
+public:
+  //################################################################################################
+  /*!
+  \param coreInterface - The interface to record, this must outlive the recorder.
+  \param codecs - Used to encode payloads, can be nullptr, this must outlive the recorder.
+  */
+  CoreInterfaceRecorder(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs=nullptr);
+
+  //################################################################################################
+  ~CoreInterfaceRecorder() override;
+
+  //################################################################################################
+  //! Start recording to a new log file
+  /*!
+  \param path - The file to write, any existing file will be replaced.
+  \param initialSize - The initial size of the mapping, this will grow as required.
+  \return True if the log file was opened.
+  */
+  bool start(const std::string& path, size_t initialSize=1<<20);
+
+  //################################################################################################
+  //! Stop recording and truncate the log to the size used
+  void stop();
+
+  //################################################################################################
+  bool isRecording() const;
+
+  //################################################################################################
+  //! The number of events that have been recorded since start()
+  size_t eventCount() const;
+
+  //################################################################################################
+  //! The number of bytes used in the log
+  size_t bytesWritten() const;
+
+  //################################################################################################
+  void handleCreated(const CoreInterfaceHandle& handle) override;
+
+  //################################################################################################
+  void channelDataSet(const CoreInterfaceHandle& handle, const CoreInterfaceData* data) override;
+
+  //################################################################################################
+  void signalSent(const tp_utils::StringID& typeID, const CoreInterfaceData* data) override;
+
+private:
+  struct Private;
+  friend struct Private;
+  Private* d;
+};
+
+//##################################################################################################
+//! Plays back a log written by CoreInterfaceRecorder into a core interface
+class TP_CONTROL_SHARED_EXPORT CoreInterfaceReplayer
+{
+  TP_NONCOPYABLE(CoreInterfaceReplayer);
+public:
+  //################################################################################################
+  /*!
+  \param codecs - Used to decode payloads, can be nullptr, this must outlive the replayer.
+  */
+  CoreInterfaceReplayer(const CoreInterfaceCodecs* codecs=nullptr);
+
+  //################################################################################################
+  ~CoreInterfaceReplayer();
+
+  //################################################################################################
+  //! Map a log file for playback
+  bool open(const std::string& path);
+
+  //################################################################################################
+  void close();
+
+  //################################################################################################
+  //! Play the log into a core interface
+  /*!
+  This blocks until the log has been played. Events that were made by callbacks during recording are
+  skipped by default, as the subscribers in the target interface are expected to make them again.
+
+  Records are checked before they are played, playback stops at the first record that is truncated,
+  has an unknown kind, or refers to a string that has not been written, see isCorrupt().
+
+  \param coreInterface - The interface to drive, this should be called on its owner thread.
+  \param speed - 1.0 plays at the recorded speed, 2.0 twice as fast, 0.0 as fast as possible.
+  \param topLevelOnly - Skip events that were made from inside callbacks.
+  \return The number of events that were played.
+  */
+  size_t replay(CoreInterface* coreInterface, double speed=1.0, bool topLevelOnly=true);
+
+  //################################################################################################
+  //! Returns true if the last call to replay() stopped at a corrupt record
+  bool isCorrupt() const;
+
+private:
+  struct Private;
+  friend struct Private;
+  Private* d;
+};
+
+}
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef tp_control_CoreInterfaceSeqlockChannel_h
+#define tp_control_CoreInterfaceSeqlockChannel_h
+
+#include "tp_control/CoreInterfaceValue.h"
+
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+namespace tp_control
+{
+
+//##################################################################################################
+//! A channel holding a small trivially copyable value that any thread can read
+/*!
+The channel is an ordinary CoreInterfaceValue<T> channel, it is set on the owner thread and its
+callbacks are called as normal. Alongside that the value is copied into a seqlock each time the
+channel is set, by set() or by anything else calling CoreInterface::setChannelData(), so other
+threads such as a render thread can read a consistent copy with read() without taking a lock and
+without taking part in callback dispatch.
+
+The writer never waits. read() is lock-free but not wait-free, it retries for as long as it keeps
+overlapping a write, so keep T small. A reader that must not wait, such as one with a frame
+deadline, should use tryRead() which gives up after a bounded number of attempts.
+
+The channel registers a callback on its own channel so other channels do not pay for it, create
+and destroy it on the owner thread.
+*/
+template<typename T>
+class CoreInterfaceSeqlockChannel
+{
+  static_assert(std::is_trivially_copyable<T>::value, "CoreInterfaceSeqlockChannel requires a trivially copyable type.");
+  TP_NONCOPYABLE(CoreInterfaceSeqlockChannel);
+public:
+  //################################################################################################
+  CoreInterfaceSeqlockChannel(CoreInterface* coreInterface,
+                              const tp_utils::StringID& typeID,
+                              const tp_utils::StringID& nameID,
+                              const T& value=T()):
+    m_coreInterface(coreInterface),
+    m_handle(coreInterface->handle(typeID, nameID))
+  {
+    m_callback = [this](const tp_utils::StringID&, const tp_utils::StringID&, const CoreInterfaceData* data)
+    {
+      auto v = dynamic_cast<const CoreInterfaceValue<T>*>(data);
+      if(v)
+        write(v->value);
+    };
+
+    // With deferred channel creation registering the callback creates the channel.
+    m_coreInterface->registerCallback(&m_callback, m_handle);
+    m_handle = m_coreInterface->handle(typeID, nameID);
+
+    auto current = dynamic_cast<const CoreInterfaceValue<T>*>(m_handle.data());
+    if(current)
+      write(current->value);
+    else
+      set(value);
+  }
+
+  //################################################################################################
+  ~CoreInterfaceSeqlockChannel()
+  {
+    m_coreInterface->unregisterCallback(&m_callback, m_handle);
+  }
+
+  //################################################################################################
+  const CoreInterfaceHandle& handle() const
+  {
+    return m_handle;
+  }
+
+  //################################################################################################
+  //! Set the channel, this must be called on the owner thread
+  void set(const T& value)
+  {
+    m_coreInterface->setChannelData(m_handle, new CoreInterfaceValue<T>(value));
+  }
+
+  //################################################################################################
+  //! Take a consistent copy of the value, this can be called from any thread
+  /*!
+  This spins until it gets a copy that no write overlapped, use tryRead() to bound the wait.
+
+  \return The number of times the value has been written.
+  */
+  uint64_t read(T& value) const
+  {
+    for(;;)
+    {
+      uint64_t before = m_sequence.load(std::memory_order_acquire);
+      if(before&1)
+        continue;
+
+      memcpy(&value, &m_value, sizeof(T));
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if(m_sequence.load(std::memory_order_relaxed)==before)
+        return before/2;
+    }
+  }
+
+  //################################################################################################
+  //! Returns a consistent copy of the value, this can be called from any thread
+  T read() const
+  {
+    T value;
+    read(value);
+    return value;
+  }
+
+  //################################################################################################
+  //! Try to take a consistent copy of the value, this can be called from any thread
+  /*!
+  Each attempt that overlaps a write is retried, up to maxAttempts attempts in total.
+
+  \param value - Receives the value, this is only modified if a consistent copy was taken.
+  \param maxAttempts - The number of attempts to make before giving up.
+  \param version - If not null set to the number of times the value has been written.
+  \return True if a consistent copy was taken.
+  */
+  bool tryRead(T& value, size_t maxAttempts=64, uint64_t* version=nullptr) const
+  {
+    for(size_t attempt=0; attempt<maxAttempts; attempt++)
+    {
+      uint64_t before = m_sequence.load(std::memory_order_acquire);
+      if(before&1)
+        continue;
+
+      T copy;
+      memcpy(&copy, &m_value, sizeof(T));
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if(m_sequence.load(std::memory_order_relaxed)==before)
+      {
+        value = copy;
+        if(version)
+          *version = before/2;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+private:
+  //################################################################################################
+  void write(const T& value)
+  {
+    uint64_t sequence = m_sequence.load(std::memory_order_relaxed);
+    m_sequence.store(sequence+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&m_value, &value, sizeof(T));
+    m_sequence.store(sequence+2, std::memory_order_release);
+  }
+
+  CoreInterface* m_coreInterface;
+  CoreInterfaceHandle m_handle;
+  ChannelChangedCallback m_callback;
+
+  // Keep the lock on its own cache line so readers don't contend with the owner's other writes.
+  alignas(64) std::atomic<uint64_t> m_sequence{0};
+  T m_value;
+};
+
+}
+
+#endif
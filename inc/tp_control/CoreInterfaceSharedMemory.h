@@ -0,0 +1,170 @@
+#ifndef tp_control_CoreInterfaceSharedMemory_h
+#define tp_control_CoreInterfaceSharedMemory_h
+
+#include "tp_control/CoreInterface.h"
+
+#include <type_traits>
+
+namespace tp_control
+{
+class CoreInterfaceCodecs;
+
+//##################################################################################################
+//! Mirrors selected channel types into a memory mapped region that other processes can read
+/*!
+Each mirrored channel gets a fixed size slot in the region. Slots are written under a seqlock so a
+reader in another process can take a consistent copy without locks or syscalls, and the index of
+each changed slot is pushed to a notification ring that readers can poll.
+
+Payloads are encoded with the codecs, so for POD payloads the codec should just copy the bytes.
+Payloads that encode to more than the slot capacity are not mirrored.
+
+Use a path in /dev/shm on Linux to keep the region in memory.
+*/
+class TP_CONTROL_SHARED_EXPORT CoreInterfaceSharedMemoryMirror : public CoreInterfaceObserver
+{
+  TP_NONCOPYABLE(CoreInterfaceSharedMemoryMirror);
+public:
+  //################################################################################################
+  /*!
+  \param coreInterface - The interface to mirror, this must outlive the mirror.
+  \param codecs - Used to encode payloads, this must outlive the mirror.
+  */
+  CoreInterfaceSharedMemoryMirror(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs);
+
+  //################################################################################################
+  ~CoreInterfaceSharedMemoryMirror() override;
+
+  //################################################################################################
+  //! Create the shared region and start mirroring
+  /*!
+  An existing region is reinitialized in place rather than truncated, so readers that still have it
+  mapped are not faulted, their reads report ReadStatus::Stale and they should reopen.
+
+  \param path - The file to map.
+  \param slotCount - The maximum number of channels that can be mirrored.
+  \param payloadCapacity - The maximum encoded size of a channel's data.
+  \param ringCapacity - The number of change notifications kept for readers.
+  \return True if the region was created.
+  */
+  bool open(const std::string& path, size_t slotCount=1024, size_t payloadCapacity=256, size_t ringCapacity=4096);
+
+  //################################################################################################
+  void close();
+
+  //################################################################################################
+  //! Mirror channels of this type, existing channels with data are written immediately
+  void addChannelType(const tp_utils::StringID& typeID);
+
+  //################################################################################################
+  void removeChannelType(const tp_utils::StringID& typeID);
+
+  //################################################################################################
+  void handleCreated(const CoreInterfaceHandle& handle) override;
+
+  //################################################################################################
+  void channelDataSet(const CoreInterfaceHandle& handle, const CoreInterfaceData* data) override;
+
+private:
+  struct Private;
+  friend struct Private;
+  Private* d;
+};
+
+//##################################################################################################
+//! Reads channels from a region written by CoreInterfaceSharedMemoryMirror
+/*!
+The reader maps the region read only, once a slot has been found reads do not make any syscalls.
+This can be used from any thread, but a single reader should not be used from multiple threads.
+
+If the mirror opens the region again, for example after the writing process restarts, the slots
+the reader found are no longer valid. Reads then return ReadStatus::Stale and findSlot() and
+pollChanges() fail until the reader is reopened.
+*/
+class TP_CONTROL_SHARED_EXPORT CoreInterfaceSharedMemoryReader
+{
+  TP_NONCOPYABLE(CoreInterfaceSharedMemoryReader);
+public:
+  //################################################################################################
+  //! The result of reading a slot
+  enum class ReadStatus
+  {
+    Ok,       //!< The payload was copied into the buffer.
+    NoData,   //!< The slot is not valid or has not been written yet.
+    TooLarge, //!< The payload does not fit in the buffer, size is set to the size required.
+    Busy,     //!< The slot stayed locked for every attempt, the writer may have died mid write.
+    Stale     //!< The mirror has reopened the region, the reader should be reopened.
+  };
+
+  //################################################################################################
+  CoreInterfaceSharedMemoryReader();
+
+  //################################################################################################
+  ~CoreInterfaceSharedMemoryReader();
+
+  //################################################################################################
+  bool open(const std::string& path);
+
+  //################################################################################################
+  void close();
+
+  //################################################################################################
+  //! Find the slot for a channel
+  /*!
+  \return The slot index or -1 if the channel is not mirrored yet.
+  */
+  int findSlot(const std::string& typeID, const std::string& nameID) const;
+
+  //################################################################################################
+  //! The typeID and nameID of a slot
+  bool slotIDs(int slot, std::string& typeID, std::string& nameID) const;
+
+  //################################################################################################
+  //! Take a consistent copy of a slot's payload
+  /*!
+  The copy is retried while the writer is part way through writing the slot, a bounded number of
+  times so that a writer that died mid write does not hang the reader.
+
+  \param slot - The index returned by findSlot().
+  \param buffer - Receives the payload, this must be at least capacity bytes.
+  \param capacity - The size of buffer.
+  \param size - Set to the size of the payload.
+  \param version - If not null set to the number of times the slot has been written.
+  \return ReadStatus::Ok if the slot has data and it was copied into buffer.
+  */
+  ReadStatus read(int slot, void* buffer, size_t capacity, size_t& size, uint64_t* version=nullptr) const;
+
+  //################################################################################################
+  //! Take a consistent copy of a slot that holds a trivially copyable value
+  /*!
+  \return ReadStatus::Ok if the slot holds a value of the size of T, ReadStatus::TooLarge if the
+  payload is a different size.
+  */
+  template<typename T>
+  ReadStatus readValue(int slot, T& value, uint64_t* version=nullptr) const
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "readValue() requires a trivially copyable type.");
+    size_t size=0;
+    ReadStatus status = read(slot, &value, sizeof(T), size, version);
+    return (status==ReadStatus::Ok && size!=sizeof(T))?ReadStatus::TooLarge:status;
+  }
+
+  //################################################################################################
+  //! Collect the slots that have changed since the cursor
+  /*!
+  \param cursor - Pass 0 the first time, this is updated to the position of the last change read.
+  \param slots - Changed slots are appended to this, a slot may appear more than once.
+  \return False if the reader fell behind and changes were lost, the caller should re-read all slots,
+  or if the region is stale.
+  */
+  bool pollChanges(uint64_t& cursor, std::vector<int>& slots) const;
+
+private:
+  struct Private;
+  friend struct Private;
+  Private* d;
+};
+
+}
+
+#endif
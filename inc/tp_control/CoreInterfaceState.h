@@ -0,0 +1,52 @@
+#ifndef tp_control_CoreInterfaceState_h
+#define tp_control_CoreInterfaceState_h
+
+#include "tp_control/CoreInterface.h"
+
+#include <iosfwd>
+
+namespace tp_control
+{
+class CoreInterfaceCodecs;
+
+//##################################################################################################
+// The JSON state of an interface has the form:
+// {"channels":[{"typeID":"...", "nameID":"...", "data":...}, ...]}
+//
+// Each channel is written with CoreInterfaceHandle::saveState() and the data is converted with the
+// saveState and loadState functions of the codec for its type. Channels with null data are written
+// without a "data" member, and types without a JSON codec are not saved.
+
+//##################################################################################################
+//! Returns the JSON state of every channel that has a JSON codec
+nlohmann::json TP_CONTROL_SHARED_EXPORT saveCoreInterfaceState(const CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs);
+
+//##################################################################################################
+//! Write the JSON state to a stream one channel at a time
+/*!
+This produces the same document as saveCoreInterfaceState() without building it in memory.
+*/
+void TP_CONTROL_SHARED_EXPORT saveCoreInterfaceState(const CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs, std::ostream& stream);
+
+//##################################################################################################
+//! Set the channels in a parsed JSON state
+/*!
+\return The number of channels that were set.
+*/
+size_t TP_CONTROL_SHARED_EXPORT loadCoreInterfaceState(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs, const nlohmann::json& j);
+
+//##################################################################################################
+//! Set the channels in a JSON state as they are read from a stream
+/*!
+The stream is parsed with the nlohmann SAX interface rather than into a DOM, so only one channel is
+held in memory at a time and each channel is set as soon as it has been read. Members other than
+"channels" are skipped. If the document is malformed a warning is printed and the channels read
+before the error are left set.
+
+\return The number of channels that were set.
+*/
+size_t TP_CONTROL_SHARED_EXPORT loadCoreInterfaceState(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs, std::istream& stream);
+
+}
+
+#endif
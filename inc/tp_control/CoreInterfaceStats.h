@@ -0,0 +1,115 @@
+#ifndef tp_control_CoreInterfaceStats_h
+#define tp_control_CoreInterfaceStats_h
+
+#include "tp_control/Globals.h"
+
+#include "tp_utils/StringID.h"
+
+#include "json.hpp"
+
+#include <array>
+#include <unordered_map>
+
+namespace tp_control
+{
+
+//##################################################################################################
+//! Returns true if tp_control was built with TP_CONTROL_INSTRUMENTATION defined
+/*!
+The counters and histograms are only collected when the library is built with
+TP_CONTROL_INSTRUMENTATION, otherwise the instrumentation is compiled out of the dispatch loops and
+CoreInterface::stats() returns empty stats.
+*/
+bool TP_CONTROL_SHARED_EXPORT instrumentationEnabled();
+
+//##################################################################################################
+//! A histogram of durations in log2 nanosecond buckets
+/*!
+Bucket i counts durations in the range [2^i, 2^(i+1)) nanoseconds, with durations under 1ns in the
+first bucket and durations over ~4s in the last.
+*/
+struct TP_CONTROL_SHARED_EXPORT LatencyHistogram
+{
+  static constexpr size_t bucketCount=32;
+
+  std::array<uint64_t, bucketCount> buckets{};
+  uint64_t count{0};
+  int64_t totalNS{0};
+  int64_t maxNS{0};
+
+  //################################################################################################
+  void add(int64_t ns);
+
+  //################################################################################################
+  //! Returns the upper bound of the bucket that contains the given fraction of samples
+  int64_t percentileNS(double fraction) const;
+
+  //################################################################################################
+  double meanNS() const;
+
+  //################################################################################################
+  nlohmann::json saveState() const;
+};
+
+//##################################################################################################
+//! Counters for a channel or a channel type
+struct TP_CONTROL_SHARED_EXPORT ChannelStats
+{
+  uint64_t setCount{0};        //!< The number of calls to setChannelData() that changed the data.
+  uint64_t suppressedCount{0}; //!< The number of calls skipped because the data was equal, per type only.
+  LatencyHistogram dispatch;   //!< The time taken to call all of the channel changed callbacks.
+
+  //################################################################################################
+  nlohmann::json saveState() const;
+};
+
+//##################################################################################################
+//! Counters for a signal type
+struct TP_CONTROL_SHARED_EXPORT SignalStats
+{
+  uint64_t sendCount{0};           //!< The number of calls to sendSignal().
+  uint64_t callbackInvocations{0}; //!< The total fan-out for this signal type.
+  LatencyHistogram dispatch;       //!< The time taken to call all of the signal callbacks.
+
+  //################################################################################################
+  nlohmann::json saveState() const;
+};
+
+//##################################################################################################
+//! Counters for a single registered callback
+struct TP_CONTROL_SHARED_EXPORT CallbackStats
+{
+  std::string tag;          //!< The tag set with CoreInterface::setCallbackTag().
+  uint64_t invocations{0};
+  LatencyHistogram latency;
+
+  //################################################################################################
+  nlohmann::json saveState() const;
+};
+
+//##################################################################################################
+//! A snapshot of the instrumentation counters of a CoreInterface
+struct TP_CONTROL_SHARED_EXPORT CoreInterfaceStats
+{
+  //! Stats by channel typeID.
+  std::unordered_map<tp_utils::StringID, ChannelStats> channelTypes;
+
+  //! Stats by channel typeID then nameID.
+  std::unordered_map<tp_utils::StringID, std::unordered_map<tp_utils::StringID, ChannelStats>> channels;
+
+  //! Stats by signal typeID.
+  std::unordered_map<tp_utils::StringID, SignalStats> signals;
+
+  //! Stats by callback pointer.
+  std::unordered_map<const void*, CallbackStats> callbacks;
+
+  //################################################################################################
+  void clear();
+
+  //################################################################################################
+  nlohmann::json saveState() const;
+};
+
+}
+
+#endif
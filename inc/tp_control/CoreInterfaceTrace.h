@@ -0,0 +1,70 @@
+#ifndef tp_control_CoreInterfaceTrace_h
+#define tp_control_CoreInterfaceTrace_h
+
+#include "tp_control/CoreInterface.h"
+
+namespace tp_control
+{
+
+//##################################################################################################
+//! Records begin and end events around CoreInterface callbacks for viewing in Perfetto
+/*!
+When tracing is running each callback invoked by CoreInterface::handle(), setChannelData() and
+sendSignal() is wrapped in a begin and end event, along with a span for the dispatch as a whole.
+Events are written to a fixed size buffer per thread without taking locks, once a buffer is full
+further events from that thread are dropped and counted.
+
+The trace can be exported in the Chrome trace_event JSON format which can be loaded into Perfetto or
+chrome://tracing.
+
+Tracing is part of the instrumentation and is only available if tp_control was built with
+TP_CONTROL_INSTRUMENTATION defined, see instrumentationEnabled().
+*/
+class TP_CONTROL_SHARED_EXPORT CoreInterfaceTrace
+{
+public:
+  //################################################################################################
+  //! Discard any existing events and start tracing
+  /*!
+  This should not be called while other threads are dispatching.
+
+  \param eventsPerThread - The capacity of each thread's event buffer.
+  */
+  static void start(size_t eventsPerThread=1<<16);
+
+  //################################################################################################
+  //! Stop recording events, recorded events are kept until the next call to start()
+  static void stop();
+
+  //################################################################################################
+  static bool isTracing();
+
+  //################################################################################################
+  //! The number of events dropped because a thread's buffer was full
+  static size_t droppedEvents();
+
+  //################################################################################################
+  //! Export the recorded events in the Chrome trace_event format
+  /*!
+  \param coreInterface - If set callbacks are named using CoreInterface::callbackTag(), this should
+  be called on the owner thread of that interface.
+  \return JSON containing a "traceEvents" array.
+  */
+  static nlohmann::json saveChromeTrace(const CoreInterface* coreInterface=nullptr);
+
+  //################################################################################################
+  //! Write the output of saveChromeTrace() to a file
+  static bool writeChromeTrace(const std::string& path, const CoreInterface* coreInterface=nullptr);
+
+  //################################################################################################
+  //! Record the start of a dispatch or a callback, callback is nullptr for the dispatch span.
+  static void begin(DispatchKind kind, const void* callback, const tp_utils::StringID& typeID, const tp_utils::StringID& nameID);
+
+  //################################################################################################
+  //! Record the end of a dispatch or callback.
+  static void end(DispatchKind kind, const void* callback, const tp_utils::StringID& typeID, const tp_utils::StringID& nameID);
+};
+
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef tp_control_CoreInterfaceValue_h
+#define tp_control_CoreInterfaceValue_h
+
+#include "tp_control/CoreInterface.h"
+
+namespace tp_control
+{
+
+//##################################################################################################
+//! Channel or signal data that holds a single value of type T
+/*!
+This implements CoreInterfaceData::equals() using T::operator==, so setting a channel to a value
+that it already holds is skipped along with the channel changed callbacks.
+*/
+template<typename T>
+class CoreInterfaceValue : public CoreInterfaceData
+{
+public:
+  T value;
+
+  //################################################################################################
+  CoreInterfaceValue()=default;
+
+  //################################################################################################
+  CoreInterfaceValue(const T& value_):
+    value(value_)
+  {
+
+  }
+
+  //################################################################################################
+  CoreInterfaceValue(T&& value_):
+    value(std::move(value_))
+  {
+
+  }
+
+  //################################################################################################
+  bool equals(const CoreInterfaceData* other) const override
+  {
+    auto o = dynamic_cast<const CoreInterfaceValue<T>*>(other);
+    return o && o->value==value;
+  }
+
+  //################################################################################################
+  CoreInterfaceData* clone() const override
+  {
+    return new CoreInterfaceValue<T>(value);
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef tp_control_CoreInterfaceWatchdog_h
+#define tp_control_CoreInterfaceWatchdog_h
+
+#include "tp_control/CoreInterface.h"
+
+namespace tp_control
+{
+
+//##################################################################################################
+//! Details of a callback that took longer than its budget
+struct TP_CONTROL_SHARED_EXPORT SlowCallbackReport
+{
+  DispatchKind kind{DispatchKind::Signal};
+  tp_utils::StringID typeID;
+  tp_utils::StringID nameID;      //!< Invalid for signals.
+  const void* callback{nullptr};
+  std::string tag;                //!< The tag set with CoreInterface::setCallbackTag().
+  int64_t durationNS{0};          //!< How long the callback took.
+  int64_t budgetNS{0};            //!< The budget that it exceeded.
+  size_t offenceCount{0};         //!< How many times this callback has exceeded budget for typeID.
+
+  //################################################################################################
+  nlohmann::json saveState() const;
+};
+
+//##################################################################################################
+//! Called each time a callback exceeds its budget
+typedef std::function<void(const SlowCallbackReport& report)> SlowCallbackHandler;
+
+//##################################################################################################
+//! Reports callbacks that take longer than a time budget
+/*!
+Budgets are set per signal type and per channel type, with an optional default for types that don't
+have their own budget. Callbacks are only timed when the type being dispatched has a budget, so
+types without a budget cost a single lookup per dispatch.
+
+Each time a callback exceeds its budget the handler is called, by default this prints a warning.
+The worst offenders are kept and can be queried with offenders().
+
+The watchdog attaches itself to the interface in its constructor and detaches in its destructor, an
+interface can only have one watchdog at a time.
+*/
+class TP_CONTROL_SHARED_EXPORT CoreInterfaceWatchdog
+{
+  TP_NONCOPYABLE(CoreInterfaceWatchdog);
+public:
+  //################################################################################################
+  CoreInterfaceWatchdog(CoreInterface* coreInterface);
+
+  //################################################################################################
+  ~CoreInterfaceWatchdog();
+
+  //################################################################################################
+  //! Set the budget for callbacks of a signal type, 0 removes the budget
+  void setSignalBudget(const tp_utils::StringID& typeID, int64_t budgetNS);
+
+  //################################################################################################
+  //! Set the budget for callbacks of a channel type, 0 removes the budget
+  void setChannelBudget(const tp_utils::StringID& typeID, int64_t budgetNS);
+
+  //################################################################################################
+  //! Set the budget for all types that don't have their own budget, 0 disables it
+  void setDefaultBudget(int64_t budgetNS);
+
+  //################################################################################################
+  //! Replace the default handler that prints a warning
+  void setHandler(const SlowCallbackHandler& handler);
+
+  //################################################################################################
+  //! The most recent report for each callback and type that has exceeded its budget
+  /*!
+  \return Reports sorted by offenceCount, most frequent first.
+  */
+  std::vector<SlowCallbackReport> offenders() const;
+
+  //################################################################################################
+  void clearOffenders();
+
+  //################################################################################################
+  nlohmann::json saveState() const;
+
+  //################################################################################################
+  //! The budget for a dispatch or 0 if callbacks should not be timed, called by CoreInterface
+  int64_t budgetNS(DispatchKind kind, const tp_utils::StringID& typeID) const;
+
+  //################################################################################################
+  //! Called by CoreInterface when a callback exceeds its budget
+  void callbackExceededBudget(DispatchKind kind,
+                              const void* callback,
+                              const tp_utils::StringID& typeID,
+                              const tp_utils::StringID& nameID,
+                              int64_t durationNS,
+                              int64_t budgetNS);
+
+private:
+  struct Private;
+  friend struct Private;
+  Private* d;
+};
+
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef tp_control_MappedFile_h
+#define tp_control_MappedFile_h
+
+#include "tp_control/Globals.h"
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace tp_control
+{
+
+//##################################################################################################
+//! A file mapped into memory
+/*!
+This is used by the logging and persistence classes in tp_control to read and write files without
+going through a syscall for each record. On platforms that do not support memory mapping open()
+will fail.
+*/
+class TP_CONTROL_SHARED_EXPORT MappedFile
+{
+  TP_NONCOPYABLE(MappedFile);
+public:
+  //################################################################################################
+  enum class Mode
+  {
+    ReadOnly,  //!< Map an existing file for reading.
+    ReadWrite, //!< Map a file for reading and writing, creating it if required.
+    Truncate   //!< Map a file for reading and writing, discarding any existing contents.
+  };
+
+  //################################################################################################
+  //! Identifies a version of a file on disk
+  /*!
+  A file that is replaced by a rename has a new inode, and a file that is rewritten in place has a
+  new modification time or size.
+  */
+  struct Identity
+  {
+    uint64_t device{0};
+    uint64_t inode{0};
+    int64_t modifiedNS{0};
+    uint64_t size{0};
+
+    //##############################################################################################
+    bool operator==(const Identity& other) const
+    {
+      return device==other.device && inode==other.inode && modifiedNS==other.modifiedNS && size==other.size;
+    }
+  };
+
+  //################################################################################################
+  MappedFile();
+
+  //################################################################################################
+  ~MappedFile();
+
+  //################################################################################################
+  //! Open and map a file
+  /*!
+  \param path - The path of the file to map.
+  \param mode - How the file should be opened.
+  \param size - For writable files the file will be grown to at least this many bytes.
+  \return True if the file was mapped.
+  */
+  bool open(const std::string& path, Mode mode, size_t size=0);
+
+  //################################################################################################
+  //! Grow or shrink a writable mapping, this will invalidate pointers returned by data()
+  bool resize(size_t size);
+
+  //################################################################################################
+  //! Write changes through to the disk
+  /*!
+  This blocks until the mapped pages and the file size have been written to the storage device, so
+  the data survives the machine going down as well as the process crashing.
+
+  \return True if the data is on disk.
+  */
+  bool sync();
+
+  //################################################################################################
+  //! Write the directory entries of the directory holding path through to the disk
+  /*!
+  A rename or a newly created file is not durable until its directory has been synced.
+
+  \param path - A file in the directory to sync.
+  \return True if the directory is on disk.
+  */
+  static bool syncDirectory(const std::string& path);
+
+  //################################################################################################
+  //! Unmap and close the file
+  /*!
+  \param finalSize - If this is a writable file it will be truncated to this size, use 0 to leave
+  the size unchanged.
+  */
+  void close(size_t finalSize=0);
+
+  //################################################################################################
+  bool isOpen() const;
+
+  //################################################################################################
+  char* data() const;
+
+  //################################################################################################
+  size_t size() const;
+
+  //################################################################################################
+  const std::string& path() const;
+
+  //################################################################################################
+  //! Returns the identity of the open file
+  /*!
+  This is read from the open descriptor, so it describes the file that is mapped even if the path
+  has since been replaced.
+  \return True if the file is open and the identity was read.
+  */
+  bool identity(Identity& identity) const;
+
+private:
+  struct Private;
+  friend struct Private;
+  Private* d;
+};
+
+}
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef tp_control_ScalarGroup_h
+#define tp_control_ScalarGroup_h
+
+#include "tp_control/Globals.h"
+
+#include "tp_utils/StringID.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace tp_control
+{
+class ScalarGroup;
+
+//##################################################################################################
+//! The callback for a bulk update of a scalar group, changed holds the indices that changed.
+typedef std::function<void(const ScalarGroup& group, const std::vector<size_t>& changed)> ScalarGroupChangedCallback;
+
+//##################################################################################################
+//! A large set of named scalars stored as contiguous arrays
+/*!
+Publishing thousands of telemetry values as individual channels costs an allocation and a callback
+fan-out per value. A scalar group instead holds each value, version, and timestamp in parallel
+arrays, values are updated in bulk and the callbacks are called once per update with the indices
+that actually changed.
+
+A scalar group is a separate utility, it is not connected to a CoreInterface. Its scalars are not
+channels, they can't be found with CoreInterface::handle() and are not saved with the state. To
+expose a scalar as a channel set the channel from one of the group's callbacks.
+
+Values are compared bitwise so setting NaN to NaN is not a change but setting -0.0 to 0.0 is.
+
+Like CoreInterface a scalar group should only be used from a single thread.
+*/
+class TP_CONTROL_SHARED_EXPORT ScalarGroup
+{
+  TP_NONCOPYABLE(ScalarGroup);
+public:
+  static constexpr size_t npos = size_t(-1);
+
+  //################################################################################################
+  ScalarGroup();
+
+  //################################################################################################
+  ~ScalarGroup();
+
+  //################################################################################################
+  //! Add a scalar to the group
+  /*!
+  \param nameID - The name of the scalar.
+  \param value - The initial value, this does not call the callbacks.
+  \return The index of the scalar, or the index of the existing scalar if the name is already used.
+  */
+  size_t addScalar(const tp_utils::StringID& nameID, double value=0.0);
+
+  //################################################################################################
+  //! Returns the index of a scalar or npos
+  size_t indexOf(const tp_utils::StringID& nameID) const;
+
+  //################################################################################################
+  //! The number of scalars in the group
+  size_t size() const;
+
+  //################################################################################################
+  const tp_utils::StringID& nameID(size_t index) const;
+
+  //################################################################################################
+  double value(size_t index) const;
+
+  //################################################################################################
+  //! The values of all scalars, size() long, invalidated by addScalar()
+  const double* values() const;
+
+  //################################################################################################
+  //! The number of times each scalar has changed, size() long, invalidated by addScalar()
+  const uint64_t* versions() const;
+
+  //################################################################################################
+  //! The time each scalar last changed from CoreInterfaceHistory::nowNS(), invalidated by addScalar()
+  const int64_t* timestamps() const;
+
+  //################################################################################################
+  //! Set many scalars by index
+  /*!
+  If an index appears more than once the last value wins, and the scalar has only changed if that
+  value differs from the one it held before the call. The callbacks are called once if any of the
+  values changed.
+
+  \param indices - The indices of the scalars to set, count long.
+  \param values - The new values, count long.
+  \param count - The number of values to set.
+  \return The number of scalars that changed.
+  */
+  size_t setBulk(const size_t* indices, const double* values, size_t count);
+
+  //################################################################################################
+  //! Set a contiguous run of scalars
+  /*!
+  This is the fast path for publishing a whole frame of telemetry, the comparison is a straight loop
+  over both arrays that the compiler can vectorize.
+
+  \param first - The index of the first scalar to set.
+  \param values - The new values, count long.
+  \param count - The number of values to set.
+  \return The number of scalars that changed.
+  */
+  size_t setRange(size_t first, const double* values, size_t count);
+
+  //################################################################################################
+  //! Register a callback for bulk updates
+  void registerCallback(const ScalarGroupChangedCallback* callback);
+
+  //################################################################################################
+  void unregisterCallback(const ScalarGroupChangedCallback* callback);
+
+private:
+  struct Private;
+  friend struct Private;
+  Private* d;
+};
+
+}
+
+#endif
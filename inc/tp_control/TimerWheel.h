@@ -0,0 +1,74 @@
+#ifndef tp_control_TimerWheel_h
+#define tp_control_TimerWheel_h
+
+#include "tp_control/Globals.h"
+
+#include <functional>
+#include <cstdint>
+
+namespace tp_control
+{
+
+//##################################################################################################
+//! A hierarchical timer wheel for one-shot and periodic timers
+/*!
+Time is divided into ticks of a fixed resolution and timers are kept in four levels of 256 slots.
+Each slot is an intrusive list so adding and cancelling a timer is constant time. A bitmap of the
+occupied slots lets advance() jump straight to the next tick that has timers to fire or cascade, so
+a long gap with nothing due costs a few bitmap scans rather than a step per tick.
+
+Timers that fall due in the same tick fire together in the order they were added, including timers
+that were cascaded down from a higher level. A periodic timer keeps the position of its first add.
+
+The wheel does not own a thread or read a clock, the owner calls advance() with the current time,
+and the callbacks are called from there. Callbacks may add and cancel timers, including themselves.
+*/
+class TP_CONTROL_SHARED_EXPORT TimerWheel
+{
+  TP_NONCOPYABLE(TimerWheel);
+public:
+  //################################################################################################
+  /*!
+  \param startNS - The time of tick 0, deadlines before this fire on the next advance().
+  \param resolutionNS - The length of a tick, timers fire on the first tick at or after their deadline.
+  */
+  TimerWheel(int64_t startNS, int64_t resolutionNS=1000000);
+
+  //################################################################################################
+  ~TimerWheel();
+
+  //################################################################################################
+  //! Add a timer
+  /*!
+  \param deadlineNS - When the timer should first fire.
+  \param periodNS - The interval to repeat at, or 0 for a one-shot timer. Periods shorter than a tick
+  are rounded up to a tick, and if advance() falls behind missed periods are skipped.
+  \param callback - Called from advance() each time the timer fires.
+  \return An ID that can be passed to cancel(), this is never 0.
+  */
+  uint64_t add(int64_t deadlineNS, int64_t periodNS, const std::function<void()>& callback);
+
+  //################################################################################################
+  //! Cancel a timer, returns false if it has already fired or been cancelled
+  bool cancel(uint64_t id);
+
+  //################################################################################################
+  //! Fire the timers that are due at nowNS
+  /*!
+  \return The number of callbacks that were called.
+  */
+  size_t advance(int64_t nowNS);
+
+  //################################################################################################
+  //! The number of timers that are waiting to fire
+  size_t size() const;
+
+private:
+  struct Private;
+  friend struct Private;
+  Private* d;
+};
+
+}
+
+#endif
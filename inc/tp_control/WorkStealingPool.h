@@ -0,0 +1,62 @@
+#ifndef tp_control_WorkStealingPool_h
+#define tp_control_WorkStealingPool_h
+
+#include "tp_control/Globals.h"
+
+#include <functional>
+#include <cstddef>
+
+namespace tp_control
+{
+
+//##################################################################################################
+//! A fixed set of worker threads that balance tasks between themselves by stealing
+/*!
+Each worker has its own queue, a worker takes the newest task from its own queue and when that is
+empty steals the oldest task from another. Tasks submitted from a worker go to that worker's queue
+and tasks submitted from other threads are spread across the queues.
+
+Threads that wait on the pool, in parallelFor() and runPendingTask(), run queued tasks rather than
+blocking so waiting from inside a task does not deadlock.
+*/
+class TP_CONTROL_SHARED_EXPORT WorkStealingPool
+{
+  TP_NONCOPYABLE(WorkStealingPool);
+public:
+  //################################################################################################
+  /*!
+  \param threadCount - The number of worker threads, 0 for one per hardware thread.
+  */
+  WorkStealingPool(size_t threadCount=0);
+
+  //################################################################################################
+  //! Runs any tasks that are still queued and then joins the worker threads
+  ~WorkStealingPool();
+
+  //################################################################################################
+  size_t threadCount() const;
+
+  //################################################################################################
+  //! Queue a task to be run on a worker
+  void submit(const std::function<void()>& task);
+
+  //################################################################################################
+  //! Call task(i) for each i in [0, count) across the workers and return when they have all run
+  void parallelFor(size_t count, const std::function<void(size_t index)>& task);
+
+  //################################################################################################
+  //! Run one queued task on the calling thread
+  /*!
+  \return False if there were no tasks queued.
+  */
+  bool runPendingTask();
+
+private:
+  struct Private;
+  friend struct Private;
+  Private* d;
+};
+
+}
+
+#endif
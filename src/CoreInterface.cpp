@@ -1,221 +1,1961 @@
 #include "tp_control/CoreInterface.h"
+#include "tp_control/CoreInterfaceHistory.h"
+#include "tp_control/CoreInterfaceStats.h"
+#include "tp_control/CoreInterfaceTrace.h"
+#include "tp_control/CoreInterfaceWatchdog.h"
+#include "tp_control/TimerWheel.h"
+#include "tp_control/WorkStealingPool.h"
 
 #include "tp_utils/JSONUtils.h"
+#include "tp_utils/DebugUtils.h"
 
+#include <algorithm>
+#include <atomic>
 #include <thread>
+#include <chrono>
 #include <cassert>
+#include <unordered_set>
 
 namespace tp_control
 {
+
+namespace
+{
+//##################################################################################################
+//! Checks that the interface is only used from the thread that created it.
+struct OwnerThreadPolicy
+{
+  static constexpr bool concurrent = true;
+  template<typename T> using Counter = std::atomic<T>;
+
+  std::thread::id ownerThread{std::this_thread::get_id()};
+
+  void check() const
+  {
+    assert(ownerThread==std::this_thread::get_id());
+  }
+};
+
+//##################################################################################################
+//! For builds that only ever use one thread, there are no checks and counters are plain integers.
+/*!
+The signal pool dispatch is compiled out, parallel signal callbacks and channel tasks run on the
+calling thread.
+*/
+struct SingleThreadPolicy
+{
+  static constexpr bool concurrent = false;
+  template<typename T> using Counter = T;
+
+  void check() const
+  {
+  }
+};
+
+#ifdef TP_CONTROL_SINGLE_THREADED
+typedef SingleThreadPolicy ThreadingPolicy;
+#else
+typedef OwnerThreadPolicy ThreadingPolicy;
+#endif
+}
+
+//##################################################################################################
+struct DerivedChannelPrivate
+{
+  std::vector<CoreInterfaceHandle> inputs;
+  std::vector<uint64_t> inputVersions;
+  DerivedChannelFunction function;
+  bool recomputeOnFlush{false};
+  bool computing{false};
+};
+
+//##################################################################################################
+//! The data held by a channel, owned outright until a shared reference is asked for.
+/*!
+Most channels are only ever read through data(), so setting a channel from a raw pointer does not
+pay for a shared_ptr control block. The control block is created the first time share() is called
+for a value, or comes with the data when it was set from a shared_ptr.
+*/
+class ChannelData
+{
+  CoreInterfaceData* m_data{nullptr};
+  std::shared_ptr<CoreInterfaceData> m_shared;
+public:
+  TP_NONCOPYABLE(ChannelData);
+
+  //################################################################################################
+  ChannelData()=default;
+
+  //################################################################################################
+  ~ChannelData()
+  {
+    reset();
+  }
+
+  //################################################################################################
+  //! Take ownership of data.
+  void reset(CoreInterfaceData* data=nullptr)
+  {
+    if(!m_shared)
+      delete m_data;
+    m_shared.reset();
+    m_data = data;
+  }
+
+  //################################################################################################
+  //! Share ownership of data.
+  void reset(std::shared_ptr<CoreInterfaceData> data)
+  {
+    reset();
+    m_data = data.get();
+    m_shared = std::move(data);
+  }
+
+  //################################################################################################
+  CoreInterfaceData* get() const
+  {
+    return m_data;
+  }
+
+  //################################################################################################
+  //! Returns a shared reference, creating the control block if the data is not shared yet.
+  const std::shared_ptr<CoreInterfaceData>& share()
+  {
+    if(m_data && !m_shared)
+      m_shared.reset(m_data);
+    return m_shared;
+  }
+};
+
+//##################################################################################################
+//! The callbacks registered for a single channel.
+/*!
+Callbacks removed while the channel is being dispatched are set to nullptr and erased once the
+outermost dispatch of the channel completes, so the callbacks after them are not skipped.
+*/
+struct ChannelCallbacks
+{
+  std::vector<const ChannelChangedCallback*> callbacks;
+  size_t dispatching{0};
+  bool removed{false};
+};
+
 //##################################################################################################
 struct CoreInterfacePayloadPrivate
 {
   TP_NONCOPYABLE(CoreInterfacePayloadPrivate);
 
-  CoreInterfaceData* data{nullptr};
+  ChannelData data;
+  uint64_t version{0};
+  DerivedChannelPrivate* derived{nullptr};
+  CoreInterfaceHistory* history{nullptr};
+  ChannelCallbacks* callbacks{nullptr};
+  bool dirty{false};
+  bool taskChanged{false};
+
+  // Saved data that has not been loaded yet.
+  const CoreInterfaceStateSource* source{nullptr};
+  uint64_t sourceToken{0};
+  size_t* unloadedCount{nullptr};
+
+#ifdef TP_CONTROL_INSTRUMENTATION
+  ChannelStats* stats{nullptr};
+  ChannelStats* typeStats{nullptr};
+#endif
+
+  CoreInterfacePayloadPrivate()=default;
+
+  ~CoreInterfacePayloadPrivate()
+  {
+    delete history;
+    delete derived;
+    delete callbacks;
+  }
+
+  //################################################################################################
+  //! Drop the reference to saved data, loading it first if load is true.
+  void releaseSource(const tp_utils::StringID& typeID, bool load)
+  {
+    if(!source)
+      return;
+
+    const CoreInterfaceStateSource* s = source;
+    source = nullptr;
+    (*unloadedCount)--;
+
+    if(load)
+      data.reset(s->load(typeID, sourceToken));
+  }
+
+  //################################################################################################
+  void appendHistory()
+  {
+    if(history)
+      history->append(CoreInterfaceHistory::nowNS(), data.share());
+  }
+
+  //################################################################################################
+  //! Bring a derived channel up to date, returns true if it was recomputed.
+  bool updateDerived()
+  {
+    if(!derived || derived->computing)
+      return false;
+
+    derived->computing = true;
+
+    bool stale = derived->inputVersions.size()!=derived->inputs.size();
+    for(size_t i=0; i<derived->inputs.size(); i++)
+    {
+      CoreInterfacePayloadPrivate* input = derived->inputs.at(i).m_payload;
+      if(!input)
+        continue;
+
+      input->updateDerived();
+      if(stale || derived->inputVersions[i]!=input->version)
+        stale = true;
+    }
+
+    if(stale)
+    {
+      derived->inputVersions.resize(derived->inputs.size());
+      for(size_t i=0; i<derived->inputs.size(); i++)
+      {
+        CoreInterfacePayloadPrivate* input = derived->inputs.at(i).m_payload;
+        derived->inputVersions[i] = input?input->version:0;
+      }
+
+      data.reset(derived->function(derived->inputs));
+      version++;
+      appendHistory();
+    }
+
+    derived->computing = false;
+    return stale;
+  }
+};
+
+//##################################################################################################
+bool CoreInterfaceData::equals(const CoreInterfaceData* other) const
+{
+  TP_UNUSED(other);
+  return false;
+}
+
+//##################################################################################################
+CoreInterfaceData* CoreInterfaceData::clone() const
+{
+  return nullptr;
+}
+
+//##################################################################################################
+CoreInterfaceHandle::CoreInterfaceHandle(tp_utils::StringID typeID, tp_utils::StringID nameID):
+  m_typeID(std::move(typeID)),
+  m_nameID(std::move(nameID))
+{
+}
+
+//##################################################################################################
+const tp_utils::StringID& CoreInterfaceHandle::typeID() const
+{
+  return m_typeID;
+}
+
+//##################################################################################################
+const tp_utils::StringID& CoreInterfaceHandle::nameID() const
+{
+  return m_nameID;
+}
+
+//##################################################################################################
+bool CoreInterfaceHandle::operator==(const CoreInterfaceHandle& other)const
+{
+  if(m_payload && other.m_payload)
+    return m_payload == other.m_payload;
+
+  // At least one is invalid or from deferred channel creation.
+  return m_typeID.isValid() && m_nameID.isValid() && m_typeID==other.m_typeID && m_nameID==other.m_nameID;
+}
+
+//##################################################################################################
+CoreInterfaceData* CoreInterfaceHandle::data() const
+{
+  if(!m_payload)
+    return nullptr;
+
+  if(m_payload->source)
+    m_payload->releaseSource(m_typeID, true);
+
+  if(m_payload->derived)
+    m_payload->updateDerived();
+
+  return m_payload->data.get();
+}
+
+//##################################################################################################
+std::shared_ptr<const CoreInterfaceData> CoreInterfaceHandle::sharedData() const
+{
+  if(!m_payload)
+    return std::shared_ptr<const CoreInterfaceData>();
+
+  if(m_payload->source)
+    m_payload->releaseSource(m_typeID, true);
+
+  if(m_payload->derived)
+    m_payload->updateDerived();
+
+  return m_payload->data.share();
+}
+
+//##################################################################################################
+uint64_t CoreInterfaceHandle::version() const
+{
+  return m_payload?m_payload->version:0;
+}
+
+//##################################################################################################
+nlohmann::json CoreInterfaceHandle::saveState() const
+{
+  nlohmann::json j;
+  j["typeID"] = m_typeID.toString();
+  j["nameID"] = m_nameID.toString();
+  return j;
+}
+
+//##################################################################################################
+void CoreInterfaceHandle::loadState(const nlohmann::json& j, CoreInterface* coreInterface)
+{
+  (*this) = coreInterface->handle(TPJSONString(j, "typeID"), TPJSONString(j, "nameID"));
+}
+
+//##################################################################################################
+bool lessThanCoreInterfaceHandle(const CoreInterfaceHandle& lhs, const CoreInterfaceHandle& rhs)
+{
+  return lhs.nameID().toString() < rhs.nameID().toString();
+}
+
+//##################################################################################################
+void CoreInterfaceObserver::handleCreated(const CoreInterfaceHandle& handle)
+{
+  TP_UNUSED(handle);
+}
+
+//##################################################################################################
+void CoreInterfaceObserver::channelDataSet(const CoreInterfaceHandle& handle, const CoreInterfaceData* data)
+{
+  TP_UNUSED(handle);
+  TP_UNUSED(data);
+}
+
+//##################################################################################################
+void CoreInterfaceObserver::signalSent(const tp_utils::StringID& typeID, const CoreInterfaceData* data)
+{
+  TP_UNUSED(typeID);
+  TP_UNUSED(data);
+}
+
+//##################################################################################################
+struct RateLimitedState
+{
+  bool windowOpen{false};
+  bool pending{false};
+  uint64_t timerID{0};
+  CoreInterfaceHandle handle;                   //!< The channel, for channel callbacks.
+  std::shared_ptr<CoreInterfaceData> data;      //!< The pending signal payload, for signal callbacks.
+};
+
+//##################################################################################################
+struct RateLimitedCallback
+{
+  RateLimit rateLimit;
+  const ChannelChangedCallback* channelCallback{nullptr};
+  const SignalCallback* signalCallback{nullptr};
+  tp_utils::StringID typeID;
+
+  std::unordered_map<const CoreInterfacePayloadPrivate*, RateLimitedState> channels;
+  RateLimitedState signal;
+};
+
+//##################################################################################################
+struct CoreInterface::Private
+{
+  TP_NONCOPYABLE(Private);
+
+  ThreadingPolicy threading;
+
+  std::unordered_map<tp_utils::StringID, std::unordered_map<tp_utils::StringID, CoreInterfaceHandle>> channels;
+
+  // The channels indexed by CoreInterfaceChannelKey::hash, the handles are owned by channels.
+  std::unordered_multimap<uint64_t, const CoreInterfaceHandle*> channelKeys;
+
+  // Unique for the life of the process, used to check CoreInterfaceCachedHandle.
+  uint64_t instanceID{nextInstanceID()};
+
+  std::vector<const ChannelChangedCallback*> channelChangeCallbacks;
+  std::vector<const ChannelListChangedCallback*> channelListChangedCallbacks;
+  std::unordered_map<tp_utils::StringID, std::vector<const SignalCallback*>> signalCallbacks;
+
+  // Signal callbacks that may run on signalPool, and the number of them left running by sendSignalAsync().
+  std::unordered_map<tp_utils::StringID, std::vector<const SignalCallback*>> parallelSignalCallbacks;
+  WorkStealingPool* signalPool{nullptr};
+  ThreadingPolicy::Counter<size_t> asyncSignalTasks{0};
+
+  std::vector<CoreInterfaceObserver*> observers;
+  size_t dispatchDepth{0};
+
+  // Derived channels in dependency order, inputs before the channels that read them. Sorting is
+  // left to flushDerivedChannels() so that adding many channels does not sort after each one.
+  std::vector<CoreInterfaceHandle> derivedChannels;
+  bool derivedChannelsSorted{true};
+
+  std::unordered_map<const void*, std::string> callbackTags;
+  CoreInterfaceWatchdog* watchdog{nullptr};
+
+  // Created when the first timer is added.
+  TimerWheel* timers{nullptr};
+  int64_t servicedNS{0};
+
+  // Rate limited callbacks are kept apart so that they cost nothing when none are registered.
+  // Callbacks unregistered while these are being iterated are set to nullptr and erased once the
+  // outermost iteration completes.
+  std::vector<RateLimitedCallback*> rateLimitedChannelCallbacks;
+  std::unordered_map<tp_utils::StringID, std::vector<RateLimitedCallback*>> rateLimitedSignalCallbacks;
+  size_t rateLimitedDispatching{0};
+  bool rateLimitedRemoved{false};
+
+  bool dirtyTracking{false};
+  std::vector<CoreInterfaceHandle> dirtyChannels;
+
+  // Channel tasks in registration order, and the channels they read that changed since the last flush.
+  struct ChannelTask
+  {
+    const ChannelTaskFunction* function;
+    std::vector<CoreInterfaceHandle> reads;
+    std::vector<CoreInterfaceHandle> writes;
+  };
+  std::vector<ChannelTask> channelTasks;
+  std::vector<CoreInterfaceHandle> taskChanges;
+  bool flushingTasks{false};
+
+  bool deferChannelCreation{false};
+
+  // Set by CoreInterfaceChannelListChanges, the callbacks are called once when the outermost ends.
+  size_t channelListChangesDepth{0};
+  bool channelListChangesPending{false};
+
+  const CoreInterfaceStateSource* stateSource{nullptr};
+  size_t unloadedCount{0};
+
+#ifdef TP_CONTROL_INSTRUMENTATION
+  CoreInterfaceStats stats;
+#endif
+
+  Private()=default;
+
+  //################################################################################################
+  ~Private()
+  {
+    for(auto r : rateLimitedChannelCallbacks)
+      delete r;
+
+    for(const auto& i : rateLimitedSignalCallbacks)
+      for(auto r : i.second)
+        delete r;
+
+    delete timers;
+
+    for(const auto& i : channels)
+      for(const auto& j : i.second)
+        delete j.second.m_payload;
+  }
+
+  //################################################################################################
+  static uint64_t nextInstanceID()
+  {
+    static ThreadingPolicy::Counter<uint64_t> next{1};
+    return next++;
+  }
+
+  //################################################################################################
+  void checkThread()
+  {
+    threading.check();
+  }
+
+  //################################################################################################
+  struct DispatchScope
+  {
+    TP_NONCOPYABLE(DispatchScope);
+    Private* d;
+    DispatchScope(Private* d_):d(d_){d->dispatchDepth++;}
+    ~DispatchScope(){d->dispatchDepth--;}
+  };
+
+  //################################################################################################
+  static int64_t nowNS()
+  {
+    return CoreInterface::nowNS();
+  }
+
+  //################################################################################################
+  TimerWheel& timerWheel()
+  {
+    if(!timers)
+      timers = new TimerWheel(timerNowNS());
+    return *timers;
+  }
+
+  //################################################################################################
+  //! The time that new timers are measured from, this never falls behind the last serviced time.
+  int64_t timerNowNS() const
+  {
+    return std::max(nowNS(), servicedNS);
+  }
+
+  //################################################################################################
+  //! The watchdog budget for the callbacks in a dispatch, 0 if they should not be timed.
+  int64_t budgetNS(DispatchKind kind, const tp_utils::StringID& typeID) const
+  {
+    return watchdog?watchdog->budgetNS(kind, typeID):0;
+  }
+
+  //################################################################################################
+  //! Call a single callback, this is where per callback instrumentation is collected.
+  template<typename F>
+  void invoke(DispatchKind kind, int64_t budgetNS, const void* callback, const tp_utils::StringID& typeID, const tp_utils::StringID& nameID, const F& f)
+  {
+#ifdef TP_CONTROL_INSTRUMENTATION
+    CoreInterfaceTrace::begin(kind, callback, typeID, nameID);
+    int64_t start = nowNS();
+    f();
+    int64_t duration = nowNS()-start;
+    CoreInterfaceTrace::end(kind, callback, typeID, nameID);
+
+    CallbackStats& s = stats.callbacks[callback];
+    s.invocations++;
+    s.latency.add(duration);
+#else
+    if(budgetNS<=0)
+    {
+      f();
+      return;
+    }
+
+    int64_t start = nowNS();
+    f();
+    int64_t duration = nowNS()-start;
+#endif
+
+    // The watchdog may have been removed by the callback.
+    if(budgetNS>0 && duration>budgetNS && watchdog)
+      watchdog->callbackExceededBudget(kind, callback, typeID, nameID, duration, budgetNS);
+  }
+
+  //################################################################################################
+  //! Call the channel list changed callbacks, the IDs are those of the new channel if there is one.
+  void channelListChanged(const tp_utils::StringID& typeID, const tp_utils::StringID& nameID)
+  {
+#ifdef TP_CONTROL_INSTRUMENTATION
+    CoreInterfaceTrace::begin(DispatchKind::ChannelList, nullptr, typeID, nameID);
+#endif
+
+    {
+      int64_t budget = budgetNS(DispatchKind::ChannelList, typeID);
+      DispatchScope scope(this);
+      for(const auto& c : channelListChangedCallbacks)
+        invoke(DispatchKind::ChannelList, budget, c, typeID, nameID, [&]{(*c)();});
+    }
+
+#ifdef TP_CONTROL_INSTRUMENTATION
+    CoreInterfaceTrace::end(DispatchKind::ChannelList, nullptr, typeID, nameID);
+#endif
+  }
+
+  //################################################################################################
+  //! Call the callbacks for a signal, if async is set the parallel callbacks are left running.
+  void sendSignal(const tp_utils::StringID& typeID, CoreInterfaceData* data, const std::shared_ptr<CoreInterfaceData>* async)
+  {
+    for(const auto& o : observers)
+      o->signalSent(typeID, data);
+
+    const auto& callbacks = signalCallbacks[typeID];
+
+    tp_utils::StringID noNameID;
+
+#ifdef TP_CONTROL_INSTRUMENTATION
+    CoreInterfaceTrace::begin(DispatchKind::Signal, nullptr, typeID, noNameID);
+    int64_t start = nowNS();
+
+    // Counted up front as callbacks may unregister themselves.
+    size_t callbackCount = callbacks.size();
+#endif
+
+    // Parallel callbacks are started first so that they overlap with the other callbacks.
+    ThreadingPolicy::Counter<size_t> remaining{0};
+    size_t parallelCount=0;
+    if(!parallelSignalCallbacks.empty())
+    {
+      auto p = parallelSignalCallbacks.find(typeID);
+      if(p!=parallelSignalCallbacks.end())
+      {
+        parallelCount = p->second.size();
+        if(!ThreadingPolicy::concurrent || !signalPool)
+        {
+          DispatchScope scope(this);
+          for(const auto& c : p->second)
+            (*c)(typeID, data);
+        }
+        else if(async)
+        {
+          std::shared_ptr<CoreInterfaceData> keepAlive = *async;
+          asyncSignalTasks += parallelCount;
+          for(const auto& c : p->second)
+          {
+            signalPool->submit([this, c, typeID, keepAlive]
+            {
+              (*c)(typeID, keepAlive.get());
+              asyncSignalTasks--;
+            });
+          }
+        }
+        else
+        {
+          remaining = parallelCount;
+          for(const auto& c : p->second)
+          {
+            signalPool->submit([c, &typeID, data, &remaining]
+            {
+              (*c)(typeID, data);
+              remaining--;
+            });
+          }
+        }
+      }
+    }
+
+    {
+      int64_t budget = budgetNS(DispatchKind::Signal, typeID);
+      DispatchScope scope(this);
+      for(size_t i=0; i<callbacks.size(); i++)
+      {
+        const SignalCallback* c = callbacks[i];
+        invoke(DispatchKind::Signal, budget, c, typeID, noNameID, [&]{(*c)(typeID, data);});
+      }
+    }
+
+    if(!rateLimitedSignalCallbacks.empty())
+    {
+      auto l = rateLimitedSignalCallbacks.find(typeID);
+      if(l!=rateLimitedSignalCallbacks.end())
+      {
+        // Entries are not erased while dispatching so the reference stays valid.
+        const std::vector<RateLimitedCallback*>& limited = l->second;
+        rateLimitedDispatching++;
+        for(size_t i=0; i<limited.size(); i++)
+          if(RateLimitedCallback* r = limited[i])
+            rateLimitedEvent(r, r->signal, data);
+        endRateLimitedDispatch();
+      }
+    }
+
+    // Join the parallel callbacks, running queued tasks rather than blocking.
+    while(remaining>0)
+      if(!signalPool->runPendingTask())
+        std::this_thread::yield();
+
+#ifdef TP_CONTROL_INSTRUMENTATION
+    CoreInterfaceTrace::end(DispatchKind::Signal, nullptr, typeID, noNameID);
+    SignalStats& s = stats.signals[typeID];
+    s.sendCount++;
+    s.callbackInvocations += callbackCount + parallelCount;
+    s.dispatch.add(nowNS()-start);
+#endif
+  }
+
+  //################################################################################################
+  //! Returns true if target is reachable by following derived inputs from handle.
+  static bool dependsOn(const CoreInterfaceHandle& handle, const CoreInterfacePayloadPrivate* target)
+  {
+    if(handle.m_payload==target)
+      return true;
+
+    if(!handle.m_payload || !handle.m_payload->derived)
+      return false;
+
+    for(const auto& input : handle.m_payload->derived->inputs)
+      if(dependsOn(input, target))
+        return true;
+
+    return false;
+  }
+
+  //################################################################################################
+  //! Sort derivedChannels so that inputs come before the channels that read them.
+  void sortDerivedChannels()
+  {
+    std::vector<CoreInterfaceHandle> sorted;
+    sorted.reserve(derivedChannels.size());
+
+    std::unordered_set<const CoreInterfacePayloadPrivate*> visited;
+    visited.reserve(derivedChannels.size());
+
+    std::function<void(const CoreInterfaceHandle&)> visit = [&](const CoreInterfaceHandle& handle)
+    {
+      if(!handle.m_payload || !handle.m_payload->derived || !visited.insert(handle.m_payload).second)
+        return;
+
+      for(const auto& input : handle.m_payload->derived->inputs)
+        visit(input);
+
+      sorted.push_back(handle);
+    };
+
+    for(const auto& handle : derivedChannels)
+      visit(handle);
+
+    derivedChannels.swap(sorted);
+    derivedChannelsSorted = true;
+  }
+
+  //################################################################################################
+  //! Erase the rate limited callbacks that were unregistered during the outermost dispatch.
+  void endRateLimitedDispatch()
+  {
+    if(--rateLimitedDispatching || !rateLimitedRemoved)
+      return;
+
+    rateLimitedRemoved = false;
+    auto& channelLimited = rateLimitedChannelCallbacks;
+    channelLimited.erase(std::remove(channelLimited.begin(), channelLimited.end(), nullptr), channelLimited.end());
+    for(auto i=rateLimitedSignalCallbacks.begin(); i!=rateLimitedSignalCallbacks.end();)
+    {
+      auto& limited = i->second;
+      limited.erase(std::remove(limited.begin(), limited.end(), nullptr), limited.end());
+      if(limited.empty())
+        i = rateLimitedSignalCallbacks.erase(i);
+      else
+        ++i;
+    }
+  }
+
+  //################################################################################################
+  //! Remove a rate limited callback from its list, deferring the erase while dispatching.
+  void removeRateLimitedCallback(std::vector<RateLimitedCallback*>& limited, std::vector<RateLimitedCallback*>::iterator i)
+  {
+    RateLimitedCallback* r = *i;
+    if(rateLimitedDispatching)
+    {
+      *i = nullptr;
+      rateLimitedRemoved = true;
+    }
+    else
+      limited.erase(i);
+
+    deleteRateLimitedCallback(r);
+  }
+
+  //################################################################################################
+  //! Call a rate limited callback, r and s may be deleted by the callback.
+  void deliver(RateLimitedCallback* r, const CoreInterfaceHandle& handle_, const CoreInterfaceData* data)
+  {
+    DispatchScope scope(this);
+    if(r->channelCallback)
+    {
+      const ChannelChangedCallback* c = r->channelCallback;
+      CoreInterfaceHandle handle = handle_;
+      invoke(DispatchKind::Channel, budgetNS(DispatchKind::Channel, handle.m_typeID), c, handle.m_typeID, handle.m_nameID, [&]
+      {
+        (*c)(handle.m_typeID, handle.m_nameID, handle.m_payload->data.get());
+      });
+    }
+    else
+    {
+      const SignalCallback* c = r->signalCallback;
+      tp_utils::StringID typeID = r->typeID;
+      invoke(DispatchKind::Signal, budgetNS(DispatchKind::Signal, typeID), c, typeID, tp_utils::StringID(), [&]
+      {
+        (*c)(typeID, data);
+      });
+    }
+  }
+
+  //################################################################################################
+  void startRateLimitTimer(RateLimitedCallback* r, RateLimitedState* s)
+  {
+    s->timerID = timerWheel().add(timerNowNS()+r->rateLimit.intervalNS, 0, [this, r, s]
+    {
+      rateLimitTimer(r, s);
+    });
+  }
+
+  //################################################################################################
+  //! An event for a rate limited callback, signalData is only used for signal callbacks.
+  void rateLimitedEvent(RateLimitedCallback* r, RateLimitedState& s, const CoreInterfaceData* signalData)
+  {
+    const RateLimit& rateLimit = r->rateLimit;
+
+    if(!s.windowOpen)
+    {
+      s.windowOpen = true;
+      startRateLimitTimer(r, &s);
+
+      if(rateLimit.leading || !rateLimit.trailing)
+      {
+        deliver(r, s.handle, signalData);
+        return;
+      }
+    }
+    else if(rateLimit.mode==RateLimit::Mode::Debounce)
+    {
+      timers->cancel(s.timerID);
+      startRateLimitTimer(r, &s);
+    }
+
+    if(rateLimit.trailing)
+    {
+      s.pending = true;
+      if(r->signalCallback)
+        s.data.reset(signalData?signalData->clone():nullptr);
+    }
+  }
+
+  //################################################################################################
+  //! The end of the interval of a rate limited callback.
+  void rateLimitTimer(RateLimitedCallback* r, RateLimitedState* s)
+  {
+    s->timerID = 0;
+    if(!s->pending)
+    {
+      closeRateLimitWindow(r, s);
+      return;
+    }
+
+    s->pending = false;
+    std::shared_ptr<CoreInterfaceData> data;
+    data.swap(s->data);
+    CoreInterfaceHandle handle = s->handle;
+
+    // A throttled callback starts a new interval when it delivers the trailing event.
+    if(r->rateLimit.mode==RateLimit::Mode::Throttle)
+      startRateLimitTimer(r, s);
+    else
+      closeRateLimitWindow(r, s);
+
+    deliver(r, handle, data.get());
+  }
+
+  //################################################################################################
+  //! Close the window of a rate limited callback, the state of a channel is erased until it changes again.
+  void closeRateLimitWindow(RateLimitedCallback* r, RateLimitedState* s)
+  {
+    s->windowOpen = false;
+    if(r->channelCallback)
+      r->channels.erase(s->handle.m_payload);
+  }
+
+  //################################################################################################
+  void deleteRateLimitedCallback(RateLimitedCallback* r)
+  {
+    if(timers)
+    {
+      for(const auto& i : r->channels)
+        timers->cancel(i.second.timerID);
+      timers->cancel(r->signal.timerID);
+    }
+    delete r;
+  }
+
+  //################################################################################################
+  //! Returns false if data should be discarded because it equals the current data.
+  bool acceptChannelData(const CoreInterfaceHandle& handle, const CoreInterfaceData* data)
+  {
+    // Saved data that was never read is superseded.
+    handle.m_payload->releaseSource(handle.m_typeID, false);
+
+    if(data && handle.m_payload->data.get() && data->equals(handle.m_payload->data.get()))
+    {
+#ifdef TP_CONTROL_INSTRUMENTATION
+      stats.channelTypes[handle.m_typeID].suppressedCount++;
+#endif
+      return false;
+    }
+
+    return true;
+  }
+
+  //################################################################################################
+  //! Record a change to the data of a channel and call the callbacks.
+  void channelDataSet(const CoreInterfaceHandle& handle)
+  {
+    handle.m_payload->version++;
+    handle.m_payload->appendHistory();
+
+    if(dirtyTracking && !handle.m_payload->dirty)
+    {
+      handle.m_payload->dirty = true;
+      dirtyChannels.push_back(handle);
+    }
+
+    if(!channelTasks.empty() && !flushingTasks && !handle.m_payload->taskChanged)
+    {
+      handle.m_payload->taskChanged = true;
+      taskChanges.push_back(handle);
+    }
+
+    for(const auto& o : observers)
+      o->channelDataSet(handle, handle.m_payload->data.get());
+
+    channelChanged(handle);
+  }
+
+  //################################################################################################
+  //! Call the channel changed callbacks for a channel that has new data.
+  void channelChanged(const CoreInterfaceHandle& handle)
+  {
+#ifdef TP_CONTROL_INSTRUMENTATION
+    CoreInterfacePayloadPrivate* payload = handle.m_payload;
+    if(!payload->stats)
+    {
+      payload->stats = &stats.channels[handle.m_typeID][handle.m_nameID];
+      payload->typeStats = &stats.channelTypes[handle.m_typeID];
+    }
+    CoreInterfaceTrace::begin(DispatchKind::Channel, nullptr, handle.m_typeID, handle.m_nameID);
+    int64_t start = nowNS();
+#endif
+
+    {
+      int64_t budget = budgetNS(DispatchKind::Channel, handle.m_typeID);
+      DispatchScope scope(this);
+      for(const auto& c : channelChangeCallbacks)
+        invoke(DispatchKind::Channel, budget, c, handle.m_typeID, handle.m_nameID, [&]{(*c)(handle.m_typeID, handle.m_nameID, handle.m_payload->data.get());});
+
+      if(ChannelCallbacks* cc = handle.m_payload->callbacks)
+      {
+        cc->dispatching++;
+        for(size_t i=0; i<cc->callbacks.size(); i++)
+          if(const ChannelChangedCallback* c = cc->callbacks[i])
+            invoke(DispatchKind::Channel, budget, c, handle.m_typeID, handle.m_nameID, [&]{(*c)(handle.m_typeID, handle.m_nameID, handle.m_payload->data.get());});
+
+        if(--cc->dispatching==0 && cc->removed)
+        {
+          cc->removed = false;
+          cc->callbacks.erase(std::remove(cc->callbacks.begin(), cc->callbacks.end(), nullptr), cc->callbacks.end());
+          if(cc->callbacks.empty())
+          {
+            delete cc;
+            handle.m_payload->callbacks = nullptr;
+          }
+        }
+      }
+    }
+
+    if(!rateLimitedChannelCallbacks.empty())
+    {
+      rateLimitedDispatching++;
+      for(size_t i=0; i<rateLimitedChannelCallbacks.size(); i++)
+      {
+        if(RateLimitedCallback* r = rateLimitedChannelCallbacks[i])
+        {
+          RateLimitedState& s = r->channels[handle.m_payload];
+          s.handle = handle;
+          rateLimitedEvent(r, s, nullptr);
+        }
+      }
+      endRateLimitedDispatch();
+    }
+
+#ifdef TP_CONTROL_INSTRUMENTATION
+    int64_t duration = nowNS()-start;
+    CoreInterfaceTrace::end(DispatchKind::Channel, nullptr, handle.m_typeID, handle.m_nameID);
+    payload->stats->setCount++;
+    payload->stats->dispatch.add(duration);
+    payload->typeStats->setCount++;
+    payload->typeStats->dispatch.add(duration);
+#endif
+  }
+};
+
+//##################################################################################################
+CoreInterface::CoreInterface():
+  d(new Private())
+{
+
+}
+
+//##################################################################################################
+CoreInterface::~CoreInterface()
+{
+  d->checkThread();
+  waitForSignals();
+  delete d;
+}
+
+//##################################################################################################
+const std::unordered_map<tp_utils::StringID, std::unordered_map<tp_utils::StringID, CoreInterfaceHandle>>& CoreInterface::channels()const
+{
+  d->checkThread();
+  return d->channels;
+}
+
+//##################################################################################################
+void CoreInterface::registerCallback(const ChannelListChangedCallback* callback)
+{
+  d->checkThread();
+  d->channelListChangedCallbacks.push_back(callback);
+}
+
+//##################################################################################################
+void CoreInterface::unregisterCallback(const ChannelListChangedCallback* callback)
+{
+  d->checkThread();
+  tpRemoveOne(d->channelListChangedCallbacks, callback);
+}
+
+//##################################################################################################
+CoreInterfaceHandle CoreInterface::handle(const tp_utils::StringID& typeID, const tp_utils::StringID& nameID)
+{
+  d->checkThread();
+  if(!typeID.isValid() || !nameID.isValid())
+    return CoreInterfaceHandle();
+
+  if(d->deferChannelCreation)
+  {
+    auto t = d->channels.find(typeID);
+    if(t!=d->channels.end())
+    {
+      auto n = t->second.find(nameID);
+      if(n!=t->second.end())
+        return n->second;
+    }
+
+    // Channels with saved data already exist as far as the caller is concerned.
+    if(!d->stateSource || !d->stateSource->find(typeID, nameID))
+      return CoreInterfaceHandle(typeID, nameID);
+  }
+
+  return createHandle(typeID, nameID);
+}
+
+//##################################################################################################
+CoreInterfaceHandle CoreInterface::createHandle(const tp_utils::StringID& typeID, const tp_utils::StringID& nameID)
+{
+  CoreInterfaceHandle& localHandle = d->channels[typeID][nameID];
+
+  if(!localHandle.m_payload)
+  {
+    localHandle.m_payload = new CoreInterfacePayloadPrivate;
+    localHandle.m_typeID = typeID;
+    localHandle.m_nameID = nameID;
+    d->channelKeys.emplace(CoreInterfaceChannelKey::hashOf(typeID.toString(), nameID.toString()), &localHandle);
+
+    if(d->stateSource)
+    {
+      uint64_t token = d->stateSource->find(typeID, nameID);
+      if(token)
+      {
+        localHandle.m_payload->source = d->stateSource;
+        localHandle.m_payload->sourceToken = token;
+        localHandle.m_payload->unloadedCount = &d->unloadedCount;
+        d->unloadedCount++;
+      }
+    }
+
+    for(const auto& o : d->observers)
+      o->handleCreated(localHandle);
+
+    if(d->channelListChangesDepth)
+      d->channelListChangesPending = true;
+    else
+      d->channelListChanged(typeID, nameID);
+  }
+
+  return localHandle;
+}
+
+//##################################################################################################
+CoreInterfaceHandle CoreInterface::resolveHandle(const CoreInterfaceHandle& handle, const char* caller)
+{
+  if(handle.m_payload || !handle.m_typeID.isValid() || !handle.m_nameID.isValid())
+    return handle;
+
+  if(d->deferChannelCreation)
+    return createHandle(handle.m_typeID, handle.m_nameID);
+
+  tpWarning() << "CoreInterface::" << caller << "() handle from deferred channel creation used after it was disabled: " << handle.m_typeID.toString() << " " << handle.m_nameID.toString();
+  return CoreInterfaceHandle();
+}
+
+//##################################################################################################
+void CoreInterface::beginChannelListChanges()
+{
+  d->checkThread();
+  d->channelListChangesDepth++;
+}
+
+//##################################################################################################
+void CoreInterface::endChannelListChanges()
+{
+  d->checkThread();
+  assert(d->channelListChangesDepth>0);
+  if(d->channelListChangesDepth==0 || --d->channelListChangesDepth>0 || !d->channelListChangesPending)
+    return;
+
+  d->channelListChangesPending = false;
+  d->channelListChanged(tp_utils::StringID(), tp_utils::StringID());
+}
+
+//##################################################################################################
+CoreInterfaceHandle CoreInterface::findHandle(const tp_utils::StringID& typeID, const tp_utils::StringID& nameID) const
+{
+  d->checkThread();
+
+  auto t = d->channels.find(typeID);
+  if(t==d->channels.end())
+    return CoreInterfaceHandle();
+
+  auto n = t->second.find(nameID);
+  return (n!=t->second.end())?n->second:CoreInterfaceHandle();
+}
+
+//##################################################################################################
+CoreInterfaceHandle CoreInterface::findHandle(const CoreInterfaceChannelKey& key) const
+{
+  d->checkThread();
+
+  auto range = d->channelKeys.equal_range(key.hash);
+  for(auto i=range.first; i!=range.second; ++i)
+  {
+    const CoreInterfaceHandle* handle = i->second;
+    if(handle->m_nameID.toString()==key.nameID && handle->m_typeID.toString()==key.typeID)
+      return *handle;
+  }
+
+  return CoreInterfaceHandle();
+}
+
+//##################################################################################################
+void CoreInterface::registerCallback(const ChannelChangedCallback* callback)
+{
+  d->checkThread();
+  d->channelChangeCallbacks.push_back(callback);
+}
+
+//##################################################################################################
+void CoreInterface::registerCallback(const ChannelChangedCallback* callback, const RateLimit& rateLimit)
+{
+  d->checkThread();
+  auto r = new RateLimitedCallback();
+  r->rateLimit = rateLimit;
+  r->channelCallback = callback;
+  d->rateLimitedChannelCallbacks.push_back(r);
+}
+
+//##################################################################################################
+void CoreInterface::registerCallback(const ChannelChangedCallback* callback, const CoreInterfaceHandle& handle_)
+{
+  d->checkThread();
+  CoreInterfaceHandle handle = resolveHandle(handle_, "registerCallback");
+  if(!handle.m_payload)
+    return;
+
+  if(!handle.m_payload->callbacks)
+    handle.m_payload->callbacks = new ChannelCallbacks();
+  handle.m_payload->callbacks->callbacks.push_back(callback);
+}
+
+//##################################################################################################
+void CoreInterface::unregisterCallback(const ChannelChangedCallback* callback, const CoreInterfaceHandle& handle)
+{
+  d->checkThread();
+  ChannelCallbacks* cc = handle.m_payload?handle.m_payload->callbacks:nullptr;
+  if(!cc)
+    return;
+
+  auto i = std::find(cc->callbacks.begin(), cc->callbacks.end(), callback);
+  if(i==cc->callbacks.end())
+    return;
+
+  if(cc->dispatching)
+  {
+    *i = nullptr;
+    cc->removed = true;
+    return;
+  }
+
+  cc->callbacks.erase(i);
+  if(cc->callbacks.empty())
+  {
+    delete cc;
+    handle.m_payload->callbacks = nullptr;
+  }
+}
+
+//##################################################################################################
+void CoreInterface::unregisterCallback(const ChannelChangedCallback* callback)
+{
+  d->checkThread();
+  tpRemoveOne(d->channelChangeCallbacks, callback);
+
+  auto& limited = d->rateLimitedChannelCallbacks;
+  for(auto i=limited.begin(); i!=limited.end(); ++i)
+  {
+    if(*i && (*i)->channelCallback==callback)
+    {
+      d->removeRateLimitedCallback(limited, i);
+      break;
+    }
+  }
+}
+
+//##################################################################################################
+void CoreInterface::setChannelData(const CoreInterfaceHandle& handle, CoreInterfaceData* data)
+{
+  d->checkThread();
+  if(!handle.m_payload)
+  {
+    // A handle from deferred channel creation, the channel is created by its first set.
+    CoreInterfaceHandle created = resolveHandle(handle, "setChannelData");
+    if(created.m_payload)
+      setChannelData(created, data);
+    else
+      delete data;
+    return;
+  }
+
+  if(!d->acceptChannelData(handle, data))
+  {
+    delete data;
+    return;
+  }
+
+  handle.m_payload->data.reset(data);
+  d->channelDataSet(handle);
+}
+
+//##################################################################################################
+void CoreInterface::setChannelData(const CoreInterfaceHandle& handle, std::shared_ptr<CoreInterfaceData> data)
+{
+  d->checkThread();
+  if(!handle.m_payload)
+  {
+    // A handle from deferred channel creation, the channel is created by its first set.
+    CoreInterfaceHandle created = resolveHandle(handle, "setChannelData");
+    if(created.m_payload)
+      setChannelData(created, std::move(data));
+    return;
+  }
+
+  if(!d->acceptChannelData(handle, data.get()))
+    return;
+
+  // Readers holding a sharedData() reference keep the old data alive.
+  handle.m_payload->data.reset(std::move(data));
+  d->channelDataSet(handle);
+}
+
+//##################################################################################################
+bool CoreInterface::setDerivedChannel(const CoreInterfaceHandle& handle_,
+                                      const std::vector<CoreInterfaceHandle>& inputs_,
+                                      const DerivedChannelFunction& function,
+                                      bool recomputeOnFlush)
+{
+  d->checkThread();
+  CoreInterfaceHandle handle = resolveHandle(handle_, "setDerivedChannel");
+  if(!handle.m_payload || !function)
+    return false;
+
+  std::vector<CoreInterfaceHandle> inputs;
+  inputs.reserve(inputs_.size());
+  for(const auto& input : inputs_)
+    inputs.push_back(resolveHandle(input, "setDerivedChannel"));
+
+  // The function and inputs are in use until the computation returns.
+  if(handle.m_payload->derived && handle.m_payload->derived->computing)
+  {
+    tpWarning() << "CoreInterface::setDerivedChannel() called while the channel is being computed: " << handle.m_typeID.toString() << " " << handle.m_nameID.toString();
+    return false;
+  }
+
+  for(const auto& input : inputs)
+  {
+    if(Private::dependsOn(input, handle.m_payload))
+    {
+      tpWarning() << "CoreInterface::setDerivedChannel() cycle detected for: " << handle.m_typeID.toString() << " " << handle.m_nameID.toString();
+      return false;
+    }
+  }
+
+  if(!handle.m_payload->derived)
+  {
+    handle.m_payload->derived = new DerivedChannelPrivate();
+    d->derivedChannels.push_back(handle);
+  }
+
+  DerivedChannelPrivate* derived = handle.m_payload->derived;
+  derived->inputs = inputs;
+  derived->inputVersions.clear();
+  derived->function = function;
+  derived->recomputeOnFlush = recomputeOnFlush;
 
-  CoreInterfacePayloadPrivate()=default;
+  d->derivedChannelsSorted = false;
+  return true;
+}
 
-  ~CoreInterfacePayloadPrivate()
+//##################################################################################################
+void CoreInterface::removeDerivedChannel(const CoreInterfaceHandle& handle)
+{
+  d->checkThread();
+  if(!handle.m_payload || !handle.m_payload->derived)
+    return;
+
+  if(handle.m_payload->derived->computing)
   {
-    delete data;
+    tpWarning() << "CoreInterface::removeDerivedChannel() called while the channel is being computed: " << handle.m_typeID.toString() << " " << handle.m_nameID.toString();
+    return;
   }
-};
+
+  delete handle.m_payload->derived;
+  handle.m_payload->derived = nullptr;
+  tpRemoveOne(d->derivedChannels, handle);
+}
 
 //##################################################################################################
-CoreInterfaceHandle::CoreInterfaceHandle(tp_utils::StringID typeID, tp_utils::StringID nameID):
-  m_typeID(std::move(typeID)),
-  m_nameID(std::move(nameID))
+void CoreInterface::flushDerivedChannels()
 {
+  d->checkThread();
+
+  if(!d->derivedChannelsSorted)
+    d->sortDerivedChannels();
+
+  // Copy in case a callback changes the derived channels.
+  std::vector<CoreInterfaceHandle> derivedChannels = d->derivedChannels;
+  for(const auto& handle : derivedChannels)
+  {
+    CoreInterfacePayloadPrivate* payload = handle.m_payload;
+    if(payload->derived && payload->derived->recomputeOnFlush && payload->updateDerived())
+      d->channelChanged(handle);
+  }
 }
 
 //##################################################################################################
-const tp_utils::StringID& CoreInterfaceHandle::typeID() const
+void CoreInterface::setHistoryCapacity(const CoreInterfaceHandle& handle, size_t capacity)
 {
-  return m_typeID;
+  d->checkThread();
+  CoreInterfacePayloadPrivate* payload = resolveHandle(handle, "setHistoryCapacity").m_payload;
+  if(!payload)
+    return;
+
+  if(capacity==0)
+  {
+    delete payload->history;
+    payload->history = nullptr;
+    return;
+  }
+
+  if(payload->history && payload->history->capacity()==capacity)
+    return;
+
+  // Keep the newest entries that fit in the new capacity.
+  auto history = new CoreInterfaceHistory(capacity);
+  if(payload->history)
+  {
+    size_t size = payload->history->size();
+    for(size_t i=(size>capacity)?(size-capacity):0; i<size; i++)
+    {
+      const CoreInterfaceHistoryEntry& e = payload->history->at(i);
+      history->append(e.timestampNS, e.data);
+    }
+    delete payload->history;
+  }
+
+  payload->history = history;
 }
 
 //##################################################################################################
-const tp_utils::StringID& CoreInterfaceHandle::nameID() const
+const CoreInterfaceHistory* CoreInterface::history(const CoreInterfaceHandle& handle) const
 {
-  return m_nameID;
+  return handle.m_payload?handle.m_payload->history:nullptr;
 }
 
 //##################################################################################################
-bool CoreInterfaceHandle::operator==(const CoreInterfaceHandle& other)const
+void CoreInterface::setStateSource(const CoreInterfaceStateSource* source)
 {
-  return m_payload == other.m_payload;
+  d->checkThread();
+
+  if(d->unloadedCount)
+    for(const auto& i : d->channels)
+      for(const auto& j : i.second)
+        j.second.m_payload->releaseSource(j.second.m_typeID, true);
+
+  d->stateSource = source;
 }
 
 //##################################################################################################
-CoreInterfaceData* CoreInterfaceHandle::data() const
+size_t CoreInterface::unloadedChannelCount() const
 {
-  return m_payload?m_payload->data:nullptr;
+  return d->unloadedCount;
 }
 
 //##################################################################################################
-nlohmann::json CoreInterfaceHandle::saveState() const
+void CoreInterfaceTaskWrites::setChannelData(const CoreInterfaceHandle& handle, CoreInterfaceData* data)
 {
-  nlohmann::json j;
-  j["typeID"] = m_typeID.toString();
-  j["nameID"] = m_nameID.toString();
-  return j;
+  auto i = m_declared?std::find(m_declared->begin(), m_declared->end(), handle):std::vector<CoreInterfaceHandle>::const_iterator();
+  if(!m_declared || i==m_declared->end())
+  {
+    tpWarning() << "CoreInterfaceTaskWrites::setChannelData() channel not in the declared writes: " << handle.typeID().toString() << " " << handle.nameID().toString();
+    delete data;
+    return;
+  }
+
+  // Stage the declared handle, the one passed in may be from deferred channel creation.
+  m_writes.emplace_back(*i, std::unique_ptr<CoreInterfaceData>(data));
 }
 
 //##################################################################################################
-void CoreInterfaceHandle::loadState(const nlohmann::json& j, CoreInterface* coreInterface)
+void CoreInterface::registerChannelTask(const ChannelTaskFunction* task,
+                                        const std::vector<CoreInterfaceHandle>& reads,
+                                        const std::vector<CoreInterfaceHandle>& writes)
 {
-  (*this) = coreInterface->handle(TPJSONString(j, "typeID"), TPJSONString(j, "nameID"));
+  d->checkThread();
+
+  // Tasks index their channels by payload, so deferred channels are created here.
+  auto resolve = [&](const std::vector<CoreInterfaceHandle>& handles)
+  {
+    std::vector<CoreInterfaceHandle> resolved;
+    resolved.reserve(handles.size());
+    for(const auto& handle : handles)
+      resolved.push_back(resolveHandle(handle, "registerChannelTask"));
+    return resolved;
+  };
+
+  d->channelTasks.push_back({task, resolve(reads), resolve(writes)});
 }
 
 //##################################################################################################
-bool lessThanCoreInterfaceHandle(const CoreInterfaceHandle& lhs, const CoreInterfaceHandle& rhs)
+void CoreInterface::unregisterChannelTask(const ChannelTaskFunction* task)
 {
-  return lhs.nameID().toString() < rhs.nameID().toString();
+  d->checkThread();
+  for(auto i=d->channelTasks.begin(); i!=d->channelTasks.end(); ++i)
+  {
+    if(i->function!=task)
+      continue;
+
+    // Indexes are held while flushing so the entry is removed once the flush completes.
+    if(d->flushingTasks)
+      i->function = nullptr;
+    else
+      d->channelTasks.erase(i);
+    return;
+  }
 }
 
 //##################################################################################################
-struct CoreInterface::Private
+size_t CoreInterface::flushChannelTasks()
 {
-  TP_NONCOPYABLE(Private);
+  d->checkThread();
+  if(d->taskChanges.empty() || d->flushingTasks)
+    return 0;
 
-  std::thread::id ownerThread{std::this_thread::get_id()};
+  typedef const CoreInterfacePayloadPrivate* Payload;
+  const auto& tasks = d->channelTasks;
 
-  std::unordered_map<tp_utils::StringID, std::unordered_map<tp_utils::StringID, CoreInterfaceHandle>> channels;
+  // Tasks registered by callbacks during the flush are left for the next one.
+  size_t taskCount = tasks.size();
 
-  std::vector<const ChannelChangedCallback*> channelChangeCallbacks;
-  std::vector<const ChannelListChangedCallback*> channelListChangedCallbacks;
-  std::unordered_map<tp_utils::StringID, std::vector<const SignalCallback*>> signalCallbacks;
+  std::unordered_map<Payload, std::vector<size_t>> readers;
+  for(size_t t=0; t<taskCount; t++)
+    for(const auto& h : tasks.at(t).reads)
+      if(h.m_payload)
+        readers[h.m_payload].push_back(t);
 
-  Private()=default;
+  // Find the tasks that read changed channels, and the tasks that read what those write.
+  std::unordered_set<Payload> changed;
+  std::vector<char> candidate(taskCount, 0);
+  std::vector<size_t> stack;
+  auto reach = [&](Payload payload)
+  {
+    auto i = readers.find(payload);
+    if(i!=readers.end())
+      for(size_t t : i->second)
+        if(!candidate.at(t))
+        {
+          candidate.at(t) = 1;
+          stack.push_back(t);
+        }
+  };
 
-  //################################################################################################
-  ~Private()
+  for(const auto& h : d->taskChanges)
   {
-    for(const auto& i : channels)
-      for(const auto& j : i.second)
-        delete j.second.m_payload;
+    h.m_payload->taskChanged = false;
+    changed.insert(h.m_payload);
+    reach(h.m_payload);
   }
+  d->taskChanges.clear();
 
-  //################################################################################################
-  void checkThread()
+  while(!stack.empty())
   {
-    assert(ownerThread==std::this_thread::get_id());
+    size_t t = stack.back();
+    stack.pop_back();
+    for(const auto& h : tasks.at(t).writes)
+      if(h.m_payload)
+        reach(h.m_payload);
   }
-};
+
+  // Writers of a channel come before its readers, and writers of the same channel are chained in
+  // registration order. Tasks without an edge between them don't conflict.
+  std::unordered_map<Payload, std::vector<size_t>> writers;
+  for(size_t t=0; t<taskCount; t++)
+    if(candidate.at(t))
+      for(const auto& h : tasks.at(t).writes)
+        if(h.m_payload)
+          writers[h.m_payload].push_back(t);
+
+  std::vector<std::vector<size_t>> edges(taskCount);
+  std::vector<size_t> inDegree(taskCount, 0);
+  auto addEdge = [&](size_t from, size_t to)
+  {
+    edges.at(from).push_back(to);
+    inDegree.at(to)++;
+  };
+
+  for(const auto& w : writers)
+  {
+    const auto& ws = w.second;
+    for(size_t i=1; i<ws.size(); i++)
+      if(ws.at(i-1)!=ws.at(i))
+        addEdge(ws.at(i-1), ws.at(i));
+
+    auto r = readers.find(w.first);
+    if(r!=readers.end())
+      for(size_t reader : r->second)
+        for(size_t writer : ws)
+          if(writer!=reader)
+            addEdge(writer, reader);
+  }
+
+  // Run the tasks in waves of those with no unfinished predecessors.
+  std::vector<char> done(taskCount, 0);
+  size_t remaining = size_t(std::count(candidate.begin(), candidate.end(), 1));
+  size_t ran=0;
+
+  d->flushingTasks = true;
+
+  std::vector<size_t> wave;
+  std::vector<size_t> runnable;
+  std::vector<CoreInterfaceTaskWrites> staged;
+  while(remaining)
+  {
+    wave.clear();
+    for(size_t t=0; t<taskCount; t++)
+      if(candidate.at(t) && !done.at(t) && inDegree.at(t)==0)
+        wave.push_back(t);
+
+    // A cycle, break it at the first task in registration order.
+    if(wave.empty())
+      for(size_t t=0; t<taskCount && wave.empty(); t++)
+        if(candidate.at(t) && !done.at(t))
+          wave.push_back(t);
+
+    runnable.clear();
+    for(size_t t : wave)
+    {
+      done.at(t) = 1;
+      remaining--;
+      for(size_t e : edges.at(t))
+        inDegree.at(e)--;
+
+      if(!tasks.at(t).function)
+        continue;
+
+      for(const auto& h : tasks.at(t).reads)
+      {
+        if(changed.count(h.m_payload))
+        {
+          runnable.push_back(t);
+          break;
+        }
+      }
+    }
+
+    if(runnable.empty())
+      continue;
+
+    // Bring lazily loaded and derived inputs up to date on this thread before the tasks read them.
+    staged.clear();
+    staged.resize(runnable.size());
+    for(size_t i=0; i<runnable.size(); i++)
+    {
+      const auto& task = tasks.at(runnable.at(i));
+      for(const auto& h : task.reads)
+      {
+        h.data();
+
+        // Tasks may call sharedData() concurrently, so the data must already be shared.
+        if(h.m_payload)
+          h.m_payload->data.share();
+      }
+      staged.at(i).m_declared = &task.writes;
+    }
+
+    auto runTask = [&](size_t i)
+    {
+      (*tasks.at(runnable.at(i)).function)(staged.at(i));
+    };
+
+    {
+      Private::DispatchScope scope(d);
+      if(ThreadingPolicy::concurrent && d->signalPool && runnable.size()>1)
+        d->signalPool->parallelFor(runnable.size(), runTask);
+      else
+        for(size_t i=0; i<runnable.size(); i++)
+          runTask(i);
+    }
+    ran += runnable.size();
+
+    // Set the staged data in registration order, the callbacks may modify the task list.
+    for(auto& writes : staged)
+    {
+      for(auto& write : writes.m_writes)
+      {
+        const CoreInterfaceHandle& h = write.first;
+        uint64_t version = h.version();
+        setChannelData(h, write.second.release());
+        if(h.version()==version)
+          continue;
+
+        changed.insert(h.m_payload);
+
+        // A reader that has already had its turn sees the change in the next flush.
+        auto r = readers.find(h.m_payload);
+        if(r!=readers.end() && !h.m_payload->taskChanged)
+        {
+          for(size_t reader : r->second)
+          {
+            if(done.at(reader) && !tpContains(runnable, reader))
+            {
+              h.m_payload->taskChanged = true;
+              d->taskChanges.push_back(h);
+              break;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  d->flushingTasks = false;
+
+  d->channelTasks.erase(std::remove_if(d->channelTasks.begin(), d->channelTasks.end(), [](const Private::ChannelTask& task)
+  {
+    return !task.function;
+  }), d->channelTasks.end());
+
+  return ran;
+}
 
 //##################################################################################################
-CoreInterface::CoreInterface():
-  d(new Private())
+void CoreInterface::setDeferChannelCreation(bool defer)
 {
+  d->checkThread();
+  d->deferChannelCreation = defer;
+}
 
+//##################################################################################################
+bool CoreInterface::deferChannelCreation() const
+{
+  return d->deferChannelCreation;
 }
 
 //##################################################################################################
-CoreInterface::~CoreInterface()
+void CoreInterface::setDirtyTracking(bool enabled)
 {
   d->checkThread();
-  delete d;
+  d->dirtyTracking = enabled;
+  if(!enabled)
+    clearDirtyChannels();
 }
 
 //##################################################################################################
-const std::unordered_map<tp_utils::StringID, std::unordered_map<tp_utils::StringID, CoreInterfaceHandle>>& CoreInterface::channels()const
+bool CoreInterface::dirtyTracking() const
+{
+  return d->dirtyTracking;
+}
+
+//##################################################################################################
+const std::vector<CoreInterfaceHandle>& CoreInterface::dirtyChannels() const
+{
+  return d->dirtyChannels;
+}
+
+//##################################################################################################
+void CoreInterface::clearDirtyChannels()
 {
   d->checkThread();
-  return d->channels;
+  for(const auto& handle : d->dirtyChannels)
+    handle.m_payload->dirty = false;
+  d->dirtyChannels.clear();
 }
 
 //##################################################################################################
-void CoreInterface::registerCallback(const ChannelListChangedCallback* callback)
+void CoreInterface::registerCallback(const SignalCallback* callback, const tp_utils::StringID& typeID)
 {
   d->checkThread();
-  d->channelListChangedCallbacks.push_back(callback);
+  d->signalCallbacks[typeID].push_back(callback);
 }
 
 //##################################################################################################
-void CoreInterface::unregisterCallback(const ChannelListChangedCallback* callback)
+void CoreInterface::registerCallback(const SignalCallback* callback, const tp_utils::StringID& typeID, const RateLimit& rateLimit)
 {
   d->checkThread();
-  tpRemoveOne(d->channelListChangedCallbacks, callback);
+  auto r = new RateLimitedCallback();
+  r->rateLimit = rateLimit;
+  r->signalCallback = callback;
+  r->typeID = typeID;
+  d->rateLimitedSignalCallbacks[typeID].push_back(r);
 }
 
 //##################################################################################################
-CoreInterfaceHandle CoreInterface::handle(const tp_utils::StringID& typeID, const tp_utils::StringID& nameID)
+void CoreInterface::unregisterCallback(const SignalCallback* callback, const tp_utils::StringID& typeID)
 {
   d->checkThread();
-  if(!typeID.isValid() || !nameID.isValid())
-    return CoreInterfaceHandle();
+  auto& callbacks = d->signalCallbacks[typeID];
+  tpRemoveOne(callbacks, callback);
 
-  CoreInterfaceHandle& localHandle = d->channels[typeID][nameID];
+  // The list may be being iterated by sendSignal(), in which case the empty list is left in place.
+  if(callbacks.empty() && d->dispatchDepth==0)
+    d->signalCallbacks.erase(typeID);
 
-  if(!localHandle.m_payload)
+  auto p = d->parallelSignalCallbacks.find(typeID);
+  if(p!=d->parallelSignalCallbacks.end() && tpContains(p->second, callback))
   {
-    localHandle.m_payload = new CoreInterfacePayloadPrivate;
-    localHandle.m_typeID = typeID;
-    localHandle.m_nameID = nameID;
+    // The callback may still be running from sendSignalAsync().
+    waitForSignals();
+    tpRemoveOne(p->second, callback);
+    if(p->second.empty())
+      d->parallelSignalCallbacks.erase(p);
+  }
 
-    for(const auto& c : d->channelListChangedCallbacks)
-      (*c)();
+  auto l = d->rateLimitedSignalCallbacks.find(typeID);
+  if(l==d->rateLimitedSignalCallbacks.end())
+    return;
+
+  auto& limited = l->second;
+  for(auto i=limited.begin(); i!=limited.end(); ++i)
+  {
+    if(*i && (*i)->signalCallback==callback)
+    {
+      d->removeRateLimitedCallback(limited, i);
+      break;
+    }
   }
 
-  return localHandle;
+  if(limited.empty())
+    d->rateLimitedSignalCallbacks.erase(l);
 }
 
 //##################################################################################################
-void CoreInterface::registerCallback(const ChannelChangedCallback* callback)
+void CoreInterface::sendSignal(const tp_utils::StringID& typeID, CoreInterfaceData* data)
 {
   d->checkThread();
-  d->channelChangeCallbacks.push_back(callback);
+  std::unique_ptr<CoreInterfaceData> payload(data);
+  d->sendSignal(typeID, data, nullptr);
 }
 
 //##################################################################################################
-void CoreInterface::unregisterCallback(const ChannelChangedCallback* callback)
+void CoreInterface::sendSignalAsync(const tp_utils::StringID& typeID, const std::shared_ptr<CoreInterfaceData>& data)
 {
   d->checkThread();
-  tpRemoveOne(d->channelChangeCallbacks, callback);
+  d->sendSignal(typeID, data.get(), &data);
 }
 
 //##################################################################################################
-void CoreInterface::setChannelData(const CoreInterfaceHandle& handle, CoreInterfaceData* data)
+void CoreInterface::registerParallelCallback(const SignalCallback* callback, const tp_utils::StringID& typeID)
 {
   d->checkThread();
-  if(!handle.m_payload)
+  d->parallelSignalCallbacks[typeID].push_back(callback);
+}
+
+//##################################################################################################
+void CoreInterface::setSignalPool(WorkStealingPool* pool)
+{
+  d->checkThread();
+  waitForSignals();
+
+  if(!ThreadingPolicy::concurrent && pool)
   {
-    delete data;
+    tpWarning() << "CoreInterface::setSignalPool() ignored, tp_control was built with TP_CONTROL_SINGLE_THREADED.";
     return;
   }
 
-  delete handle.m_payload->data;
+  d->signalPool = pool;
+}
 
-  handle.m_payload->data = data;
+//##################################################################################################
+void CoreInterface::waitForSignals()
+{
+  d->checkThread();
+  while(d->asyncSignalTasks>0)
+    if(!d->signalPool->runPendingTask())
+      std::this_thread::yield();
+}
 
-  for(const auto& c : d->channelChangeCallbacks)
-    (*c)(handle.m_typeID, handle.m_nameID, handle.m_payload->data);
+//##################################################################################################
+uint64_t CoreInterface::sendSignalAt(const tp_utils::StringID& typeID, CoreInterfaceData* data, int64_t deadlineNS)
+{
+  d->checkThread();
+  std::shared_ptr<CoreInterfaceData> payload(data);
+  return d->timerWheel().add(deadlineNS, 0, [this, typeID, payload]
+  {
+    d->sendSignal(typeID, payload.get(), nullptr);
+  });
 }
 
 //##################################################################################################
-void CoreInterface::registerCallback(const SignalCallback* callback, const tp_utils::StringID& typeID)
+uint64_t CoreInterface::sendSignalPeriodic(const tp_utils::StringID& typeID, CoreInterfaceData* data, int64_t periodNS, int64_t firstDeadlineNS)
 {
   d->checkThread();
-  d->signalCallbacks[typeID].push_back(callback);
+  std::shared_ptr<CoreInterfaceData> payload(data);
+  if(firstDeadlineNS==0)
+    firstDeadlineNS = d->timerNowNS()+periodNS;
+
+  return d->timerWheel().add(firstDeadlineNS, std::max(periodNS, int64_t(1)), [this, typeID, payload]
+  {
+    d->sendSignal(typeID, payload.get(), nullptr);
+  });
 }
 
 //##################################################################################################
-void CoreInterface::unregisterCallback(const SignalCallback* callback, const tp_utils::StringID& typeID)
+bool CoreInterface::cancelTimer(uint64_t id)
 {
   d->checkThread();
-  auto& callbacks = d->signalCallbacks[typeID];
-  tpRemoveOne(callbacks, callback);
-  if(callbacks.empty())
-    d->signalCallbacks.erase(typeID);
+  return d->timers?d->timers->cancel(id):false;
 }
 
 //##################################################################################################
-void CoreInterface::sendSignal(const tp_utils::StringID& typeID, CoreInterfaceData* data)
+size_t CoreInterface::serviceTimers()
+{
+  return serviceTimers(nowNS());
+}
+
+//##################################################################################################
+size_t CoreInterface::serviceTimers(int64_t nowNS_)
 {
   d->checkThread();
-  for(const auto& c : d->signalCallbacks[typeID])
-    (*c)(typeID, data);
+  d->servicedNS = std::max(d->servicedNS, nowNS_);
+  return d->timers?d->timers->advance(d->servicedNS):0;
+}
+
+//##################################################################################################
+int64_t CoreInterface::nowNS()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//##################################################################################################
+void CoreInterface::registerObserver(CoreInterfaceObserver* observer)
+{
+  d->checkThread();
+  d->observers.push_back(observer);
+}
+
+//##################################################################################################
+void CoreInterface::unregisterObserver(CoreInterfaceObserver* observer)
+{
+  d->checkThread();
+  tpRemoveOne(d->observers, observer);
+}
+
+//##################################################################################################
+size_t CoreInterface::dispatchDepth() const
+{
+  return d->dispatchDepth;
+}
+
+//##################################################################################################
+void CoreInterface::setCallbackTag(const void* callback, const std::string& tag)
+{
+  d->checkThread();
+  if(tag.empty())
+    d->callbackTags.erase(callback);
+  else
+    d->callbackTags[callback] = tag;
+}
+
+//##################################################################################################
+std::string CoreInterface::callbackTag(const void* callback) const
+{
+  auto i = d->callbackTags.find(callback);
+  return (i!=d->callbackTags.end())?i->second:std::string();
+}
+
+//##################################################################################################
+void CoreInterface::setWatchdog(CoreInterfaceWatchdog* watchdog)
+{
+  d->checkThread();
+  d->watchdog = watchdog;
+}
+
+//##################################################################################################
+CoreInterfaceStats CoreInterface::stats() const
+{
+  d->checkThread();
+#ifdef TP_CONTROL_INSTRUMENTATION
+  CoreInterfaceStats stats = d->stats;
+  for(auto& i : stats.callbacks)
+    i.second.tag = callbackTag(i.first);
+  return stats;
+#else
+  return CoreInterfaceStats();
+#endif
+}
+
+//##################################################################################################
+void CoreInterface::resetStats()
+{
+  d->checkThread();
+#ifdef TP_CONTROL_INSTRUMENTATION
+  // Channel stats are referenced by the payloads so reset them in place.
+  for(auto& i : d->stats.channelTypes)
+    i.second = ChannelStats();
+
+  for(auto& i : d->stats.channels)
+    for(auto& j : i.second)
+      j.second = ChannelStats();
+
+  d->stats.signals.clear();
+  d->stats.callbacks.clear();
+#endif
+}
+
+//##################################################################################################
+CoreInterfaceCachedHandle::CoreInterfaceCachedHandle(std::string_view typeID, std::string_view nameID):
+  m_key(typeID, nameID)
+{
+
+}
+
+//##################################################################################################
+const CoreInterfaceHandle& CoreInterfaceCachedHandle::get(const CoreInterface* coreInterface)
+{
+  if(m_instanceID!=coreInterface->d->instanceID)
+  {
+    m_handle = coreInterface->findHandle(m_key);
+    m_instanceID = m_handle.typeID().isValid()?coreInterface->d->instanceID:0;
+  }
+
+  return m_handle;
+}
+
+//##################################################################################################
+CoreInterfaceChannelListChanges::CoreInterfaceChannelListChanges(CoreInterface* coreInterface):
+  m_coreInterface(coreInterface)
+{
+  m_coreInterface->beginChannelListChanges();
+}
+
+//##################################################################################################
+CoreInterfaceChannelListChanges::~CoreInterfaceChannelListChanges()
+{
+  m_coreInterface->endChannelListChanges();
 }
 
 }
@@ -0,0 +1,605 @@
+#include "tp_control/CoreInterfaceBridge.h"
+#include "tp_control/CoreInterfaceCodecs.h"
+
+#include "tp_utils/DebugUtils.h"
+
+#include <cstring>
+
+#if defined(_WIN32) || defined(__EMSCRIPTEN__)
+#define TP_CONTROL_NO_UNIX_SOCKETS
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace tp_control
+{
+
+namespace
+{
+//##################################################################################################
+enum FrameKind : uint8_t
+{
+  ChannelFrame = 1,
+  SignalFrame  = 2
+};
+
+#pragma pack(push, 1)
+struct FrameHeader
+{
+  uint32_t size;      //!< The size of the frame excluding this field.
+  uint8_t kind;
+  uint8_t hasPayload;
+  uint16_t typeSize;
+  uint16_t nameSize;
+};
+#pragma pack(pop)
+
+//! The bytes of a frame after the size field that come before the IDs.
+const size_t frameFieldsSize = sizeof(FrameHeader) - sizeof(uint32_t);
+
+//##################################################################################################
+struct PendingUpdate
+{
+  FrameKind kind;
+  tp_utils::StringID typeID;
+  tp_utils::StringID nameID;
+  bool hasPayload{false};
+  std::string payload;
+};
+
+#ifndef TP_CONTROL_NO_UNIX_SOCKETS
+//##################################################################################################
+bool setNonBlocking(int fd)
+{
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags>=0 && fcntl(fd, F_SETFL, flags|O_NONBLOCK)==0;
+}
+
+//##################################################################################################
+bool makeAddress(const std::string& path, sockaddr_un& address)
+{
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if(path.size()>=sizeof(address.sun_path))
+  {
+    tpWarning() << "CoreInterfaceBridge socket path too long: " << path;
+    return false;
+  }
+  memcpy(address.sun_path, path.c_str(), path.size()+1);
+  return true;
+}
+#endif
+}
+
+//##################################################################################################
+struct CoreInterfaceBridge::Private
+{
+  TP_NONCOPYABLE(Private);
+
+  CoreInterface* coreInterface;
+  const CoreInterfaceCodecs* codecs;
+
+  int fd{-1};
+  int listenFD{-1};
+  std::string listenPath;
+
+  std::vector<tp_utils::StringID> channelTypes;
+  std::vector<tp_utils::StringID> signalTypes;
+
+  size_t maxPendingBytes{1<<20};
+  size_t droppedSignals{0};
+  size_t receivedCount{0};
+
+  // Updates waiting to be framed, channels are indexed so that they can be coalesced.
+  std::vector<PendingUpdate> pending;
+  std::unordered_map<tp_utils::StringID, std::unordered_map<tp_utils::StringID, size_t>> pendingChannels;
+  size_t pendingPayloadBytes{0};
+
+  std::string outBuffer;
+  size_t outOffset{0};
+  std::string inBuffer;
+
+  // Set while applying an update from the peer so that it is not sent back, other updates made by
+  // callbacks during the apply are still sent.
+  const tp_utils::StringID* applyingTypeID{nullptr};
+  const tp_utils::StringID* applyingNameID{nullptr};
+
+  //################################################################################################
+  ChannelChangedCallback channelChangedCallback = [&](const tp_utils::StringID& typeID, const tp_utils::StringID& nameID, const CoreInterfaceData* data)
+  {
+    // The snapshot sent on connect brings a new peer up to date.
+    if(fd<0 || !tpContains(channelTypes, typeID))
+      return;
+
+    if(applyingNameID && *applyingTypeID==typeID && *applyingNameID==nameID)
+      return;
+
+    queueChannel(typeID, nameID, data);
+  };
+
+  //################################################################################################
+  SignalCallback signalCallback = [&](const tp_utils::StringID& typeID, const CoreInterfaceData* data)
+  {
+    if(fd<0 || (applyingTypeID && !applyingNameID && *applyingTypeID==typeID))
+      return;
+
+    if(bytesWaiting()>=maxPendingBytes)
+    {
+      droppedSignals++;
+      return;
+    }
+
+    queue(SignalFrame, typeID, tp_utils::StringID(), data);
+  };
+
+  //################################################################################################
+  Private(CoreInterface* coreInterface_, const CoreInterfaceCodecs* codecs_):
+    coreInterface(coreInterface_),
+    codecs(codecs_)
+  {
+
+  }
+
+  //################################################################################################
+  size_t bytesWaiting() const
+  {
+    return (outBuffer.size()-outOffset) + pendingPayloadBytes;
+  }
+
+  //################################################################################################
+  //! Returns false and warns if an update would make a frame that the peer will reject.
+  bool checkFrameSize(const tp_utils::StringID& typeID, const tp_utils::StringID& nameID, size_t payloadSize) const
+  {
+    size_t typeSize = typeID.toString().size();
+    size_t nameSize = nameID.isValid()?nameID.toString().size():0;
+    if(typeSize<=0xFFFF && nameSize<=0xFFFF && frameFieldsSize+typeSize+nameSize+payloadSize<=maxPendingBytes)
+      return true;
+
+    tpWarning() << "CoreInterfaceBridge update too large to send: " << typeID.toString();
+    return false;
+  }
+
+  //################################################################################################
+  void queue(FrameKind kind, const tp_utils::StringID& typeID, const tp_utils::StringID& nameID, const CoreInterfaceData* data)
+  {
+    PendingUpdate update;
+    update.kind = kind;
+    update.typeID = typeID;
+    update.nameID = nameID;
+    update.hasPayload = codecs->encode(typeID, data, update.payload);
+    if(!checkFrameSize(typeID, nameID, update.payload.size()))
+      return;
+
+    pendingPayloadBytes += update.payload.size();
+    pending.push_back(std::move(update));
+  }
+
+  //################################################################################################
+  //! Queue a channel update, replacing the update for the same channel if one is waiting.
+  void queueChannel(const tp_utils::StringID& typeID, const tp_utils::StringID& nameID, const CoreInterfaceData* data)
+  {
+    auto& index = pendingChannels[typeID];
+    auto i = index.find(nameID);
+    if(i==index.end())
+    {
+      size_t position = pending.size();
+      queue(ChannelFrame, typeID, nameID, data);
+      if(pending.size()>position)
+        index[nameID] = position;
+      return;
+    }
+
+    std::string payload;
+    bool hasPayload = codecs->encode(typeID, data, payload);
+    if(!checkFrameSize(typeID, nameID, payload.size()))
+      return;
+
+    PendingUpdate& update = pending[i->second];
+    pendingPayloadBytes -= update.payload.size();
+    update.payload.swap(payload);
+    update.hasPayload = hasPayload;
+    pendingPayloadBytes += update.payload.size();
+  }
+
+  //################################################################################################
+  //! Queue the current value of each channel of a type, so that a new peer starts in sync.
+  void queueSnapshot(const tp_utils::StringID& typeID)
+  {
+    const auto& channels = coreInterface->channels();
+    auto i = channels.find(typeID);
+    if(i==channels.end())
+      return;
+
+    for(const auto& j : i->second)
+      if(const CoreInterfaceData* data = j.second.data())
+        queueChannel(typeID, j.first, data);
+  }
+
+  //################################################################################################
+  //! Called once a peer is connected.
+  void connected()
+  {
+    for(const auto& typeID : channelTypes)
+      queueSnapshot(typeID);
+  }
+
+  //################################################################################################
+  //! Returns false if a received frame is malformed, frameSize is the size including the size field.
+  bool validFrame(const FrameHeader& header, size_t& frameSize) const
+  {
+    frameSize = sizeof(uint32_t) + size_t(header.size);
+
+    if(header.size<frameFieldsSize || size_t(header.size)>maxPendingBytes)
+      return false;
+
+    if(header.kind!=ChannelFrame && header.kind!=SignalFrame)
+      return false;
+
+    if(header.typeSize==0 || (header.kind==ChannelFrame && header.nameSize==0))
+      return false;
+
+    return size_t(header.typeSize) + size_t(header.nameSize) <= size_t(header.size)-frameFieldsSize;
+  }
+
+  //################################################################################################
+  void frame()
+  {
+    if((outBuffer.size()-outOffset)>=maxPendingBytes)
+      return;
+
+    if(outOffset>0)
+    {
+      outBuffer.erase(0, outOffset);
+      outOffset=0;
+    }
+
+    for(const auto& update : pending)
+    {
+      const std::string& typeID = update.typeID.toString();
+      const std::string& nameID = update.nameID.isValid()?update.nameID.toString():std::string();
+
+      FrameHeader header;
+      header.kind = update.kind;
+      header.hasPayload = update.hasPayload?1:0;
+      header.typeSize = uint16_t(typeID.size());
+      header.nameSize = uint16_t(nameID.size());
+      header.size = uint32_t(sizeof(FrameHeader) - sizeof(uint32_t) + typeID.size() + nameID.size() + update.payload.size());
+
+      outBuffer.append(reinterpret_cast<const char*>(&header), sizeof(FrameHeader));
+      outBuffer.append(typeID);
+      outBuffer.append(nameID);
+      outBuffer.append(update.payload);
+    }
+
+    pending.clear();
+    pendingChannels.clear();
+    pendingPayloadBytes=0;
+  }
+
+  //################################################################################################
+  void apply(const char* data, const FrameHeader& header)
+  {
+    const char* typeData = data+sizeof(FrameHeader);
+    const char* nameData = typeData+header.typeSize;
+    const char* payload = nameData+header.nameSize;
+    size_t payloadSize = header.size - frameFieldsSize - header.typeSize - header.nameSize;
+
+    tp_utils::StringID typeID(std::string(typeData, header.typeSize));
+    CoreInterfaceData* eventData = header.hasPayload?codecs->decode(typeID, payload, payloadSize):nullptr;
+
+    applyingTypeID = &typeID;
+    if(header.kind==ChannelFrame)
+    {
+      tp_utils::StringID nameID(std::string(nameData, header.nameSize));
+      applyingNameID = &nameID;
+      coreInterface->setChannelData(coreInterface->handle(typeID, nameID), eventData);
+    }
+    else
+      coreInterface->sendSignal(typeID, eventData);
+    applyingTypeID = nullptr;
+    applyingNameID = nullptr;
+
+    receivedCount++;
+  }
+
+  //################################################################################################
+  void closeSocket()
+  {
+#ifndef TP_CONTROL_NO_UNIX_SOCKETS
+    if(fd>=0)
+      ::close(fd);
+#endif
+    fd=-1;
+    outBuffer.clear();
+    outOffset=0;
+    inBuffer.clear();
+
+    // Updates for the old peer are not sent to the next one.
+    pending.clear();
+    pendingChannels.clear();
+    pendingPayloadBytes=0;
+  }
+
+  //################################################################################################
+  bool pollSocket()
+  {
+#ifdef TP_CONTROL_NO_UNIX_SOCKETS
+    return false;
+#else
+    if(fd<0 && listenFD>=0)
+    {
+      int peer = ::accept(listenFD, nullptr, nullptr);
+      if(peer>=0)
+      {
+        setNonBlocking(peer);
+        fd = peer;
+        connected();
+      }
+    }
+
+    if(fd<0)
+      return listenFD>=0;
+
+    frame();
+
+    while(outOffset<outBuffer.size())
+    {
+#ifdef MSG_NOSIGNAL
+      ssize_t n = ::send(fd, outBuffer.data()+outOffset, outBuffer.size()-outOffset, MSG_NOSIGNAL);
+#else
+      ssize_t n = ::send(fd, outBuffer.data()+outOffset, outBuffer.size()-outOffset, 0);
+#endif
+      if(n>0)
+        outOffset += size_t(n);
+      else if(n<0 && (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR))
+        break;
+      else
+      {
+        closeSocket();
+        return false;
+      }
+    }
+
+    if(outOffset==outBuffer.size())
+    {
+      outBuffer.clear();
+      outOffset=0;
+    }
+
+    // If the peer has closed the connection the frames that it sent before closing are still applied.
+    bool peerClosed=false;
+    char buffer[65536];
+    for(;;)
+    {
+      ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+      if(n>0)
+        inBuffer.append(buffer, size_t(n));
+      else if(n<0 && errno==EINTR)
+        continue;
+      else if(n<0 && (errno==EAGAIN || errno==EWOULDBLOCK))
+        break;
+      else
+      {
+        peerClosed=true;
+        break;
+      }
+    }
+
+    size_t offset=0;
+    while(inBuffer.size()-offset>=sizeof(FrameHeader))
+    {
+      FrameHeader header;
+      memcpy(&header, inBuffer.data()+offset, sizeof(FrameHeader));
+
+      // Checked before waiting for the rest of the frame, so a bad size can't grow the buffer.
+      size_t frameSize=0;
+      if(!validFrame(header, frameSize))
+      {
+        tpWarning() << "CoreInterfaceBridge received a malformed frame, closing the connection.";
+        closeSocket();
+        return false;
+      }
+
+      if(inBuffer.size()-offset<frameSize)
+        break;
+
+      apply(inBuffer.data()+offset, header);
+      offset += frameSize;
+
+      // The connection may have been closed by a callback.
+      if(fd<0)
+        return false;
+    }
+    inBuffer.erase(0, offset);
+
+    if(peerClosed)
+    {
+      closeSocket();
+      return false;
+    }
+
+    return true;
+#endif
+  }
+};
+
+//##################################################################################################
+CoreInterfaceBridge::CoreInterfaceBridge(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs):
+  d(new Private(coreInterface, codecs))
+{
+  d->coreInterface->registerCallback(&d->channelChangedCallback);
+  d->coreInterface->setCallbackTag(&d->channelChangedCallback, "CoreInterfaceBridge");
+  d->coreInterface->setCallbackTag(&d->signalCallback, "CoreInterfaceBridge");
+}
+
+//##################################################################################################
+CoreInterfaceBridge::~CoreInterfaceBridge()
+{
+  close();
+  for(const auto& typeID : d->signalTypes)
+    d->coreInterface->unregisterCallback(&d->signalCallback, typeID);
+  d->coreInterface->unregisterCallback(&d->channelChangedCallback);
+  d->coreInterface->setCallbackTag(&d->channelChangedCallback, std::string());
+  d->coreInterface->setCallbackTag(&d->signalCallback, std::string());
+  delete d;
+}
+
+//##################################################################################################
+bool CoreInterfaceBridge::listen(const std::string& path)
+{
+  close();
+
+#ifdef TP_CONTROL_NO_UNIX_SOCKETS
+  TP_UNUSED(path);
+  return false;
+#else
+  sockaddr_un address;
+  if(!makeAddress(path, address))
+    return false;
+
+  ::unlink(path.c_str());
+  d->listenFD = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if(d->listenFD<0 ||
+     ::bind(d->listenFD, reinterpret_cast<sockaddr*>(&address), sizeof(address))!=0 ||
+     ::listen(d->listenFD, 1)!=0 ||
+     !setNonBlocking(d->listenFD))
+  {
+    tpWarning() << "CoreInterfaceBridge failed to listen on: " << path;
+    close();
+    return false;
+  }
+
+  d->listenPath = path;
+  return true;
+#endif
+}
+
+//##################################################################################################
+bool CoreInterfaceBridge::connect(const std::string& path)
+{
+  close();
+
+#ifdef TP_CONTROL_NO_UNIX_SOCKETS
+  TP_UNUSED(path);
+  return false;
+#else
+  sockaddr_un address;
+  if(!makeAddress(path, address))
+    return false;
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd<0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address))!=0)
+  {
+    tpWarning() << "CoreInterfaceBridge failed to connect to: " << path;
+    if(fd>=0)
+      ::close(fd);
+    return false;
+  }
+
+  return attach(fd);
+#endif
+}
+
+//##################################################################################################
+bool CoreInterfaceBridge::attach(int fd)
+{
+  d->closeSocket();
+
+#ifdef TP_CONTROL_NO_UNIX_SOCKETS
+  TP_UNUSED(fd);
+  return false;
+#else
+  if(fd<0 || !setNonBlocking(fd))
+    return false;
+
+  d->fd = fd;
+  d->connected();
+  return true;
+#endif
+}
+
+//##################################################################################################
+void CoreInterfaceBridge::close()
+{
+  d->closeSocket();
+
+#ifndef TP_CONTROL_NO_UNIX_SOCKETS
+  if(d->listenFD>=0)
+  {
+    ::close(d->listenFD);
+    ::unlink(d->listenPath.c_str());
+  }
+#endif
+
+  d->listenFD=-1;
+  d->listenPath.clear();
+}
+
+//##################################################################################################
+bool CoreInterfaceBridge::isConnected() const
+{
+  return d->fd>=0;
+}
+
+//##################################################################################################
+void CoreInterfaceBridge::addChannelType(const tp_utils::StringID& typeID)
+{
+  if(tpContains(d->channelTypes, typeID))
+    return;
+
+  d->channelTypes.push_back(typeID);
+  if(d->fd>=0)
+    d->queueSnapshot(typeID);
+}
+
+//##################################################################################################
+void CoreInterfaceBridge::addSignalType(const tp_utils::StringID& typeID)
+{
+  if(tpContains(d->signalTypes, typeID))
+    return;
+
+  d->signalTypes.push_back(typeID);
+  d->coreInterface->registerCallback(&d->signalCallback, typeID);
+}
+
+//##################################################################################################
+void CoreInterfaceBridge::setMaxPendingBytes(size_t maxPendingBytes)
+{
+  d->maxPendingBytes = maxPendingBytes;
+}
+
+//##################################################################################################
+bool CoreInterfaceBridge::poll()
+{
+  return d->pollSocket();
+}
+
+//##################################################################################################
+size_t CoreInterfaceBridge::pendingBytes() const
+{
+  return d->bytesWaiting();
+}
+
+//##################################################################################################
+size_t CoreInterfaceBridge::droppedSignals() const
+{
+  return d->droppedSignals;
+}
+
+//##################################################################################################
+size_t CoreInterfaceBridge::receivedCount() const
+{
+  return d->receivedCount;
+}
+
+//##################################################################################################
+int CoreInterfaceBridge::fileDescriptor() const
+{
+  return d->fd;
+}
+
+}
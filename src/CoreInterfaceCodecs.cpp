@@ -0,0 +1,73 @@
+#include "tp_control/CoreInterfaceCodecs.h"
+
+namespace tp_control
+{
+
+//##################################################################################################
+void CoreInterfaceCodecs::addCodec(const tp_utils::StringID& typeID, const CoreInterfaceCodec& codec)
+{
+  m_codecs[typeID] = codec;
+}
+
+//##################################################################################################
+void CoreInterfaceCodecs::removeCodec(const tp_utils::StringID& typeID)
+{
+  m_codecs.erase(typeID);
+}
+
+//##################################################################################################
+const CoreInterfaceCodec* CoreInterfaceCodecs::codec(const tp_utils::StringID& typeID) const
+{
+  auto i = m_codecs.find(typeID);
+  return (i!=m_codecs.end())?&i->second:nullptr;
+}
+
+//##################################################################################################
+bool CoreInterfaceCodecs::encode(const tp_utils::StringID& typeID, const CoreInterfaceData* data, std::string& result) const
+{
+  if(!data)
+    return false;
+
+  const CoreInterfaceCodec* c = codec(typeID);
+  if(!c || !c->encode)
+    return false;
+
+  c->encode(data, result);
+  return true;
+}
+
+//##################################################################################################
+CoreInterfaceData* CoreInterfaceCodecs::decode(const tp_utils::StringID& typeID, const char* encoded, size_t size) const
+{
+  const CoreInterfaceCodec* c = codec(typeID);
+  if(!c || !c->decode)
+    return nullptr;
+
+  return c->decode(encoded, size);
+}
+
+//##################################################################################################
+bool CoreInterfaceCodecs::saveState(const tp_utils::StringID& typeID, const CoreInterfaceData* data, nlohmann::json& j) const
+{
+  if(!data)
+    return false;
+
+  const CoreInterfaceCodec* c = codec(typeID);
+  if(!c || !c->saveState)
+    return false;
+
+  j = c->saveState(data);
+  return true;
+}
+
+//##################################################################################################
+CoreInterfaceData* CoreInterfaceCodecs::loadState(const tp_utils::StringID& typeID, const nlohmann::json& j) const
+{
+  const CoreInterfaceCodec* c = codec(typeID);
+  if(!c || !c->loadState)
+    return nullptr;
+
+  return c->loadState(j);
+}
+
+}
@@ -0,0 +1,142 @@
+#include "tp_control/CoreInterfaceHistory.h"
+
+#include <cassert>
+#include <cstdint>
+
+namespace tp_control
+{
+
+//##################################################################################################
+struct CoreInterfaceHistory::Private
+{
+  TP_NONCOPYABLE(Private);
+
+  std::vector<CoreInterfaceHistoryEntry> entries;
+  size_t first{0};
+  size_t count{0};
+
+  //################################################################################################
+  Private(size_t capacity):
+    entries(capacity)
+  {
+
+  }
+
+  //################################################################################################
+  const CoreInterfaceHistoryEntry& entry(size_t index) const
+  {
+    return entries[(first+index)%entries.size()];
+  }
+};
+
+//##################################################################################################
+CoreInterfaceHistory::CoreInterfaceHistory(size_t capacity):
+  d(new Private(capacity))
+{
+
+}
+
+//##################################################################################################
+CoreInterfaceHistory::~CoreInterfaceHistory()
+{
+  delete d;
+}
+
+//##################################################################################################
+size_t CoreInterfaceHistory::capacity() const
+{
+  return d->entries.size();
+}
+
+//##################################################################################################
+size_t CoreInterfaceHistory::size() const
+{
+  return d->count;
+}
+
+//##################################################################################################
+const CoreInterfaceHistoryEntry& CoreInterfaceHistory::at(size_t index) const
+{
+  assert(index<d->count);
+  return d->entry(index);
+}
+
+//##################################################################################################
+void CoreInterfaceHistory::append(int64_t timestampNS, const std::shared_ptr<const CoreInterfaceData>& data)
+{
+  if(d->entries.empty())
+    return;
+
+  assert(d->count==0 || d->entry(d->count-1).timestampNS<=timestampNS);
+
+  size_t index;
+  if(d->count<d->entries.size())
+    index = (d->first+d->count++)%d->entries.size();
+  else
+  {
+    index = d->first;
+    d->first = (d->first+1)%d->entries.size();
+  }
+
+  CoreInterfaceHistoryEntry& e = d->entries[index];
+  e.timestampNS = timestampNS;
+  e.data = data;
+}
+
+//##################################################################################################
+void CoreInterfaceHistory::clear()
+{
+  for(auto& e : d->entries)
+    e.data.reset();
+
+  d->first = 0;
+  d->count = 0;
+}
+
+//##################################################################################################
+size_t CoreInterfaceHistory::lowerBound(int64_t tNS) const
+{
+  size_t lo=0;
+  size_t hi=d->count;
+  while(lo<hi)
+  {
+    size_t mid = lo + (hi-lo)/2;
+    if(d->entry(mid).timestampNS<tNS)
+      lo = mid+1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+//##################################################################################################
+std::vector<CoreInterfaceHistoryEntry> CoreInterfaceHistory::range(int64_t t0NS, int64_t t1NS) const
+{
+  std::vector<CoreInterfaceHistoryEntry> result;
+  for(size_t i=lowerBound(t0NS); i<d->count; i++)
+  {
+    const CoreInterfaceHistoryEntry& e = d->entry(i);
+    if(e.timestampNS>t1NS)
+      break;
+    result.push_back(e);
+  }
+  return result;
+}
+
+//##################################################################################################
+std::shared_ptr<const CoreInterfaceData> CoreInterfaceHistory::valueAt(int64_t tNS) const
+{
+  // The first entry after tNS, the one before it is the value at tNS.
+  size_t i = (tNS==INT64_MAX)?d->count:lowerBound(tNS+1);
+  if(i==0)
+    return std::shared_ptr<const CoreInterfaceData>();
+  return d->entry(i-1).data;
+}
+
+//##################################################################################################
+int64_t CoreInterfaceHistory::nowNS()
+{
+  return CoreInterface::nowNS();
+}
+
+}
@@ -0,0 +1,978 @@
+#include "tp_control/CoreInterfaceJournal.h"
+#include "tp_control/CoreInterfaceCodecs.h"
+#include "tp_control/MappedFile.h"
+
+#include "tp_utils/DebugUtils.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+
+namespace tp_control
+{
+
+namespace
+{
+//##################################################################################################
+// File layout: an 8 byte magic followed by 8 byte aligned records, each record is a RecordHeader
+// followed by size bytes of payload. The mapping is zero filled so a kind of zero marks the end.
+// Each record carries a CRC so that reading stops at the first record that was damaged.
+const char journalMagic[8]    = {'T', 'P', 'C', 'I', 'J', 'R', 'N', '2'};
+const char checkpointMagic[8] = {'T', 'P', 'C', 'I', 'C', 'K', 'P', '2'};
+const char deltaMagic[8]      = {'T', 'P', 'C', 'I', 'D', 'L', 'T', '2'};
+
+// Index layout: an 8 byte magic, the identity and a sample hash of the file that was indexed, the entry
+// count, and then the entries sorted by type and name.
+const char indexMagic[8]      = {'T', 'P', 'C', 'I', 'I', 'D', 'X', '3'};
+
+enum RecordKind : uint8_t
+{
+  EndKind     = 0,
+  StringKind  = 1,
+  ChannelKind = 2
+};
+
+enum RecordFlags : uint8_t
+{
+  HasPayloadFlag = 1
+};
+
+struct RecordHeader
+{
+  uint8_t kind;
+  uint8_t flags;
+  uint16_t reserved;
+  uint32_t size;
+  uint32_t typeIndex;
+  uint32_t nameIndex;
+  uint32_t crc;       //!< CRC-32 of the header, with crc set to 0, followed by the payload.
+  uint32_t padding;
+};
+
+struct IndexHeader
+{
+  char magic[8];
+  uint64_t fileSize;
+  uint64_t fileDevice;
+  uint64_t fileInode;
+  int64_t fileModifiedNS;
+  uint64_t fileHash;
+  uint64_t count;
+};
+
+//! Offsets of the channel record and the string records that hold its type and name.
+struct IndexEntry
+{
+  uint64_t recordOffset;
+  uint64_t typeOffset;
+  uint64_t nameOffset;
+};
+
+//##################################################################################################
+size_t padded(size_t size)
+{
+  return (size+7) & ~size_t(7);
+}
+
+//##################################################################################################
+//! CRC-32 with the IEEE polynomial, pass the result of a previous call as crc to continue it.
+uint32_t crc32(uint32_t crc, const char* data, size_t size)
+{
+  static const std::array<uint32_t, 256> table = []
+  {
+    std::array<uint32_t, 256> t;
+    for(uint32_t i=0; i<256; i++)
+    {
+      uint32_t c = i;
+      for(int k=0; k<8; k++)
+        c = (c&1)?(0xEDB88320u ^ (c>>1)):(c>>1);
+      t[i] = c;
+    }
+    return t;
+  }();
+
+  crc = ~crc;
+  for(size_t i=0; i<size; i++)
+    crc = table[(crc ^ uint8_t(data[i])) & 0xFF] ^ (crc>>8);
+  return ~crc;
+}
+
+//##################################################################################################
+uint32_t recordCRC(RecordHeader header, const char* payload)
+{
+  header.crc = 0;
+  return crc32(crc32(0, reinterpret_cast<const char*>(&header), sizeof(RecordHeader)), payload, header.size);
+}
+
+//##################################################################################################
+//! Returns false if a record was damaged after it was written, the payload must lie within the file.
+bool recordIntact(const RecordHeader& header, const char* payload)
+{
+  return recordCRC(header, payload)==header.crc;
+}
+
+//##################################################################################################
+//! Appends records to a mapped file, strings are written once and then referenced by index.
+struct LogWriter
+{
+  MappedFile file;
+  size_t offset{0};
+  std::unordered_map<tp_utils::StringID, uint32_t> stringIndexes;
+
+  //################################################################################################
+  bool open(const std::string& path, const char* magic, size_t initialSize)
+  {
+    if(!file.open(path, MappedFile::Mode::Truncate, std::max(padded(initialSize), size_t(4096))))
+      return false;
+
+    memcpy(file.data(), magic, 8);
+    offset = 8;
+    stringIndexes.clear();
+    return true;
+  }
+
+  //################################################################################################
+  void close()
+  {
+    if(file.isOpen())
+      file.close(offset + sizeof(RecordHeader));
+  }
+
+  //################################################################################################
+  bool write(RecordKind kind, uint8_t flags, uint32_t typeIndex, uint32_t nameIndex, const char* payload, size_t size)
+  {
+    // Leave room for the zeroed end marker.
+    size_t recordSize = sizeof(RecordHeader) + padded(size);
+    size_t required = offset + recordSize + sizeof(RecordHeader);
+    if(required>file.size())
+    {
+      size_t newSize = file.size()*2;
+      while(newSize<required)
+        newSize*=2;
+
+      if(!file.resize(newSize))
+        return false;
+    }
+
+    RecordHeader header;
+    header.kind = kind;
+    header.flags = flags;
+    header.reserved = 0;
+    header.size = uint32_t(size);
+    header.typeIndex = typeIndex;
+    header.nameIndex = nameIndex;
+    header.padding = 0;
+    header.crc = recordCRC(header, payload);
+    header.kind = EndKind;
+
+    char* dst = file.data() + offset;
+    memcpy(dst, &header, sizeof(RecordHeader));
+    if(size)
+      memcpy(dst+sizeof(RecordHeader), payload, size);
+
+    // Write the kind last so that a crash mid record leaves the end marker in place.
+    dst[0] = char(kind);
+
+    offset += recordSize;
+    return true;
+  }
+
+  //################################################################################################
+  bool stringIndex(const tp_utils::StringID& id, uint32_t& index)
+  {
+    auto i = stringIndexes.find(id);
+    if(i!=stringIndexes.end())
+    {
+      index = i->second;
+      return true;
+    }
+
+    index = uint32_t(stringIndexes.size());
+    stringIndexes[id] = index;
+    const std::string& str = id.toString();
+    return write(StringKind, 0, index, 0, str.data(), str.size());
+  }
+
+  //################################################################################################
+  bool writeChannel(const tp_utils::StringID& typeID, const tp_utils::StringID& nameID, bool hasPayload, const std::string& payload)
+  {
+    uint32_t typeIndex=0;
+    uint32_t nameIndex=0;
+    if(!stringIndex(typeID, typeIndex) || !stringIndex(nameID, nameIndex))
+      return false;
+
+    return write(ChannelKind, hasPayload?HasPayloadFlag:0, typeIndex, nameIndex, payload.data(), payload.size());
+  }
+};
+
+//##################################################################################################
+bool writeHandle(LogWriter& writer, const CoreInterfaceCodecs* codecs, const CoreInterfaceHandle& handle, std::string& buffer)
+{
+  buffer.clear();
+  bool hasPayload = codecs->encode(handle.typeID(), handle.data(), buffer);
+  return writer.writeChannel(handle.typeID(), handle.nameID(), hasPayload, buffer);
+}
+
+//##################################################################################################
+//! Write every channel that has a codec.
+bool writeAllChannels(LogWriter& writer, CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs, std::string& buffer)
+{
+  for(const auto& type : coreInterface->channels())
+  {
+    if(!codecs->codec(type.first))
+      continue;
+
+    for(const auto& channel : type.second)
+      if(!writeHandle(writer, codecs, channel.second, buffer))
+        return false;
+  }
+
+  return true;
+}
+
+//##################################################################################################
+//! Write a file next to path and rename it over path once it is complete and synced.
+/*!
+When this returns true the new file and the rename are on disk, so the caller can discard anything
+that the file replaces.
+*/
+bool writeFileAtomically(const std::string& path, const char* magic, const std::function<bool(LogWriter&)>& writeRecords)
+{
+  std::string tmpPath = path + ".tmp";
+
+  LogWriter writer;
+  if(!writer.open(tmpPath, magic, 1<<20))
+    return false;
+
+  if(!writeRecords(writer))
+  {
+    writer.close();
+    std::remove(tmpPath.c_str());
+    return false;
+  }
+
+  // Trim the file before syncing so that the final size is durable along with the records.
+  if(!writer.file.resize(writer.offset + sizeof(RecordHeader)) || !writer.file.sync())
+  {
+    writer.close();
+    std::remove(tmpPath.c_str());
+    return false;
+  }
+  writer.file.close();
+
+  if(std::rename(tmpPath.c_str(), path.c_str())!=0)
+  {
+    tpWarning() << "CoreInterfaceJournal failed to replace: " << path;
+    std::remove(tmpPath.c_str());
+    return false;
+  }
+
+  // Any index of the old file is now stale.
+  std::remove((path + ".index").c_str());
+
+  // The rename is not durable until the directory is, and callers may truncate the journal next.
+  return MappedFile::syncDirectory(path);
+}
+
+//##################################################################################################
+typedef std::function<void(const tp_utils::StringID& typeID, const tp_utils::StringID& nameID, const char* payload, size_t size, bool hasPayload)> ApplyRecord;
+
+//##################################################################################################
+//! Calls apply for each channel record in a file, returns the number of records.
+/*!
+The file must start with magic or otherMagic if that is set.
+*/
+size_t readLog(const std::string& path, const char* magic, const ApplyRecord& apply, const char* otherMagic=nullptr)
+{
+  // Missing files are expected the first time an interface is persisted.
+  if(FILE* f = fopen(path.c_str(), "rb"))
+    fclose(f);
+  else
+    return 0;
+
+  MappedFile file;
+  if(!file.open(path, MappedFile::Mode::ReadOnly))
+    return 0;
+
+  const char* data = file.data();
+  size_t size = file.size();
+  if(size<8 || (memcmp(data, magic, 8)!=0 && (!otherMagic || memcmp(data, otherMagic, 8)!=0)))
+  {
+    tpWarning() << "CoreInterfaceJournal ignoring unrecognized file: " << path;
+    return 0;
+  }
+
+  std::vector<tp_utils::StringID> strings;
+  size_t offset = 8;
+  size_t count = 0;
+
+  while(offset+sizeof(RecordHeader)<=size)
+  {
+    RecordHeader header;
+    memcpy(&header, data+offset, sizeof(RecordHeader));
+    const char* payload = data+offset+sizeof(RecordHeader);
+
+    if(header.kind==EndKind || offset+sizeof(RecordHeader)+header.size>size)
+      break;
+
+    if(!recordIntact(header, payload))
+    {
+      tpWarning() << "CoreInterfaceJournal corrupt record at offset: " << offset << " in: " << path;
+      break;
+    }
+
+    offset += sizeof(RecordHeader) + padded(header.size);
+
+    if(header.kind==StringKind)
+    {
+      if(strings.size()<=header.typeIndex)
+        strings.resize(header.typeIndex+1);
+      strings[header.typeIndex] = tp_utils::StringID(std::string(payload, header.size));
+    }
+    else if(header.kind==ChannelKind && header.typeIndex<strings.size() && header.nameIndex<strings.size())
+    {
+      apply(strings[header.typeIndex], strings[header.nameIndex], payload, header.size, header.flags&HasPayloadFlag);
+      count++;
+    }
+  }
+
+  return count;
+}
+
+//##################################################################################################
+//! Read the header of a record, returns false unless it is of kind and lies within the file.
+bool recordAt(const char* data, size_t size, uint64_t offset, RecordKind kind, RecordHeader& header)
+{
+  if(offset<8 || offset>size || size-offset<sizeof(RecordHeader))
+    return false;
+
+  memcpy(&header, data+offset, sizeof(RecordHeader));
+  return header.kind==kind && header.size<=size-offset-sizeof(RecordHeader);
+}
+
+//##################################################################################################
+//! FNV-1a over the first and last pages of a file, catches most rewrites without reading it all.
+uint64_t sampleHash(const char* data, size_t size)
+{
+  uint64_t h = 14695981039346656037ull;
+  auto add = [&](const char* bytes, size_t count)
+  {
+    for(size_t i=0; i<count; i++)
+      h = (h ^ uint8_t(bytes[i])) * 1099511628211ull;
+  };
+
+  size_t sample = std::min(size, size_t(4096));
+  add(data, sample);
+  add(data+size-sample, sample);
+  return h;
+}
+
+//##################################################################################################
+//! Compare the bytes of a string record with a string, the record must have been checked by recordAt().
+int compareString(const char* data, uint64_t stringOffset, const char* str, size_t size)
+{
+  RecordHeader header;
+  memcpy(&header, data+stringOffset, sizeof(RecordHeader));
+
+  int c = memcmp(data+stringOffset+sizeof(RecordHeader), str, std::min(size_t(header.size), size));
+  if(c!=0)
+    return c;
+  return (header.size<size)?-1:((header.size>size)?1:0);
+}
+
+//##################################################################################################
+//! Compare the string records at two offsets.
+int compareStrings(const char* data, uint64_t lhsOffset, uint64_t rhsOffset)
+{
+  RecordHeader header;
+  memcpy(&header, data+rhsOffset, sizeof(RecordHeader));
+  return compareString(data, lhsOffset, data+rhsOffset+sizeof(RecordHeader), header.size);
+}
+
+//##################################################################################################
+//! Write a sorted index of the channel records in a mapped checkpoint or delta.
+bool writeIndex(const MappedFile& file, const MappedFile::Identity& identity, const std::string& indexPath)
+{
+  const char* data = file.data();
+  size_t size = file.size();
+
+  std::vector<uint64_t> strings;
+  std::vector<IndexEntry> entries;
+  size_t offset = 8;
+
+  while(offset+sizeof(RecordHeader)<=size)
+  {
+    RecordHeader header;
+    memcpy(&header, data+offset, sizeof(RecordHeader));
+
+    if(header.kind==EndKind || offset+sizeof(RecordHeader)+header.size>size)
+      break;
+
+    // Records after a damaged one are not indexed, matching what loadCheckpoint() would apply.
+    if(!recordIntact(header, data+offset+sizeof(RecordHeader)))
+      break;
+
+    if(header.kind==StringKind)
+    {
+      if(strings.size()<=header.typeIndex)
+        strings.resize(header.typeIndex+1, 0);
+      strings[header.typeIndex] = offset;
+    }
+    else if(header.kind==ChannelKind && header.typeIndex<strings.size() && header.nameIndex<strings.size())
+      entries.push_back({offset, strings[header.typeIndex], strings[header.nameIndex]});
+
+    offset += sizeof(RecordHeader) + padded(header.size);
+  }
+
+  // Sort by type then name, the sort is stable so the last record for a channel is the last of its
+  // run and is the one that is kept.
+  auto compare = [&](const IndexEntry& lhs, const IndexEntry& rhs)
+  {
+    int c = compareStrings(data, lhs.typeOffset, rhs.typeOffset);
+    return (c!=0)?(c<0):(compareStrings(data, lhs.nameOffset, rhs.nameOffset)<0);
+  };
+  std::stable_sort(entries.begin(), entries.end(), compare);
+
+  std::vector<IndexEntry> unique;
+  unique.reserve(entries.size());
+  for(size_t i=0; i<entries.size(); i++)
+    if(i+1==entries.size() || compare(entries.at(i), entries.at(i+1)))
+      unique.push_back(entries.at(i));
+
+  std::string tmpPath = indexPath + ".tmp";
+  size_t indexSize = sizeof(IndexHeader) + unique.size()*sizeof(IndexEntry);
+
+  MappedFile index;
+  if(!index.open(tmpPath, MappedFile::Mode::Truncate, indexSize))
+    return false;
+
+  IndexHeader header;
+  memcpy(header.magic, indexMagic, 8);
+  header.fileSize = size;
+  header.fileDevice = identity.device;
+  header.fileInode = identity.inode;
+  header.fileModifiedNS = identity.modifiedNS;
+  header.fileHash = sampleHash(data, size);
+  header.count = unique.size();
+  memcpy(index.data(), &header, sizeof(IndexHeader));
+  if(!unique.empty())
+    memcpy(index.data()+sizeof(IndexHeader), unique.data(), unique.size()*sizeof(IndexEntry));
+
+  index.sync();
+  index.close(indexSize);
+
+  if(std::rename(tmpPath.c_str(), indexPath.c_str())!=0)
+  {
+    std::remove(tmpPath.c_str());
+    return false;
+  }
+
+  return true;
+}
+}
+
+//##################################################################################################
+struct CoreInterfaceJournal::Private
+{
+  TP_NONCOPYABLE(Private);
+
+  CoreInterface* coreInterface;
+  const CoreInterfaceCodecs* codecs;
+
+  std::string path;
+  size_t compactionBytes{0};
+  LogWriter journal;
+  std::string buffer;
+  bool failed{false};
+  bool compactionDue{false};
+
+  //################################################################################################
+  Private(CoreInterface* coreInterface_, const CoreInterfaceCodecs* codecs_):
+    coreInterface(coreInterface_),
+    codecs(codecs_)
+  {
+
+  }
+
+  //################################################################################################
+  std::string journalPath() const
+  {
+    return path + ".journal";
+  }
+
+  //################################################################################################
+  std::string checkpointPath() const
+  {
+    return path + ".checkpoint";
+  }
+
+  //################################################################################################
+  //! Write the current value of each persisted channel to a new checkpoint and restart the journal.
+  bool checkpoint()
+  {
+    bool written = writeFileAtomically(checkpointPath(), checkpointMagic, [&](LogWriter& writer)
+    {
+      return writeAllChannels(writer, coreInterface, codecs, buffer);
+    });
+
+    if(!written)
+      return false;
+
+    compactionDue = false;
+    journal.close();
+    return journal.open(journalPath(), journalMagic, std::min(compactionBytes, size_t(1)<<20));
+  }
+};
+
+//##################################################################################################
+CoreInterfaceJournal::CoreInterfaceJournal(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs):
+  d(new Private(coreInterface, codecs))
+{
+
+}
+
+//##################################################################################################
+CoreInterfaceJournal::~CoreInterfaceJournal()
+{
+  close();
+  delete d;
+}
+
+//##################################################################################################
+size_t CoreInterfaceJournal::recover(const std::string& path)
+{
+  auto apply = [&](const tp_utils::StringID& typeID, const tp_utils::StringID& nameID, const char* payload, size_t size, bool hasPayload)
+  {
+    CoreInterfaceData* data = hasPayload?d->codecs->decode(typeID, payload, size):nullptr;
+    d->coreInterface->setChannelData(d->coreInterface->handle(typeID, nameID), data);
+  };
+
+  size_t count = loadCheckpoint(d->coreInterface, d->codecs, path + ".checkpoint");
+  count += readLog(path + ".journal", journalMagic, apply);
+  return count;
+}
+
+//##################################################################################################
+bool CoreInterfaceJournal::open(const std::string& path, size_t compactionBytes)
+{
+  close();
+
+  d->path = path;
+  d->compactionBytes = compactionBytes;
+  d->failed = false;
+  d->compactionDue = false;
+
+  if(!d->checkpoint())
+  {
+    tpWarning() << "CoreInterfaceJournal failed to open: " << path;
+    d->journal.close();
+    return false;
+  }
+
+  d->coreInterface->registerObserver(this);
+  return true;
+}
+
+//##################################################################################################
+void CoreInterfaceJournal::close()
+{
+  if(!d->journal.file.isOpen())
+    return;
+
+  d->coreInterface->unregisterObserver(this);
+  d->journal.close();
+}
+
+//##################################################################################################
+bool CoreInterfaceJournal::isOpen() const
+{
+  return d->journal.file.isOpen();
+}
+
+//##################################################################################################
+bool CoreInterfaceJournal::checkpoint()
+{
+  if(!isOpen())
+    return false;
+
+  return d->checkpoint();
+}
+
+//##################################################################################################
+bool CoreInterfaceJournal::compact()
+{
+  if(!isOpen() || !d->compactionDue)
+    return false;
+
+  if(d->checkpoint())
+    return true;
+
+  // Back off so that a failing disk does not cause a checkpoint attempt on every call.
+  tpWarning() << "CoreInterfaceJournal failed to compact journal: " << d->journalPath();
+  d->compactionBytes = d->journal.offset*2;
+  d->compactionDue = false;
+  return false;
+}
+
+//##################################################################################################
+bool CoreInterfaceJournal::compactionDue() const
+{
+  return d->compactionDue;
+}
+
+//##################################################################################################
+bool CoreInterfaceJournal::sync()
+{
+  return isOpen() && d->journal.file.sync();
+}
+
+//##################################################################################################
+size_t CoreInterfaceJournal::journalBytes() const
+{
+  return d->journal.offset;
+}
+
+//##################################################################################################
+void CoreInterfaceJournal::channelDataSet(const CoreInterfaceHandle& handle, const CoreInterfaceData* data)
+{
+  if(!d->journal.file.isOpen() || !d->codecs->codec(handle.typeID()))
+    return;
+
+  d->buffer.clear();
+  bool hasPayload = d->codecs->encode(handle.typeID(), data, d->buffer);
+  if(!d->journal.writeChannel(handle.typeID(), handle.nameID(), hasPayload, d->buffer))
+  {
+    if(!d->failed)
+      tpWarning() << "CoreInterfaceJournal failed to grow journal: " << d->journalPath();
+    d->failed = true;
+    return;
+  }
+
+  // The checkpoint is written and synced by compact(), not here in the middle of a dispatch.
+  if(d->journal.offset>d->compactionBytes)
+    d->compactionDue = true;
+}
+
+//##################################################################################################
+bool writeCheckpoint(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs, const std::string& path)
+{
+  std::string buffer;
+  bool written = writeFileAtomically(path, checkpointMagic, [&](LogWriter& writer)
+  {
+    return writeAllChannels(writer, coreInterface, codecs, buffer);
+  });
+
+  if(written && coreInterface->dirtyTracking())
+    coreInterface->clearDirtyChannels();
+
+  return written;
+}
+
+//##################################################################################################
+bool writeCheckpointDelta(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs, const std::string& path)
+{
+  if(!coreInterface->dirtyTracking())
+  {
+    tpWarning() << "writeCheckpointDelta called without dirty tracking enabled.";
+    return false;
+  }
+
+  std::string buffer;
+  bool written = writeFileAtomically(path, deltaMagic, [&](LogWriter& writer)
+  {
+    for(const auto& handle : coreInterface->dirtyChannels())
+      if(codecs->codec(handle.typeID()) && !writeHandle(writer, codecs, handle, buffer))
+        return false;
+    return true;
+  });
+
+  // On failure the channels stay dirty so that the next delta picks them up.
+  if(written)
+    coreInterface->clearDirtyChannels();
+
+  return written;
+}
+
+//##################################################################################################
+bool mergeCheckpointDeltas(const std::string& basePath, const std::vector<std::string>& deltaPaths, const std::string& outputPath)
+{
+  struct Record
+  {
+    tp_utils::StringID typeID;
+    tp_utils::StringID nameID;
+    bool hasPayload;
+    std::string payload;
+  };
+
+  // Records are kept in the order that channels first appear, payloads are copied without decoding.
+  std::vector<Record> records;
+  std::unordered_map<tp_utils::StringID, std::unordered_map<tp_utils::StringID, size_t>> indexes;
+
+  auto apply = [&](const tp_utils::StringID& typeID, const tp_utils::StringID& nameID, const char* payload, size_t size, bool hasPayload)
+  {
+    auto& names = indexes[typeID];
+    auto i = names.find(nameID);
+    if(i==names.end())
+    {
+      names[nameID] = records.size();
+      records.push_back({typeID, nameID, hasPayload, std::string(payload, size)});
+    }
+    else
+    {
+      Record& record = records[i->second];
+      record.hasPayload = hasPayload;
+      record.payload.assign(payload, size);
+    }
+  };
+
+  readLog(basePath, checkpointMagic, apply);
+  for(const auto& deltaPath : deltaPaths)
+    readLog(deltaPath, deltaMagic, apply);
+
+  return writeFileAtomically(outputPath, checkpointMagic, [&](LogWriter& writer)
+  {
+    for(const auto& record : records)
+      if(!writer.writeChannel(record.typeID, record.nameID, record.hasPayload, record.payload))
+        return false;
+    return true;
+  });
+}
+
+//##################################################################################################
+size_t loadCheckpoint(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs, const std::string& path)
+{
+  return readLog(path, checkpointMagic, [&](const tp_utils::StringID& typeID, const tp_utils::StringID& nameID, const char* payload, size_t size, bool hasPayload)
+  {
+    CoreInterfaceData* data = hasPayload?codecs->decode(typeID, payload, size):nullptr;
+    coreInterface->setChannelData(coreInterface->handle(typeID, nameID), data);
+  }, deltaMagic);
+}
+
+//##################################################################################################
+struct CoreInterfaceLazyCheckpoint::Private
+{
+  TP_NONCOPYABLE(Private);
+
+  const CoreInterfaceCodecs* codecs;
+
+  MappedFile file;
+  MappedFile::Identity identity;
+  uint64_t hash{0};
+
+  std::string indexPath;
+  MappedFile index;
+  const IndexEntry* entries{nullptr};
+  size_t count{0};
+  bool rebuilt{false};
+
+  //################################################################################################
+  Private(const CoreInterfaceCodecs* codecs_):
+    codecs(codecs_)
+  {
+
+  }
+
+  //################################################################################################
+  //! Map the index and check that it was built from the current file.
+  bool openIndex(const std::string& indexPath)
+  {
+    if(FILE* f = fopen(indexPath.c_str(), "rb"))
+      fclose(f);
+    else
+      return false;
+
+    if(!index.open(indexPath, MappedFile::Mode::ReadOnly))
+      return false;
+
+    // The index may have been left behind by a checkpoint that has since been replaced, possibly by
+    // one of the same size, so the whole identity of the file is compared.
+    IndexHeader header;
+    if(index.size()>=sizeof(IndexHeader))
+    {
+      memcpy(&header, index.data(), sizeof(IndexHeader));
+      if(memcmp(header.magic, indexMagic, 8)==0 &&
+         header.fileSize==file.size() &&
+         header.fileSize==identity.size &&
+         header.fileDevice==identity.device &&
+         header.fileInode==identity.inode &&
+         header.fileModifiedNS==identity.modifiedNS &&
+         header.fileHash==hash &&
+         header.count<=(index.size()-sizeof(IndexHeader))/sizeof(IndexEntry))
+      {
+        entries = reinterpret_cast<const IndexEntry*>(index.data()+sizeof(IndexHeader));
+        count = size_t(header.count);
+        return true;
+      }
+    }
+
+    index.close();
+    return false;
+  }
+
+  //################################################################################################
+  //! Replace an index that has entries pointing outside the file, this is done at most once.
+  bool rebuild()
+  {
+    entries = nullptr;
+    count = 0;
+    index.close();
+
+    if(rebuilt)
+      return false;
+    rebuilt = true;
+
+    tpWarning() << "CoreInterfaceLazyCheckpoint rebuilding invalid index: " << indexPath;
+    return writeIndex(file, identity, indexPath) && openIndex(indexPath);
+  }
+
+  //################################################################################################
+  //! Binary search the index, returns false if an entry is invalid.
+  bool find(const std::string& type, const std::string& name, uint64_t& token) const
+  {
+    const char* data = file.data();
+    size_t size = file.size();
+    token = 0;
+
+    size_t first=0;
+    size_t last=count;
+    while(first<last)
+    {
+      size_t middle = first + (last-first)/2;
+      const IndexEntry& entry = entries[middle];
+
+      RecordHeader typeHeader;
+      RecordHeader nameHeader;
+      if(!recordAt(data, size, entry.typeOffset, StringKind, typeHeader) ||
+         !recordAt(data, size, entry.nameOffset, StringKind, nameHeader))
+        return false;
+
+      int c = compareString(data, entry.typeOffset, type.data(), type.size());
+      if(c==0)
+        c = compareString(data, entry.nameOffset, name.data(), name.size());
+
+      if(c==0)
+      {
+        RecordHeader header;
+        if(!recordAt(data, size, entry.recordOffset, ChannelKind, header))
+          return false;
+
+        token = entry.recordOffset+1;
+        return true;
+      }
+
+      if(c<0)
+        first = middle+1;
+      else
+        last = middle;
+    }
+
+    return true;
+  }
+};
+
+//##################################################################################################
+CoreInterfaceLazyCheckpoint::CoreInterfaceLazyCheckpoint(const CoreInterfaceCodecs* codecs):
+  d(new Private(codecs))
+{
+
+}
+
+//##################################################################################################
+CoreInterfaceLazyCheckpoint::~CoreInterfaceLazyCheckpoint()
+{
+  close();
+  delete d;
+}
+
+//##################################################################################################
+bool CoreInterfaceLazyCheckpoint::open(const std::string& path, const std::string& indexPath_)
+{
+  close();
+
+  if(FILE* f = fopen(path.c_str(), "rb"))
+    fclose(f);
+  else
+    return false;
+
+  if(!d->file.open(path, MappedFile::Mode::ReadOnly))
+    return false;
+
+  if(d->file.size()<8 || (memcmp(d->file.data(), checkpointMagic, 8)!=0 && memcmp(d->file.data(), deltaMagic, 8)!=0))
+  {
+    tpWarning() << "CoreInterfaceLazyCheckpoint ignoring unrecognized file: " << path;
+    d->file.close();
+    return false;
+  }
+
+  if(!d->file.identity(d->identity))
+  {
+    d->file.close();
+    return false;
+  }
+
+  d->hash = sampleHash(d->file.data(), d->file.size());
+  d->indexPath = indexPath_.empty()?(path + ".index"):indexPath_;
+  d->rebuilt = false;
+
+  const std::string& indexPath = d->indexPath;
+  if(!d->openIndex(indexPath) && !(writeIndex(d->file, d->identity, indexPath) && d->openIndex(indexPath)))
+  {
+    tpWarning() << "CoreInterfaceLazyCheckpoint failed to index: " << path;
+    d->file.close();
+    return false;
+  }
+
+  return true;
+}
+
+//##################################################################################################
+void CoreInterfaceLazyCheckpoint::close()
+{
+  d->entries = nullptr;
+  d->count = 0;
+  d->index.close();
+  d->file.close();
+}
+
+//##################################################################################################
+size_t CoreInterfaceLazyCheckpoint::size() const
+{
+  return d->count;
+}
+
+//##################################################################################################
+uint64_t CoreInterfaceLazyCheckpoint::find(const tp_utils::StringID& typeID, const tp_utils::StringID& nameID) const
+{
+  if(!d->entries)
+    return 0;
+
+  const std::string& type = typeID.toString();
+  const std::string& name = nameID.toString();
+
+  // An entry outside the file means the index is stale, it is rebuilt and the search repeated.
+  uint64_t token=0;
+  if(d->find(type, name, token) || (d->rebuild() && d->find(type, name, token)))
+    return token;
+
+  tpWarning() << "CoreInterfaceLazyCheckpoint failed to rebuild index: " << d->indexPath;
+  d->entries = nullptr;
+  d->count = 0;
+  return 0;
+}
+
+//##################################################################################################
+CoreInterfaceData* CoreInterfaceLazyCheckpoint::load(const tp_utils::StringID& typeID, uint64_t token) const
+{
+  RecordHeader header;
+  if(!d->file.isOpen() || token==0 || !recordAt(d->file.data(), d->file.size(), token-1, ChannelKind, header))
+    return nullptr;
+
+  const char* payload = d->file.data()+(token-1)+sizeof(RecordHeader);
+  if(!(header.flags&HasPayloadFlag) || !recordIntact(header, payload))
+    return nullptr;
+
+  return d->codecs->decode(typeID, payload, header.size);
+}
+
+}
@@ -0,0 +1,414 @@
+#include "tp_control/CoreInterfaceRecorder.h"
+#include "tp_control/CoreInterfaceCodecs.h"
+#include "tp_control/MappedFile.h"
+
+#include "tp_utils/DebugUtils.h"
+
+#include <chrono>
+#include <thread>
+#include <cstring>
+
+namespace tp_control
+{
+
+namespace
+{
+//##################################################################################################
+// Log layout: an 8 byte magic followed by 8 byte aligned records, each record is a RecordHeader
+// followed by size bytes of payload. The mapping is zero filled so a kind of zero marks the end.
+const char logMagic[8] = {'T', 'P', 'C', 'I', 'R', 'E', 'C', '1'};
+
+enum RecordKind : uint8_t
+{
+  EndKind     = 0,
+  StringKind  = 1,
+  HandleKind  = 2,
+  ChannelKind = 3,
+  SignalKind  = 4
+};
+
+enum RecordFlags : uint8_t
+{
+  HasPayloadFlag = 1,
+  NestedFlag     = 2
+};
+
+struct RecordHeader
+{
+  uint8_t kind;
+  uint8_t flags;
+  uint16_t reserved;
+  uint32_t size;
+  int64_t timestampNS;
+  uint32_t typeIndex;
+  uint32_t nameIndex;
+};
+
+//##################################################################################################
+size_t padded(size_t size)
+{
+  return (size+7) & ~size_t(7);
+}
+}
+
+//##################################################################################################
+struct CoreInterfaceRecorder::Private
+{
+  TP_NONCOPYABLE(Private);
+
+  CoreInterface* coreInterface;
+  const CoreInterfaceCodecs* codecs;
+
+  MappedFile file;
+  size_t offset{0};
+  size_t eventCount{0};
+  bool recording{false};
+
+  std::chrono::steady_clock::time_point startTime;
+  std::unordered_map<tp_utils::StringID, uint32_t> stringIndexes;
+  std::string buffer;
+
+  //################################################################################################
+  Private(CoreInterface* coreInterface_, const CoreInterfaceCodecs* codecs_):
+    coreInterface(coreInterface_),
+    codecs(codecs_)
+  {
+
+  }
+
+  //################################################################################################
+  bool reserve(size_t size)
+  {
+    // Leave room for the zeroed end marker.
+    size_t required = offset + size + sizeof(RecordHeader);
+    if(required<=file.size())
+      return true;
+
+    size_t newSize = file.size()*2;
+    while(newSize<required)
+      newSize*=2;
+
+    return file.resize(newSize);
+  }
+
+  //################################################################################################
+  void write(RecordKind kind, uint8_t flags, uint32_t typeIndex, uint32_t nameIndex, const char* payload, size_t size)
+  {
+    size_t recordSize = sizeof(RecordHeader) + padded(size);
+    if(!reserve(recordSize))
+    {
+      tpWarning() << "CoreInterfaceRecorder failed to grow log, recording stopped.";
+      recording = false;
+      return;
+    }
+
+    RecordHeader header;
+    header.kind = EndKind;
+    header.flags = flags;
+    header.reserved = 0;
+    header.size = uint32_t(size);
+    header.timestampNS = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+    header.typeIndex = typeIndex;
+    header.nameIndex = nameIndex;
+
+    char* dst = file.data() + offset;
+    memcpy(dst, &header, sizeof(RecordHeader));
+    if(size)
+      memcpy(dst+sizeof(RecordHeader), payload, size);
+
+    // Write the kind last so that a reader of a partially written log stops before this record.
+    dst[0] = char(kind);
+
+    offset += recordSize;
+  }
+
+  //################################################################################################
+  uint32_t stringIndex(const tp_utils::StringID& id)
+  {
+    auto i = stringIndexes.find(id);
+    if(i!=stringIndexes.end())
+      return i->second;
+
+    uint32_t index = uint32_t(stringIndexes.size());
+    stringIndexes[id] = index;
+    const std::string& str = id.toString();
+    write(StringKind, 0, index, 0, str.data(), str.size());
+    return index;
+  }
+
+  //################################################################################################
+  void writeEvent(RecordKind kind, const tp_utils::StringID& typeID, const tp_utils::StringID& nameID, const CoreInterfaceData* data)
+  {
+    if(!recording)
+      return;
+
+    uint32_t typeIndex = stringIndex(typeID);
+    uint32_t nameIndex = nameID.isValid()?stringIndex(nameID):0;
+
+    uint8_t flags = (coreInterface->dispatchDepth()>0)?NestedFlag:0;
+
+    buffer.clear();
+    if(codecs && codecs->encode(typeID, data, buffer))
+      flags |= HasPayloadFlag;
+
+    write(kind, flags, typeIndex, nameIndex, buffer.data(), buffer.size());
+    eventCount++;
+  }
+};
+
+//##################################################################################################
+CoreInterfaceRecorder::CoreInterfaceRecorder(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs):
+  d(new Private(coreInterface, codecs))
+{
+
+}
+
+//##################################################################################################
+CoreInterfaceRecorder::~CoreInterfaceRecorder()
+{
+  stop();
+  delete d;
+}
+
+//##################################################################################################
+bool CoreInterfaceRecorder::start(const std::string& path, size_t initialSize)
+{
+  stop();
+
+  initialSize = std::max(padded(initialSize), size_t(4096));
+  if(!d->file.open(path, MappedFile::Mode::Truncate, initialSize))
+    return false;
+
+  memcpy(d->file.data(), logMagic, sizeof(logMagic));
+  d->offset = sizeof(logMagic);
+  d->eventCount = 0;
+  d->stringIndexes.clear();
+  d->startTime = std::chrono::steady_clock::now();
+  d->recording = true;
+  d->coreInterface->registerObserver(this);
+  return true;
+}
+
+//##################################################################################################
+void CoreInterfaceRecorder::stop()
+{
+  if(!d->file.isOpen())
+    return;
+
+  d->coreInterface->unregisterObserver(this);
+  d->recording = false;
+  d->file.close(d->offset + sizeof(RecordHeader));
+}
+
+//##################################################################################################
+bool CoreInterfaceRecorder::isRecording() const
+{
+  return d->recording;
+}
+
+//##################################################################################################
+size_t CoreInterfaceRecorder::eventCount() const
+{
+  return d->eventCount;
+}
+
+//##################################################################################################
+size_t CoreInterfaceRecorder::bytesWritten() const
+{
+  return d->offset;
+}
+
+//##################################################################################################
+void CoreInterfaceRecorder::handleCreated(const CoreInterfaceHandle& handle)
+{
+  d->writeEvent(HandleKind, handle.typeID(), handle.nameID(), nullptr);
+}
+
+//##################################################################################################
+void CoreInterfaceRecorder::channelDataSet(const CoreInterfaceHandle& handle, const CoreInterfaceData* data)
+{
+  d->writeEvent(ChannelKind, handle.typeID(), handle.nameID(), data);
+}
+
+//##################################################################################################
+void CoreInterfaceRecorder::signalSent(const tp_utils::StringID& typeID, const CoreInterfaceData* data)
+{
+  d->writeEvent(SignalKind, typeID, tp_utils::StringID(), data);
+}
+
+//##################################################################################################
+struct CoreInterfaceReplayer::Private
+{
+  TP_NONCOPYABLE(Private);
+
+  const CoreInterfaceCodecs* codecs;
+  MappedFile file;
+  bool corrupt{false};
+
+  //################################################################################################
+  Private(const CoreInterfaceCodecs* codecs_):
+    codecs(codecs_)
+  {
+
+  }
+};
+
+//##################################################################################################
+CoreInterfaceReplayer::CoreInterfaceReplayer(const CoreInterfaceCodecs* codecs):
+  d(new Private(codecs))
+{
+
+}
+
+//##################################################################################################
+CoreInterfaceReplayer::~CoreInterfaceReplayer()
+{
+  delete d;
+}
+
+//##################################################################################################
+bool CoreInterfaceReplayer::open(const std::string& path)
+{
+  if(!d->file.open(path, MappedFile::Mode::ReadOnly))
+    return false;
+
+  if(d->file.size()<sizeof(logMagic) || memcmp(d->file.data(), logMagic, sizeof(logMagic))!=0)
+  {
+    tpWarning() << "CoreInterfaceReplayer not a core interface log: " << path;
+    d->file.close();
+    return false;
+  }
+
+  return true;
+}
+
+//##################################################################################################
+void CoreInterfaceReplayer::close()
+{
+  d->file.close();
+}
+
+//##################################################################################################
+size_t CoreInterfaceReplayer::replay(CoreInterface* coreInterface, double speed, bool topLevelOnly)
+{
+  d->corrupt = false;
+  if(!d->file.isOpen())
+    return 0;
+
+  std::vector<tp_utils::StringID> strings;
+  std::unordered_map<uint64_t, CoreInterfaceHandle> handles;
+
+  auto getHandle = [&](const RecordHeader& header)
+  {
+    uint64_t key = (uint64_t(header.typeIndex)<<32) | header.nameIndex;
+    CoreInterfaceHandle& handle = handles[key];
+    if(!handle.typeID().isValid())
+      handle = coreInterface->handle(strings[header.typeIndex], strings[header.nameIndex]);
+    return handle;
+  };
+
+  const char* data = d->file.data();
+  size_t size = d->file.size();
+  size_t offset = sizeof(logMagic);
+  size_t eventCount = 0;
+
+  auto startTime = std::chrono::steady_clock::now();
+  int64_t firstTimestamp = -1;
+
+  while(offset+sizeof(RecordHeader)<=size)
+  {
+    RecordHeader header;
+    memcpy(&header, data+offset, sizeof(RecordHeader));
+    const char* payload = data+offset+sizeof(RecordHeader);
+
+    if(header.kind==EndKind)
+      break;
+
+    // The recorder numbers strings in the order it writes them, so a string may only replace an
+    // existing entry or add the next one, and events may only refer to strings already written.
+    bool valid = (offset+sizeof(RecordHeader)+header.size<=size);
+    if(valid)
+    {
+      switch(header.kind)
+      {
+      case StringKind:
+        valid = (header.typeIndex<=strings.size());
+        break;
+
+      case HandleKind:
+      case ChannelKind:
+        valid = (header.typeIndex<strings.size() && header.nameIndex<strings.size());
+        break;
+
+      case SignalKind:
+        valid = (header.typeIndex<strings.size());
+        break;
+
+      default:
+        valid = false;
+        break;
+      }
+    }
+
+    if(!valid)
+    {
+      tpWarning() << "CoreInterfaceReplayer corrupt record at offset: " << offset;
+      d->corrupt = true;
+      break;
+    }
+
+    offset += sizeof(RecordHeader) + padded(header.size);
+
+    if(header.kind==StringKind)
+    {
+      if(header.typeIndex==strings.size())
+        strings.emplace_back();
+      strings[header.typeIndex] = tp_utils::StringID(std::string(payload, header.size));
+      continue;
+    }
+
+    if(topLevelOnly && (header.flags&NestedFlag))
+      continue;
+
+    if(speed>0.0)
+    {
+      if(firstTimestamp<0)
+        firstTimestamp = header.timestampNS;
+
+      auto delay = std::chrono::nanoseconds(int64_t(double(header.timestampNS-firstTimestamp)/speed));
+      std::this_thread::sleep_until(startTime + delay);
+    }
+
+    const tp_utils::StringID& typeID = strings[header.typeIndex];
+    CoreInterfaceData* eventData = nullptr;
+    if((header.flags&HasPayloadFlag) && d->codecs)
+      eventData = d->codecs->decode(typeID, payload, header.size);
+
+    switch(header.kind)
+    {
+    case HandleKind:
+      getHandle(header);
+      break;
+
+    case ChannelKind:
+      coreInterface->setChannelData(getHandle(header), eventData);
+      break;
+
+    case SignalKind:
+      coreInterface->sendSignal(typeID, eventData);
+      break;
+    }
+
+    eventCount++;
+  }
+
+  return eventCount;
+}
+
+//##################################################################################################
+bool CoreInterfaceReplayer::isCorrupt() const
+{
+  return d->corrupt;
+}
+
+}
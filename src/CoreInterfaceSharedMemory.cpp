@@ -0,0 +1,489 @@
+#include "tp_control/CoreInterfaceSharedMemory.h"
+#include "tp_control/CoreInterfaceCodecs.h"
+#include "tp_control/MappedFile.h"
+
+#include "tp_utils/DebugUtils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string_view>
+#include <thread>
+
+namespace tp_control
+{
+
+namespace
+{
+//##################################################################################################
+// Region layout: a RegionHeader, then slotCount slots of slotStride bytes, then ringCapacity ring
+// entries. Each slot is a SlotHeader followed by payloadCapacity bytes.
+const char regionMagic[8] = {'T', 'P', 'C', 'I', 'S', 'H', 'M', '1'};
+const size_t idCapacity = 64;
+
+// A reader gives up on a slot that stays locked for this many attempts, the writer may have died
+// part way through a write. It yields after the first few attempts.
+const size_t readAttempts = 10000;
+const size_t readSpins = 64;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "Shared memory requires lock free 32 bit atomics.");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory requires lock free 64 bit atomics.");
+
+struct RegionHeader
+{
+  char magic[8];
+  uint32_t slotCount;
+  uint32_t payloadCapacity;
+  uint32_t ringCapacity;
+  uint32_t slotStride;
+  std::atomic<uint32_t> usedSlots;
+  std::atomic<uint32_t> generation; //!< Incremented each time a mirror opens the region.
+  std::atomic<uint64_t> ringHead;
+};
+
+struct SlotHeader
+{
+  std::atomic<uint32_t> sequence;
+  uint32_t size;
+  char typeID[idCapacity];
+  char nameID[idCapacity];
+};
+
+//##################################################################################################
+// Ring entries pack the low 32 bits of their position with the slot index so that readers can
+// detect entries that have been overwritten.
+typedef std::atomic<uint64_t> RingEntry;
+
+//##################################################################################################
+size_t alignTo(size_t size, size_t alignment)
+{
+  return (size+alignment-1) & ~(alignment-1);
+}
+
+//##################################################################################################
+size_t slotsOffset()
+{
+  return alignTo(sizeof(RegionHeader), 64);
+}
+
+//##################################################################################################
+size_t ringOffset(const RegionHeader* header)
+{
+  return slotsOffset() + size_t(header->slotCount)*header->slotStride;
+}
+
+//##################################################################################################
+size_t regionSize(const RegionHeader* header)
+{
+  return ringOffset(header) + size_t(header->ringCapacity)*sizeof(RingEntry);
+}
+
+//##################################################################################################
+SlotHeader* slotAt(char* region, const RegionHeader* header, size_t index)
+{
+  return reinterpret_cast<SlotHeader*>(region + slotsOffset() + index*header->slotStride);
+}
+
+//##################################################################################################
+RingEntry* ringAt(char* region, const RegionHeader* header, uint64_t position)
+{
+  return reinterpret_cast<RingEntry*>(region + ringOffset(header)) + (position%header->ringCapacity);
+}
+}
+
+//##################################################################################################
+struct CoreInterfaceSharedMemoryMirror::Private
+{
+  TP_NONCOPYABLE(Private);
+
+  CoreInterface* coreInterface;
+  const CoreInterfaceCodecs* codecs;
+
+  MappedFile file;
+  RegionHeader* header{nullptr};
+
+  std::vector<tp_utils::StringID> channelTypes;
+  std::unordered_map<tp_utils::StringID, std::unordered_map<tp_utils::StringID, int>> slots;
+  std::string buffer;
+
+  //################################################################################################
+  Private(CoreInterface* coreInterface_, const CoreInterfaceCodecs* codecs_):
+    coreInterface(coreInterface_),
+    codecs(codecs_)
+  {
+
+  }
+
+  //################################################################################################
+  int slot(const CoreInterfaceHandle& handle)
+  {
+    int& index = slots[handle.typeID()][handle.nameID()];
+    if(index>0)
+      return index-1;
+
+    if(index<0)
+      return -1;
+
+    const std::string& typeID = handle.typeID().toString();
+    const std::string& nameID = handle.nameID().toString();
+    uint32_t used = header->usedSlots.load(std::memory_order_relaxed);
+    if(used>=header->slotCount || typeID.size()>=idCapacity || nameID.size()>=idCapacity)
+    {
+      tpWarning() << "CoreInterfaceSharedMemoryMirror can't mirror: " << typeID << " " << nameID;
+      index = -1;
+      return -1;
+    }
+
+    SlotHeader* s = slotAt(file.data(), header, used);
+    memcpy(s->typeID, typeID.c_str(), typeID.size()+1);
+    memcpy(s->nameID, nameID.c_str(), nameID.size()+1);
+    header->usedSlots.store(used+1, std::memory_order_release);
+
+    index = int(used)+1;
+    return int(used);
+  }
+
+  //################################################################################################
+  void write(const CoreInterfaceHandle& handle, const CoreInterfaceData* data)
+  {
+    if(!header || !tpContains(channelTypes, handle.typeID()))
+      return;
+
+    buffer.clear();
+    if(data && !codecs->encode(handle.typeID(), data, buffer))
+      return;
+
+    if(buffer.size()>header->payloadCapacity)
+    {
+      tpWarning() << "CoreInterfaceSharedMemoryMirror payload too large: " << handle.typeID().toString();
+      return;
+    }
+
+    int index = slot(handle);
+    if(index<0)
+      return;
+
+    SlotHeader* s = slotAt(file.data(), header, size_t(index));
+    uint32_t sequence = s->sequence.load(std::memory_order_relaxed);
+    s->sequence.store(sequence+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s->size = uint32_t(buffer.size());
+    memcpy(reinterpret_cast<char*>(s)+sizeof(SlotHeader), buffer.data(), buffer.size());
+    s->sequence.store(sequence+2, std::memory_order_release);
+
+    uint64_t position = header->ringHead.load(std::memory_order_relaxed);
+    ringAt(file.data(), header, position)->store((position<<32) | uint32_t(index), std::memory_order_relaxed);
+    header->ringHead.store(position+1, std::memory_order_release);
+  }
+};
+
+//##################################################################################################
+CoreInterfaceSharedMemoryMirror::CoreInterfaceSharedMemoryMirror(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs):
+  d(new Private(coreInterface, codecs))
+{
+
+}
+
+//##################################################################################################
+CoreInterfaceSharedMemoryMirror::~CoreInterfaceSharedMemoryMirror()
+{
+  close();
+  delete d;
+}
+
+//##################################################################################################
+bool CoreInterfaceSharedMemoryMirror::open(const std::string& path, size_t slotCount, size_t payloadCapacity, size_t ringCapacity)
+{
+  close();
+
+  if(slotCount==0 || ringCapacity==0)
+    return false;
+
+  // Readers may still have the region mapped, so it is reinitialized in place and never shrunk,
+  // truncating it would fault any reader that touches the pages that were removed.
+  size_t slotStride = alignTo(sizeof(SlotHeader)+payloadCapacity, 64);
+  size_t size = slotsOffset() + slotCount*slotStride + ringCapacity*sizeof(RingEntry);
+  if(!d->file.open(path, MappedFile::Mode::ReadWrite, size))
+    return false;
+
+  // Readers of the old region see the new generation and report their reads as stale.
+  auto header = reinterpret_cast<RegionHeader*>(d->file.data());
+  uint32_t generation = 0;
+  if(memcmp(header->magic, regionMagic, sizeof(regionMagic))==0)
+    generation = header->generation.load(std::memory_order_relaxed)+1;
+
+  // Hide the region from new readers until it has been initialized.
+  memset(header->magic, 0, sizeof(regionMagic));
+  header->generation.store(generation, std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  d->header = new (d->file.data()) RegionHeader();
+  d->header->generation = generation;
+  d->header->slotCount = uint32_t(slotCount);
+  d->header->payloadCapacity = uint32_t(payloadCapacity);
+  d->header->ringCapacity = uint32_t(ringCapacity);
+  d->header->slotStride = uint32_t(slotStride);
+  d->header->usedSlots = 0;
+  d->header->ringHead = 0;
+
+  for(size_t i=0; i<slotCount; i++)
+    new (slotAt(d->file.data(), d->header, i)) SlotHeader();
+
+  for(size_t i=0; i<ringCapacity; i++)
+    new (ringAt(d->file.data(), d->header, i)) RingEntry(~uint64_t(0));
+
+  // Write the magic last so readers don't map a partially initialized region.
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(d->header->magic, regionMagic, sizeof(regionMagic));
+
+  d->slots.clear();
+  d->coreInterface->registerObserver(this);
+
+  for(const auto& typeID : d->channelTypes)
+    addChannelType(typeID);
+
+  return true;
+}
+
+//##################################################################################################
+void CoreInterfaceSharedMemoryMirror::close()
+{
+  if(!d->header)
+    return;
+
+  d->coreInterface->unregisterObserver(this);
+  d->header = nullptr;
+  d->file.close();
+}
+
+//##################################################################################################
+void CoreInterfaceSharedMemoryMirror::addChannelType(const tp_utils::StringID& typeID)
+{
+  if(!tpContains(d->channelTypes, typeID))
+    d->channelTypes.push_back(typeID);
+
+  const auto& channels = d->coreInterface->channels();
+  auto i = channels.find(typeID);
+  if(i==channels.end())
+    return;
+
+  for(const auto& j : i->second)
+    if(j.second.data())
+      d->write(j.second, j.second.data());
+}
+
+//##################################################################################################
+void CoreInterfaceSharedMemoryMirror::removeChannelType(const tp_utils::StringID& typeID)
+{
+  tpRemoveOne(d->channelTypes, typeID);
+}
+
+//##################################################################################################
+void CoreInterfaceSharedMemoryMirror::handleCreated(const CoreInterfaceHandle& handle)
+{
+  TP_UNUSED(handle);
+}
+
+//##################################################################################################
+void CoreInterfaceSharedMemoryMirror::channelDataSet(const CoreInterfaceHandle& handle, const CoreInterfaceData* data)
+{
+  d->write(handle, data);
+}
+
+//##################################################################################################
+struct CoreInterfaceSharedMemoryReader::Private
+{
+  TP_NONCOPYABLE(Private);
+  Private()=default;
+
+  MappedFile file;
+  RegionHeader* header{nullptr};
+
+  // The layout is copied when the region is opened, a mirror that reopens the region can change
+  // the header but the offsets used here must stay inside this mapping.
+  RegionHeader layout;
+  uint32_t generation{0};
+
+  //################################################################################################
+  bool isStale() const
+  {
+    return header->generation.load(std::memory_order_acquire)!=generation;
+  }
+
+  //################################################################################################
+  uint32_t usedSlots() const
+  {
+    return std::min(header->usedSlots.load(std::memory_order_acquire), layout.slotCount);
+  }
+};
+
+//##################################################################################################
+CoreInterfaceSharedMemoryReader::CoreInterfaceSharedMemoryReader():
+  d(new Private())
+{
+
+}
+
+//##################################################################################################
+CoreInterfaceSharedMemoryReader::~CoreInterfaceSharedMemoryReader()
+{
+  delete d;
+}
+
+//##################################################################################################
+bool CoreInterfaceSharedMemoryReader::open(const std::string& path)
+{
+  close();
+
+  if(!d->file.open(path, MappedFile::Mode::ReadOnly))
+    return false;
+
+  if(d->file.size()<sizeof(RegionHeader) || memcmp(d->file.data(), regionMagic, sizeof(regionMagic))!=0)
+  {
+    tpWarning() << "CoreInterfaceSharedMemoryReader not a shared memory region: " << path;
+    d->file.close();
+    return false;
+  }
+
+  d->header = reinterpret_cast<RegionHeader*>(d->file.data());
+  d->generation = d->header->generation.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  d->layout.slotCount = d->header->slotCount;
+  d->layout.payloadCapacity = d->header->payloadCapacity;
+  d->layout.ringCapacity = d->header->ringCapacity;
+  d->layout.slotStride = d->header->slotStride;
+
+  if(d->layout.ringCapacity==0 ||
+     d->layout.slotStride<sizeof(SlotHeader)+d->layout.payloadCapacity ||
+     regionSize(&d->layout)>d->file.size())
+  {
+    tpWarning() << "CoreInterfaceSharedMemoryReader region is truncated or being initialized: " << path;
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+//##################################################################################################
+void CoreInterfaceSharedMemoryReader::close()
+{
+  d->header = nullptr;
+  d->file.close();
+}
+
+//##################################################################################################
+int CoreInterfaceSharedMemoryReader::findSlot(const std::string& typeID, const std::string& nameID) const
+{
+  if(!d->header || d->isStale())
+    return -1;
+
+  uint32_t used = d->usedSlots();
+  for(uint32_t i=0; i<used; i++)
+  {
+    const SlotHeader* s = slotAt(d->file.data(), &d->layout, i);
+    if(typeID==std::string_view(s->typeID, strnlen(s->typeID, idCapacity)) &&
+       nameID==std::string_view(s->nameID, strnlen(s->nameID, idCapacity)))
+      return int(i);
+  }
+
+  return -1;
+}
+
+//##################################################################################################
+bool CoreInterfaceSharedMemoryReader::slotIDs(int slot, std::string& typeID, std::string& nameID) const
+{
+  if(!d->header || d->isStale() || slot<0 || uint32_t(slot)>=d->usedSlots())
+    return false;
+
+  const SlotHeader* s = slotAt(d->file.data(), &d->layout, size_t(slot));
+  typeID.assign(s->typeID, strnlen(s->typeID, idCapacity));
+  nameID.assign(s->nameID, strnlen(s->nameID, idCapacity));
+  return true;
+}
+
+//##################################################################################################
+CoreInterfaceSharedMemoryReader::ReadStatus CoreInterfaceSharedMemoryReader::read(int slot, void* buffer, size_t capacity, size_t& size, uint64_t* version) const
+{
+  size = 0;
+  if(!d->header)
+    return ReadStatus::NoData;
+
+  if(d->isStale())
+    return ReadStatus::Stale;
+
+  if(slot<0 || uint32_t(slot)>=d->usedSlots())
+    return ReadStatus::NoData;
+
+  SlotHeader* s = slotAt(d->file.data(), &d->layout, size_t(slot));
+  const char* payload = reinterpret_cast<const char*>(s)+sizeof(SlotHeader);
+
+  for(size_t attempt=0; attempt<readAttempts; attempt++)
+  {
+    if(attempt>=readSpins)
+      std::this_thread::yield();
+
+    uint32_t before = s->sequence.load(std::memory_order_acquire);
+    if(before&1)
+      continue;
+
+    // The size is only trusted once the sequence shows that it was not torn.
+    size_t slotSize = std::min(size_t(s->size), size_t(d->layout.payloadCapacity));
+    bool fits = slotSize<=capacity;
+    if(fits)
+      memcpy(buffer, payload, slotSize);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(s->sequence.load(std::memory_order_relaxed)!=before)
+      continue;
+
+    if(d->isStale())
+      return ReadStatus::Stale;
+
+    size = slotSize;
+    if(version)
+      *version = before/2;
+
+    if(before==0 || size==0)
+      return ReadStatus::NoData;
+
+    return fits?ReadStatus::Ok:ReadStatus::TooLarge;
+  }
+
+  return d->isStale()?ReadStatus::Stale:ReadStatus::Busy;
+}
+
+//##################################################################################################
+bool CoreInterfaceSharedMemoryReader::pollChanges(uint64_t& cursor, std::vector<int>& slots) const
+{
+  if(!d->header || d->isStale())
+    return false;
+
+  uint64_t head = d->header->ringHead.load(std::memory_order_acquire);
+  bool complete = true;
+
+  if(head-cursor>d->layout.ringCapacity)
+  {
+    cursor = head-d->layout.ringCapacity;
+    complete = false;
+  }
+
+  uint32_t used = d->usedSlots();
+  for(; cursor<head; cursor++)
+  {
+    uint64_t entry = ringAt(d->file.data(), &d->layout, cursor)->load(std::memory_order_relaxed);
+    if((entry>>32)!=(cursor&0xFFFFFFFF))
+    {
+      complete = false;
+      continue;
+    }
+
+    uint32_t slot = uint32_t(entry&0xFFFFFFFF);
+    if(slot<used)
+      slots.push_back(int(slot));
+  }
+
+  return complete;
+}
+
+}
@@ -0,0 +1,242 @@
+#include "tp_control/CoreInterfaceState.h"
+#include "tp_control/CoreInterfaceCodecs.h"
+
+#include "tp_utils/DebugUtils.h"
+#include "tp_utils/JSONUtils.h"
+
+#include <istream>
+#include <ostream>
+
+namespace tp_control
+{
+
+namespace
+{
+//##################################################################################################
+//! Returns the JSON for a channel, or false if its type is not saved.
+bool saveChannel(const CoreInterfaceCodecs* codecs, const CoreInterfaceHandle& handle, nlohmann::json& j)
+{
+  const CoreInterfaceCodec* codec = codecs->codec(handle.typeID());
+  if(!codec || !codec->saveState)
+    return false;
+
+  j = handle.saveState();
+  nlohmann::json data;
+  if(codecs->saveState(handle.typeID(), handle.data(), data))
+    j["data"] = std::move(data);
+  return true;
+}
+
+//##################################################################################################
+bool loadChannel(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs, const nlohmann::json& j)
+{
+  if(!j.is_object() || TPJSONString(j, "typeID").empty() || TPJSONString(j, "nameID").empty())
+    return false;
+
+  CoreInterfaceHandle handle;
+  handle.loadState(j, coreInterface);
+
+  auto i = j.find("data");
+  coreInterface->setChannelData(handle, (i!=j.end())?codecs->loadState(handle.typeID(), *i):nullptr);
+  return true;
+}
+
+//##################################################################################################
+//! Builds each element of the channels array as a small DOM and loads it once it is complete.
+class StateReader : public nlohmann::json_sax<nlohmann::json>
+{
+  CoreInterface* m_coreInterface;
+  const CoreInterfaceCodecs* m_codecs;
+
+  size_t m_depth{0};          // 1 inside the root object, 2 inside channels, 3 inside a channel.
+  std::string m_rootKey;      // The last key read in the root object.
+  bool m_inChannels{false};
+
+  nlohmann::json m_channel;
+  std::vector<nlohmann::json*> m_stack; // The open containers in m_channel, empty between channels.
+  std::string m_key;
+
+public:
+  size_t count{0};
+
+  //################################################################################################
+  StateReader(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs):
+    m_coreInterface(coreInterface),
+    m_codecs(codecs)
+  {
+
+  }
+
+  //################################################################################################
+  //! Add a value to the container at the top of the stack and return a pointer to it.
+  nlohmann::json* add(nlohmann::json&& value)
+  {
+    nlohmann::json* top = m_stack.back();
+    if(top->is_object())
+      return &((*top)[m_key] = std::move(value));
+
+    top->push_back(std::move(value));
+    return &top->back();
+  }
+
+  //################################################################################################
+  bool value(nlohmann::json&& value)
+  {
+    if(!m_stack.empty())
+      add(std::move(value));
+    return true;
+  }
+
+  //################################################################################################
+  bool startContainer(nlohmann::json&& container)
+  {
+    m_depth++;
+    if(!m_stack.empty())
+      m_stack.push_back(add(std::move(container)));
+    else if(m_inChannels && m_depth==3)
+    {
+      m_channel = std::move(container);
+      m_stack.push_back(&m_channel);
+    }
+    return true;
+  }
+
+  //################################################################################################
+  bool endContainer()
+  {
+    if(!m_stack.empty())
+    {
+      m_stack.pop_back();
+      if(m_stack.empty())
+      {
+        if(loadChannel(m_coreInterface, m_codecs, m_channel))
+          count++;
+        m_channel = nlohmann::json();
+      }
+    }
+    else if(m_inChannels && m_depth==2)
+      m_inChannels = false;
+
+    m_depth--;
+    return true;
+  }
+
+  //################################################################################################
+  bool null() override{return value(nullptr);}
+  bool boolean(bool val) override{return value(val);}
+  bool number_integer(number_integer_t val) override{return value(val);}
+  bool number_unsigned(number_unsigned_t val) override{return value(val);}
+  bool number_float(number_float_t val, const string_t&) override{return value(val);}
+  bool string(string_t& val) override{return value(std::move(val));}
+  bool binary(binary_t& val) override{return value(nlohmann::json::binary(std::move(val)));}
+
+  //################################################################################################
+  bool start_object(std::size_t) override
+  {
+    return startContainer(nlohmann::json::object());
+  }
+
+  //################################################################################################
+  bool key(string_t& val) override
+  {
+    if(!m_stack.empty())
+      m_key = std::move(val);
+    else if(m_depth==1)
+      m_rootKey = std::move(val);
+    return true;
+  }
+
+  //################################################################################################
+  bool end_object() override
+  {
+    return endContainer();
+  }
+
+  //################################################################################################
+  bool start_array(std::size_t) override
+  {
+    if(m_stack.empty() && m_depth==1 && m_rootKey=="channels")
+    {
+      m_depth++;
+      m_inChannels = true;
+      return true;
+    }
+
+    return startContainer(nlohmann::json::array());
+  }
+
+  //################################################################################################
+  bool end_array() override
+  {
+    return endContainer();
+  }
+
+  //################################################################################################
+  bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& e) override
+  {
+    tpWarning() << "loadCoreInterfaceState parse error at byte " << position << ": " << e.what();
+    return false;
+  }
+};
+}
+
+//##################################################################################################
+nlohmann::json saveCoreInterfaceState(const CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs)
+{
+  nlohmann::json channels = nlohmann::json::array();
+  nlohmann::json j;
+  for(const auto& type : coreInterface->channels())
+    for(const auto& channel : type.second)
+      if(saveChannel(codecs, channel.second, j))
+        channels.push_back(std::move(j));
+
+  nlohmann::json state;
+  state["channels"] = std::move(channels);
+  return state;
+}
+
+//##################################################################################################
+void saveCoreInterfaceState(const CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs, std::ostream& stream)
+{
+  stream << "{\"channels\":[";
+
+  bool first=true;
+  nlohmann::json j;
+  for(const auto& type : coreInterface->channels())
+  {
+    for(const auto& channel : type.second)
+    {
+      if(!saveChannel(codecs, channel.second, j))
+        continue;
+
+      if(!first)
+        stream << ',';
+      first = false;
+      stream << j.dump();
+    }
+  }
+
+  stream << "]}";
+}
+
+//##################################################################################################
+size_t loadCoreInterfaceState(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs, const nlohmann::json& j)
+{
+  size_t count=0;
+  auto i = j.find("channels");
+  if(i!=j.end() && i->is_array())
+    for(const auto& channel : *i)
+      if(loadChannel(coreInterface, codecs, channel))
+        count++;
+  return count;
+}
+
+//##################################################################################################
+size_t loadCoreInterfaceState(CoreInterface* coreInterface, const CoreInterfaceCodecs* codecs, std::istream& stream)
+{
+  StateReader reader(coreInterface, codecs);
+  nlohmann::json::sax_parse(stream, &reader);
+  return reader.count;
+}
+
+}
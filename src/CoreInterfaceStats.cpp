@@ -0,0 +1,150 @@
+#include "tp_control/CoreInterfaceStats.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace tp_control
+{
+
+//##################################################################################################
+bool instrumentationEnabled()
+{
+#ifdef TP_CONTROL_INSTRUMENTATION
+  return true;
+#else
+  return false;
+#endif
+}
+
+//##################################################################################################
+void LatencyHistogram::add(int64_t ns)
+{
+  size_t bucket=0;
+  for(uint64_t v=uint64_t(std::max(ns, int64_t(1)))>>1; v && bucket<(bucketCount-1); v>>=1)
+    bucket++;
+
+  buckets[bucket]++;
+  count++;
+  totalNS += ns;
+  maxNS = std::max(maxNS, ns);
+}
+
+//##################################################################################################
+int64_t LatencyHistogram::percentileNS(double fraction) const
+{
+  if(count==0)
+    return 0;
+
+  uint64_t target = uint64_t(double(count)*fraction);
+  uint64_t seen=0;
+  for(size_t b=0; b<bucketCount; b++)
+  {
+    seen += buckets[b];
+    if(seen>target || seen==count)
+      return std::min(int64_t(1)<<(b+1), maxNS);
+  }
+
+  return maxNS;
+}
+
+//##################################################################################################
+double LatencyHistogram::meanNS() const
+{
+  return count?(double(totalNS)/double(count)):0.0;
+}
+
+//##################################################################################################
+nlohmann::json LatencyHistogram::saveState() const
+{
+  nlohmann::json j;
+  j["count"] = count;
+  j["totalNS"] = totalNS;
+  j["maxNS"] = maxNS;
+  j["meanNS"] = meanNS();
+  j["p50NS"] = percentileNS(0.5);
+  j["p99NS"] = percentileNS(0.99);
+
+  // Trim empty buckets off the end to keep the output small.
+  size_t used=bucketCount;
+  while(used>0 && buckets[used-1]==0)
+    used--;
+  j["log2Buckets"] = std::vector<uint64_t>(buckets.begin(), buckets.begin()+long(used));
+  return j;
+}
+
+//##################################################################################################
+nlohmann::json ChannelStats::saveState() const
+{
+  nlohmann::json j;
+  j["setCount"] = setCount;
+  j["suppressedCount"] = suppressedCount;
+  j["dispatch"] = dispatch.saveState();
+  return j;
+}
+
+//##################################################################################################
+nlohmann::json SignalStats::saveState() const
+{
+  nlohmann::json j;
+  j["sendCount"] = sendCount;
+  j["callbackInvocations"] = callbackInvocations;
+  j["dispatch"] = dispatch.saveState();
+  return j;
+}
+
+//##################################################################################################
+nlohmann::json CallbackStats::saveState() const
+{
+  nlohmann::json j;
+  j["tag"] = tag;
+  j["invocations"] = invocations;
+  j["latency"] = latency.saveState();
+  return j;
+}
+
+//##################################################################################################
+void CoreInterfaceStats::clear()
+{
+  channelTypes.clear();
+  channels.clear();
+  signals.clear();
+  callbacks.clear();
+}
+
+//##################################################################################################
+nlohmann::json CoreInterfaceStats::saveState() const
+{
+  nlohmann::json j;
+
+  j["instrumentationEnabled"] = instrumentationEnabled();
+
+  j["channelTypes"] = nlohmann::json::object();
+  for(const auto& i : channelTypes)
+    j["channelTypes"][i.first.toString()] = i.second.saveState();
+
+  j["channels"] = nlohmann::json::object();
+  for(const auto& i : channels)
+  {
+    nlohmann::json& type = j["channels"][i.first.toString()];
+    for(const auto& n : i.second)
+      type[n.first.toString()] = n.second.saveState();
+  }
+
+  j["signals"] = nlohmann::json::object();
+  for(const auto& i : signals)
+    j["signals"][i.first.toString()] = i.second.saveState();
+
+  j["callbacks"] = nlohmann::json::array();
+  for(const auto& i : callbacks)
+  {
+    std::ostringstream ss;
+    ss << i.first;
+    nlohmann::json c = i.second.saveState();
+    c["callback"] = ss.str();
+    j["callbacks"].push_back(std::move(c));
+  }
+
+  return j;
+}
+
+}
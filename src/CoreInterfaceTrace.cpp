@@ -0,0 +1,241 @@
+#include "tp_control/CoreInterfaceTrace.h"
+#include "tp_control/CoreInterfaceStats.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+namespace tp_control
+{
+
+namespace
+{
+//##################################################################################################
+struct TraceEvent
+{
+  int64_t timestampNS{0};
+  const void* callback{nullptr};
+  tp_utils::StringID typeID;
+  tp_utils::StringID nameID;
+  DispatchKind kind{DispatchKind::Signal};
+  char phase{'B'};
+};
+
+//##################################################################################################
+// Each buffer is only written by its own thread, events below count are never modified again so the
+// exporter can read them while the owning thread carries on appending.
+struct ThreadBuffer
+{
+  std::vector<TraceEvent> events;
+  std::atomic<size_t> count{0};
+  size_t tid{0};
+  uint64_t generation{0};
+};
+
+//##################################################################################################
+struct Registry
+{
+  std::mutex mutex;
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  std::atomic<bool> tracing{false};
+  std::atomic<uint64_t> generation{0};
+  std::atomic<size_t> dropped{0};
+  size_t capacity{0};
+  size_t nextTID{1};
+  int64_t startNS{0};
+};
+
+//##################################################################################################
+Registry& registry()
+{
+  static Registry registry;
+  return registry;
+}
+
+thread_local std::shared_ptr<ThreadBuffer> threadBuffer;
+
+//##################################################################################################
+int64_t nowNS()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//##################################################################################################
+ThreadBuffer* buffer()
+{
+  Registry& r = registry();
+  uint64_t generation = r.generation.load(std::memory_order_acquire);
+  if(!threadBuffer || threadBuffer->generation!=generation)
+  {
+    std::lock_guard<std::mutex> lock(r.mutex);
+    threadBuffer = std::make_shared<ThreadBuffer>();
+    threadBuffer->events.resize(r.capacity);
+    threadBuffer->tid = r.nextTID++;
+    threadBuffer->generation = generation;
+    r.buffers.push_back(threadBuffer);
+  }
+
+  return threadBuffer.get();
+}
+
+//##################################################################################################
+void record(char phase, DispatchKind kind, const void* callback, const tp_utils::StringID& typeID, const tp_utils::StringID& nameID)
+{
+  Registry& r = registry();
+  if(!r.tracing.load(std::memory_order_relaxed))
+    return;
+
+  ThreadBuffer* b = buffer();
+  size_t i = b->count.load(std::memory_order_relaxed);
+  if(i>=b->events.size())
+  {
+    r.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  TraceEvent& e = b->events[i];
+  e.timestampNS = nowNS();
+  e.callback = callback;
+  e.typeID = typeID;
+  e.nameID = nameID;
+  e.kind = kind;
+  e.phase = phase;
+  b->count.store(i+1, std::memory_order_release);
+}
+
+//##################################################################################################
+const char* kindName(DispatchKind kind)
+{
+  switch(kind)
+  {
+  case DispatchKind::ChannelList: return "channelList";
+  case DispatchKind::Channel:     return "channel";
+  case DispatchKind::Signal:      return "signal";
+  }
+  return "unknown";
+}
+
+//##################################################################################################
+const char* dispatchName(DispatchKind kind)
+{
+  switch(kind)
+  {
+  case DispatchKind::ChannelList: return "handle";
+  case DispatchKind::Channel:     return "setChannelData";
+  case DispatchKind::Signal:      return "sendSignal";
+  }
+  return "unknown";
+}
+}
+
+//##################################################################################################
+void CoreInterfaceTrace::start(size_t eventsPerThread)
+{
+  Registry& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  r.tracing = false;
+  r.buffers.clear();
+  r.capacity = eventsPerThread;
+  r.dropped = 0;
+  r.nextTID = 1;
+  r.startNS = nowNS();
+  r.generation.fetch_add(1, std::memory_order_release);
+  r.tracing = instrumentationEnabled();
+}
+
+//##################################################################################################
+void CoreInterfaceTrace::stop()
+{
+  registry().tracing = false;
+}
+
+//##################################################################################################
+bool CoreInterfaceTrace::isTracing()
+{
+  return registry().tracing;
+}
+
+//##################################################################################################
+size_t CoreInterfaceTrace::droppedEvents()
+{
+  return registry().dropped;
+}
+
+//##################################################################################################
+nlohmann::json CoreInterfaceTrace::saveChromeTrace(const CoreInterface* coreInterface)
+{
+  Registry& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+
+  nlohmann::json traceEvents = nlohmann::json::array();
+  for(const auto& b : r.buffers)
+  {
+    size_t count = b->count.load(std::memory_order_acquire);
+    for(size_t i=0; i<count; i++)
+    {
+      const TraceEvent& e = b->events[i];
+
+      nlohmann::json j;
+      j["ph"] = std::string(1, e.phase);
+      j["cat"] = kindName(e.kind);
+      j["ts"] = double(e.timestampNS - r.startNS) / 1000.0;
+      j["pid"] = 1;
+      j["tid"] = b->tid;
+
+      if(e.callback)
+      {
+        std::ostringstream ss;
+        ss << e.callback;
+        std::string tag = coreInterface?coreInterface->callbackTag(e.callback):std::string();
+        j["name"] = tag.empty()?ss.str():tag;
+        j["args"]["callback"] = ss.str();
+      }
+      else
+        j["name"] = dispatchName(e.kind);
+
+      if(e.phase=='B')
+      {
+        if(e.typeID.isValid())
+          j["args"]["typeID"] = e.typeID.toString();
+        if(e.nameID.isValid())
+          j["args"]["nameID"] = e.nameID.toString();
+      }
+
+      traceEvents.push_back(std::move(j));
+    }
+  }
+
+  nlohmann::json j;
+  j["traceEvents"] = std::move(traceEvents);
+  j["displayTimeUnit"] = "ns";
+  j["otherData"]["droppedEvents"] = r.dropped.load();
+  return j;
+}
+
+//##################################################################################################
+bool CoreInterfaceTrace::writeChromeTrace(const std::string& path, const CoreInterface* coreInterface)
+{
+  std::ofstream out(path);
+  if(!out)
+    return false;
+
+  out << saveChromeTrace(coreInterface).dump();
+  return bool(out);
+}
+
+//##################################################################################################
+void CoreInterfaceTrace::begin(DispatchKind kind, const void* callback, const tp_utils::StringID& typeID, const tp_utils::StringID& nameID)
+{
+  record('B', kind, callback, typeID, nameID);
+}
+
+//##################################################################################################
+void CoreInterfaceTrace::end(DispatchKind kind, const void* callback, const tp_utils::StringID& typeID, const tp_utils::StringID& nameID)
+{
+  record('E', kind, callback, typeID, nameID);
+}
+
+}
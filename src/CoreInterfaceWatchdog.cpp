@@ -0,0 +1,172 @@
+#include "tp_control/CoreInterfaceWatchdog.h"
+
+#include "tp_utils/DebugUtils.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace tp_control
+{
+
+//##################################################################################################
+nlohmann::json SlowCallbackReport::saveState() const
+{
+  std::ostringstream ss;
+  ss << callback;
+
+  nlohmann::json j;
+  switch(kind)
+  {
+  case DispatchKind::ChannelList: j["kind"] = "channelList"; break;
+  case DispatchKind::Channel:     j["kind"] = "channel";     break;
+  case DispatchKind::Signal:      j["kind"] = "signal";      break;
+  }
+  j["typeID"] = typeID.toString();
+  if(nameID.isValid())
+    j["nameID"] = nameID.toString();
+  j["callback"] = ss.str();
+  j["tag"] = tag;
+  j["durationNS"] = durationNS;
+  j["budgetNS"] = budgetNS;
+  j["offenceCount"] = offenceCount;
+  return j;
+}
+
+//##################################################################################################
+struct CoreInterfaceWatchdog::Private
+{
+  TP_NONCOPYABLE(Private);
+
+  CoreInterface* coreInterface;
+
+  std::unordered_map<tp_utils::StringID, int64_t> signalBudgets;
+  std::unordered_map<tp_utils::StringID, int64_t> channelBudgets;
+  int64_t defaultBudget{0};
+
+  SlowCallbackHandler handler;
+
+  // Offenders indexed by callback then typeID.
+  std::unordered_map<const void*, std::unordered_map<tp_utils::StringID, SlowCallbackReport>> offenders;
+
+  //################################################################################################
+  Private(CoreInterface* coreInterface_):
+    coreInterface(coreInterface_)
+  {
+
+  }
+
+  //################################################################################################
+  static void setBudget(std::unordered_map<tp_utils::StringID, int64_t>& budgets, const tp_utils::StringID& typeID, int64_t budgetNS)
+  {
+    if(budgetNS>0)
+      budgets[typeID] = budgetNS;
+    else
+      budgets.erase(typeID);
+  }
+};
+
+//##################################################################################################
+CoreInterfaceWatchdog::CoreInterfaceWatchdog(CoreInterface* coreInterface):
+  d(new Private(coreInterface))
+{
+  d->coreInterface->setWatchdog(this);
+}
+
+//##################################################################################################
+CoreInterfaceWatchdog::~CoreInterfaceWatchdog()
+{
+  d->coreInterface->setWatchdog(nullptr);
+  delete d;
+}
+
+//##################################################################################################
+void CoreInterfaceWatchdog::setSignalBudget(const tp_utils::StringID& typeID, int64_t budgetNS)
+{
+  Private::setBudget(d->signalBudgets, typeID, budgetNS);
+}
+
+//##################################################################################################
+void CoreInterfaceWatchdog::setChannelBudget(const tp_utils::StringID& typeID, int64_t budgetNS)
+{
+  Private::setBudget(d->channelBudgets, typeID, budgetNS);
+}
+
+//##################################################################################################
+void CoreInterfaceWatchdog::setDefaultBudget(int64_t budgetNS)
+{
+  d->defaultBudget = std::max(budgetNS, int64_t(0));
+}
+
+//##################################################################################################
+void CoreInterfaceWatchdog::setHandler(const SlowCallbackHandler& handler)
+{
+  d->handler = handler;
+}
+
+//##################################################################################################
+std::vector<SlowCallbackReport> CoreInterfaceWatchdog::offenders() const
+{
+  std::vector<SlowCallbackReport> offenders;
+  for(const auto& i : d->offenders)
+    for(const auto& j : i.second)
+      offenders.push_back(j.second);
+
+  std::sort(offenders.begin(), offenders.end(), [](const SlowCallbackReport& a, const SlowCallbackReport& b)
+  {
+    return a.offenceCount>b.offenceCount;
+  });
+
+  return offenders;
+}
+
+//##################################################################################################
+void CoreInterfaceWatchdog::clearOffenders()
+{
+  d->offenders.clear();
+}
+
+//##################################################################################################
+nlohmann::json CoreInterfaceWatchdog::saveState() const
+{
+  nlohmann::json j = nlohmann::json::array();
+  for(const auto& report : offenders())
+    j.push_back(report.saveState());
+  return j;
+}
+
+//##################################################################################################
+int64_t CoreInterfaceWatchdog::budgetNS(DispatchKind kind, const tp_utils::StringID& typeID) const
+{
+  const auto& budgets = (kind==DispatchKind::Signal)?d->signalBudgets:d->channelBudgets;
+  if(budgets.empty())
+    return d->defaultBudget;
+
+  auto i = budgets.find(typeID);
+  return (i!=budgets.end())?i->second:d->defaultBudget;
+}
+
+//##################################################################################################
+void CoreInterfaceWatchdog::callbackExceededBudget(DispatchKind kind,
+                                                   const void* callback,
+                                                   const tp_utils::StringID& typeID,
+                                                   const tp_utils::StringID& nameID,
+                                                   int64_t durationNS,
+                                                   int64_t budgetNS)
+{
+  SlowCallbackReport& report = d->offenders[callback][typeID];
+  report.kind = kind;
+  report.typeID = typeID;
+  report.nameID = nameID;
+  report.callback = callback;
+  report.tag = d->coreInterface->callbackTag(callback);
+  report.durationNS = durationNS;
+  report.budgetNS = budgetNS;
+  report.offenceCount++;
+
+  if(d->handler)
+    d->handler(report);
+  else
+    tpWarning() << "Slow callback: " << report.saveState().dump();
+}
+
+}
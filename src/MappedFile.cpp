@@ -0,0 +1,269 @@
+#include "tp_control/MappedFile.h"
+
+#include "tp_utils/DebugUtils.h"
+
+#if defined(_WIN32) || defined(__EMSCRIPTEN__)
+#define TP_CONTROL_NO_MMAP
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace tp_control
+{
+
+//##################################################################################################
+struct MappedFile::Private
+{
+  TP_NONCOPYABLE(Private);
+  Private()=default;
+
+  std::string path;
+  Mode mode{Mode::ReadOnly};
+  int fd{-1};
+  char* data{nullptr};
+  size_t size{0};
+
+  //################################################################################################
+  void unmap()
+  {
+#ifndef TP_CONTROL_NO_MMAP
+    if(data)
+      munmap(data, size);
+#endif
+    data = nullptr;
+  }
+
+  //################################################################################################
+  bool map()
+  {
+#ifdef TP_CONTROL_NO_MMAP
+    return false;
+#else
+    if(size==0)
+      return true;
+
+    int prot = (mode==Mode::ReadOnly)?PROT_READ:(PROT_READ|PROT_WRITE);
+    void* ptr = mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+    if(ptr==MAP_FAILED)
+    {
+      tpWarning() << "MappedFile failed to map: " << path;
+      data = nullptr;
+      return false;
+    }
+
+    data = static_cast<char*>(ptr);
+    return true;
+#endif
+  }
+};
+
+//##################################################################################################
+MappedFile::MappedFile():
+  d(new Private())
+{
+
+}
+
+//##################################################################################################
+MappedFile::~MappedFile()
+{
+  close();
+  delete d;
+}
+
+//##################################################################################################
+bool MappedFile::open(const std::string& path, Mode mode, size_t size)
+{
+  close();
+
+  d->path = path;
+  d->mode = mode;
+
+#ifdef TP_CONTROL_NO_MMAP
+  TP_UNUSED(size);
+  tpWarning() << "MappedFile is not supported on this platform.";
+  return false;
+#else
+  int flags = O_RDONLY;
+  if(mode==Mode::ReadWrite)
+    flags = O_RDWR | O_CREAT;
+  else if(mode==Mode::Truncate)
+    flags = O_RDWR | O_CREAT | O_TRUNC;
+
+  d->fd = ::open(path.c_str(), flags, 0644);
+  if(d->fd<0)
+  {
+    tpWarning() << "MappedFile failed to open: " << path;
+    return false;
+  }
+
+  struct stat st;
+  if(fstat(d->fd, &st)!=0)
+  {
+    close();
+    return false;
+  }
+
+  d->size = size_t(st.st_size);
+  if(mode!=Mode::ReadOnly && d->size<size)
+  {
+    if(ftruncate(d->fd, off_t(size))!=0)
+    {
+      tpWarning() << "MappedFile failed to resize: " << path;
+      close();
+      return false;
+    }
+    d->size = size;
+  }
+
+  if(!d->map())
+  {
+    close();
+    return false;
+  }
+
+  return true;
+#endif
+}
+
+//##################################################################################################
+bool MappedFile::resize(size_t size)
+{
+#ifdef TP_CONTROL_NO_MMAP
+  TP_UNUSED(size);
+  return false;
+#else
+  if(d->fd<0 || d->mode==Mode::ReadOnly)
+    return false;
+
+  d->unmap();
+  if(ftruncate(d->fd, off_t(size))!=0)
+  {
+    tpWarning() << "MappedFile failed to resize: " << d->path;
+    d->map();
+    return false;
+  }
+
+  d->size = size;
+  return d->map();
+#endif
+}
+
+//##################################################################################################
+bool MappedFile::sync()
+{
+#ifdef TP_CONTROL_NO_MMAP
+  return false;
+#else
+  if(d->fd<0 || d->mode==Mode::ReadOnly)
+    return false;
+
+  // msync writes the dirty pages, fsync also writes the file size and other metadata.
+  if((d->data && msync(d->data, d->size, MS_SYNC)!=0) || fsync(d->fd)!=0)
+  {
+    tpWarning() << "MappedFile failed to sync: " << d->path;
+    return false;
+  }
+
+  return true;
+#endif
+}
+
+//##################################################################################################
+bool MappedFile::syncDirectory(const std::string& path)
+{
+#ifdef TP_CONTROL_NO_MMAP
+  TP_UNUSED(path);
+  return false;
+#else
+  auto slash = path.find_last_of('/');
+  std::string directory = (slash==std::string::npos)?std::string("."):path.substr(0, slash+1);
+
+  int fd = ::open(directory.c_str(), O_RDONLY);
+  if(fd<0)
+  {
+    tpWarning() << "MappedFile failed to open directory: " << directory;
+    return false;
+  }
+
+  bool ok = (fsync(fd)==0);
+  ::close(fd);
+
+  if(!ok)
+    tpWarning() << "MappedFile failed to sync directory: " << directory;
+  return ok;
+#endif
+}
+
+//##################################################################################################
+void MappedFile::close(size_t finalSize)
+{
+  d->unmap();
+
+#ifndef TP_CONTROL_NO_MMAP
+  if(d->fd>=0)
+  {
+    if(finalSize!=0 && d->mode!=Mode::ReadOnly)
+      if(ftruncate(d->fd, off_t(finalSize))!=0)
+        tpWarning() << "MappedFile failed to truncate: " << d->path;
+    ::close(d->fd);
+  }
+#else
+  TP_UNUSED(finalSize);
+#endif
+
+  d->fd = -1;
+  d->size = 0;
+}
+
+//##################################################################################################
+bool MappedFile::isOpen() const
+{
+  return d->fd>=0;
+}
+
+//##################################################################################################
+char* MappedFile::data() const
+{
+  return d->data;
+}
+
+//##################################################################################################
+size_t MappedFile::size() const
+{
+  return d->size;
+}
+
+//##################################################################################################
+const std::string& MappedFile::path() const
+{
+  return d->path;
+}
+
+//##################################################################################################
+bool MappedFile::identity(Identity& identity) const
+{
+#ifdef TP_CONTROL_NO_MMAP
+  TP_UNUSED(identity);
+  return false;
+#else
+  struct stat st;
+  if(d->fd<0 || fstat(d->fd, &st)!=0)
+    return false;
+
+  identity.device = uint64_t(st.st_dev);
+  identity.inode = uint64_t(st.st_ino);
+#ifdef __APPLE__
+  identity.modifiedNS = int64_t(st.st_mtimespec.tv_sec)*1000000000 + int64_t(st.st_mtimespec.tv_nsec);
+#else
+  identity.modifiedNS = int64_t(st.st_mtim.tv_sec)*1000000000 + int64_t(st.st_mtim.tv_nsec);
+#endif
+  identity.size = uint64_t(st.st_size);
+  return true;
+#endif
+}
+
+}
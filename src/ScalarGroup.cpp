@@ -0,0 +1,256 @@
+#include "tp_control/ScalarGroup.h"
+#include "tp_control/CoreInterfaceHistory.h"
+
+#include "tp_utils/DebugUtils.h"
+
+#include <cstring>
+#include <unordered_map>
+
+namespace tp_control
+{
+
+namespace
+{
+//##################################################################################################
+inline uint64_t bits(double value)
+{
+  uint64_t b;
+  memcpy(&b, &value, sizeof(b));
+  return b;
+}
+}
+
+//##################################################################################################
+struct ScalarGroup::Private
+{
+  TP_NONCOPYABLE(Private);
+
+  std::vector<tp_utils::StringID> nameIDs;
+  std::unordered_map<tp_utils::StringID, size_t> indexes;
+
+  std::vector<double> values;
+  std::vector<uint64_t> versions;
+  std::vector<int64_t> timestamps;
+
+  // Scratch space reused between updates.
+  std::vector<uint8_t> changedFlags;
+  std::vector<double> previousValues;
+  std::vector<size_t> touched;
+  std::vector<size_t> changed;
+
+  std::vector<const ScalarGroupChangedCallback*> callbacks;
+
+  //################################################################################################
+  Private()=default;
+
+  //################################################################################################
+  void markChanged(size_t index, int64_t now)
+  {
+    versions[index]++;
+    timestamps[index] = now;
+    changed.push_back(index);
+  }
+
+  //################################################################################################
+  //! Call the callbacks with the changed indices, this is safe to re-enter from a callback.
+  void notify(ScalarGroup* q)
+  {
+    if(changed.empty())
+      return;
+
+    std::vector<size_t> c;
+    c.swap(changed);
+
+    for(const auto& callback : callbacks)
+      (*callback)(*q, c);
+
+    c.clear();
+    if(c.capacity()>changed.capacity())
+      changed.swap(c);
+  }
+};
+
+//##################################################################################################
+ScalarGroup::ScalarGroup():
+  d(new Private())
+{
+
+}
+
+//##################################################################################################
+ScalarGroup::~ScalarGroup()
+{
+  delete d;
+}
+
+//##################################################################################################
+size_t ScalarGroup::addScalar(const tp_utils::StringID& nameID, double value)
+{
+  auto i = d->indexes.find(nameID);
+  if(i!=d->indexes.end())
+    return i->second;
+
+  size_t index = d->nameIDs.size();
+  d->indexes[nameID] = index;
+  d->nameIDs.push_back(nameID);
+  d->values.push_back(value);
+  d->versions.push_back(0);
+  d->timestamps.push_back(CoreInterfaceHistory::nowNS());
+  d->changedFlags.push_back(0);
+  d->previousValues.push_back(value);
+  return index;
+}
+
+//##################################################################################################
+size_t ScalarGroup::indexOf(const tp_utils::StringID& nameID) const
+{
+  auto i = d->indexes.find(nameID);
+  return (i!=d->indexes.end())?i->second:npos;
+}
+
+//##################################################################################################
+size_t ScalarGroup::size() const
+{
+  return d->values.size();
+}
+
+//##################################################################################################
+const tp_utils::StringID& ScalarGroup::nameID(size_t index) const
+{
+  return d->nameIDs.at(index);
+}
+
+//##################################################################################################
+double ScalarGroup::value(size_t index) const
+{
+  return d->values.at(index);
+}
+
+//##################################################################################################
+const double* ScalarGroup::values() const
+{
+  return d->values.data();
+}
+
+//##################################################################################################
+const uint64_t* ScalarGroup::versions() const
+{
+  return d->versions.data();
+}
+
+//##################################################################################################
+const int64_t* ScalarGroup::timestamps() const
+{
+  return d->timestamps.data();
+}
+
+//##################################################################################################
+size_t ScalarGroup::setBulk(const size_t* indices, const double* values, size_t count)
+{
+  size_t size = d->values.size();
+  double* current = d->values.data();
+  double* previous = d->previousValues.data();
+  uint8_t* flags = d->changedFlags.data();
+
+  // Remember the value before the batch the first time an index is set.
+  for(size_t i=0; i<count; i++)
+  {
+    size_t index = indices[i];
+    if(index>=size)
+    {
+      tpWarning() << "ScalarGroup::setBulk index out of range: " << index;
+      continue;
+    }
+
+    if(!flags[index])
+    {
+      flags[index] = 1;
+      previous[index] = current[index];
+      d->touched.push_back(index);
+    }
+
+    current[index] = values[i];
+  }
+
+  // An index that was set more than once may have ended where it started.
+  int64_t now = CoreInterfaceHistory::nowNS();
+  for(size_t index : d->touched)
+  {
+    flags[index] = 0;
+    if(bits(current[index])!=bits(previous[index]))
+      d->markChanged(index, now);
+  }
+  d->touched.clear();
+
+  size_t changedCount = d->changed.size();
+  d->notify(this);
+  return changedCount;
+}
+
+//##################################################################################################
+size_t ScalarGroup::setRange(size_t first, const double* values, size_t count)
+{
+  size_t size = d->values.size();
+  if(first>size || count>size-first)
+  {
+    tpWarning() << "ScalarGroup::setRange range out of bounds: " << first << "+" << count;
+    return 0;
+  }
+
+  double* current = d->values.data()+first;
+  uint8_t* flags = d->changedFlags.data()+first;
+
+  // Compare and copy in a single branch free pass so that it vectorizes.
+  for(size_t i=0; i<count; i++)
+  {
+    flags[i] = uint8_t(bits(current[i])!=bits(values[i]));
+    current[i] = values[i];
+  }
+
+  // Skip unchanged runs 8 flags at a time, then collect the changed indices.
+  int64_t now = CoreInterfaceHistory::nowNS();
+  size_t i=0;
+  for(; i+8<=count; i+=8)
+  {
+    uint64_t block;
+    memcpy(&block, flags+i, sizeof(block));
+    if(!block)
+      continue;
+
+    for(size_t j=i; j<i+8; j++)
+    {
+      if(flags[j])
+      {
+        flags[j] = 0;
+        d->markChanged(first+j, now);
+      }
+    }
+  }
+
+  for(; i<count; i++)
+  {
+    if(flags[i])
+    {
+      flags[i] = 0;
+      d->markChanged(first+i, now);
+    }
+  }
+
+  size_t changedCount = d->changed.size();
+  d->notify(this);
+  return changedCount;
+}
+
+//##################################################################################################
+void ScalarGroup::registerCallback(const ScalarGroupChangedCallback* callback)
+{
+  d->callbacks.push_back(callback);
+}
+
+//##################################################################################################
+void ScalarGroup::unregisterCallback(const ScalarGroupChangedCallback* callback)
+{
+  tpRemoveOne(d->callbacks, callback);
+}
+
+}
@@ -0,0 +1,424 @@
+#include "tp_control/TimerWheel.h"
+
+#include "tp_utils/DebugUtils.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace tp_control
+{
+
+namespace
+{
+constexpr size_t levelBits  = 8;
+constexpr size_t levelCount = 4;
+constexpr size_t slotCount  = size_t(1)<<levelBits;
+constexpr uint64_t slotMask = slotCount-1;
+constexpr uint64_t maxDelta = (uint64_t(1)<<(levelBits*levelCount))-1;
+constexpr size_t wordCount  = slotCount/64;
+
+constexpr uint32_t noEntry = std::numeric_limits<uint32_t>::max();
+constexpr uint8_t dueLevel = levelCount;    //!< The entry is in the due list.
+constexpr uint8_t noLevel  = levelCount+1;  //!< The entry is not in a list, it is being fired.
+
+//##################################################################################################
+//! A doubly linked list of entries, linked through Entry::prev and Entry::next.
+struct Slot
+{
+  uint32_t head{noEntry};
+  uint32_t tail{noEntry};
+};
+
+//##################################################################################################
+struct Entry
+{
+  uint32_t generation{0};
+  bool active{false};
+  uint8_t level{noLevel};
+  uint8_t index{0};
+  uint32_t prev{noEntry};
+  uint32_t next{noEntry};
+  uint64_t sequence{0}; //!< The order the timer was added in, timers due in the same tick fire in this order.
+  uint64_t deadlineTick{0};
+  uint64_t periodTicks{0};
+  std::function<void()> callback;
+};
+
+//##################################################################################################
+//! IDs hold the generation of the entry so that an ID is not mistaken for a later timer.
+inline uint64_t makeID(uint32_t e, uint32_t generation)
+{
+  return (uint64_t(generation)<<32) | (uint64_t(e)+1);
+}
+}
+
+//##################################################################################################
+struct TimerWheel::Private
+{
+  TP_NONCOPYABLE(Private);
+
+  int64_t startNS;
+  int64_t resolutionNS;
+  uint64_t currentTick{0};
+  uint64_t targetTick{0}; //!< The tick that the current advance() is stepping to.
+  uint64_t nextSequence{0};
+  size_t activeCount{0};
+
+  std::vector<Entry> entries;
+  std::vector<uint32_t> freeEntries;
+
+  Slot slots[levelCount][slotCount];
+  uint64_t occupied[levelCount][wordCount]{}; //!< A bit for each slot that holds entries.
+
+  // Timers that were added with a deadline that has already passed.
+  Slot due;
+
+  // Reused between ticks to collect the entries that are fired together.
+  std::vector<uint64_t> batch;
+
+  //################################################################################################
+  Private(int64_t startNS_, int64_t resolutionNS_):
+    startNS(startNS_),
+    resolutionNS(resolutionNS_>0?resolutionNS_:1)
+  {
+
+  }
+
+  //################################################################################################
+  //! The first tick at or after a time.
+  uint64_t tickAtOrAfter(int64_t ns) const
+  {
+    return (ns<=startNS)?0:uint64_t((ns-startNS+resolutionNS-1)/resolutionNS);
+  }
+
+  //################################################################################################
+  //! Returns the entry for an ID or nullptr if the timer has fired or been cancelled.
+  Entry* find(uint64_t id, uint32_t& e)
+  {
+    if(!(id&0xFFFFFFFFu))
+      return nullptr;
+
+    e = uint32_t(id&0xFFFFFFFFu)-1;
+    if(e>=entries.size())
+      return nullptr;
+
+    Entry& entry = entries[e];
+    return (entry.active && entry.generation==uint32_t(id>>32))?&entry:nullptr;
+  }
+
+  //################################################################################################
+  Slot& slotFor(const Entry& entry)
+  {
+    return (entry.level==dueLevel)?due:slots[entry.level][entry.index];
+  }
+
+  //################################################################################################
+  void link(uint32_t e, uint8_t level, uint8_t index)
+  {
+    Entry& entry = entries[e];
+    entry.level = level;
+    entry.index = index;
+    entry.next = noEntry;
+
+    Slot& slot = slotFor(entry);
+    entry.prev = slot.tail;
+    if(slot.tail==noEntry)
+      slot.head = e;
+    else
+      entries[slot.tail].next = e;
+    slot.tail = e;
+
+    if(level<levelCount)
+      occupied[level][index>>6] |= uint64_t(1)<<(index&63);
+  }
+
+  //################################################################################################
+  void unlink(uint32_t e)
+  {
+    Entry& entry = entries[e];
+    if(entry.level==noLevel)
+      return;
+
+    Slot& slot = slotFor(entry);
+    if(entry.prev==noEntry)
+      slot.head = entry.next;
+    else
+      entries[entry.prev].next = entry.next;
+
+    if(entry.next==noEntry)
+      slot.tail = entry.prev;
+    else
+      entries[entry.next].prev = entry.prev;
+
+    if(slot.head==noEntry && entry.level<levelCount)
+      occupied[entry.level][entry.index>>6] &= ~(uint64_t(1)<<(entry.index&63));
+
+    entry.level = noLevel;
+    entry.prev = noEntry;
+    entry.next = noEntry;
+  }
+
+  //################################################################################################
+  void release(uint32_t e)
+  {
+    Entry& entry = entries[e];
+    entry.active = false;
+    entry.generation++;
+    entry.callback = std::function<void()>();
+    freeEntries.push_back(e);
+    activeCount--;
+  }
+
+  //################################################################################################
+  //! Place an entry in the slot for its deadline.
+  void insert(uint32_t e)
+  {
+    uint64_t deadlineTick = entries[e].deadlineTick;
+    if(deadlineTick<=currentTick)
+    {
+      link(e, dueLevel, 0);
+      return;
+    }
+
+    // Timers beyond the range of the wheel are parked in the furthest slot and placed again when
+    // that slot is cascaded.
+    uint64_t delta = std::min(deadlineTick-currentTick, maxDelta);
+    uint64_t tick = currentTick+delta;
+
+    size_t level=0;
+    while(level<(levelCount-1) && delta>=(uint64_t(1)<<(levelBits*(level+1))))
+      level++;
+
+    link(e, uint8_t(level), uint8_t((tick>>(levelBits*level))&slotMask));
+  }
+
+  //################################################################################################
+  //! The distance from index to the next occupied slot of a level, wrapping around, or 0 if none.
+  size_t nextOccupied(size_t level, size_t index) const
+  {
+    const uint64_t* bits = occupied[level];
+    for(size_t step=1; step<=slotCount;)
+    {
+      size_t i = (index+step)&slotMask;
+      uint64_t word = bits[i>>6]>>(i&63);
+      if(word)
+      {
+        while(!(word&1))
+        {
+          word>>=1;
+          step++;
+        }
+        return step;
+      }
+      step += 64-(i&63);
+    }
+    return 0;
+  }
+
+  //################################################################################################
+  //! The next tick after currentTick where a slot needs to be fired or cascaded.
+  uint64_t nextEventTick() const
+  {
+    if(due.head!=noEntry)
+      return currentTick+1;
+
+    uint64_t next = std::numeric_limits<uint64_t>::max();
+    for(size_t level=0; level<levelCount; level++)
+    {
+      size_t shift = levelBits*level;
+      uint64_t base = currentTick>>shift;
+      if(size_t step = nextOccupied(level, base&slotMask))
+        next = std::min(next, (base+step)<<shift);
+    }
+    return next;
+  }
+
+  //################################################################################################
+  //! Move the timers in the next slot of each higher level that has come around to the lower levels.
+  void cascade()
+  {
+    for(size_t level=1; level<levelCount; level++)
+    {
+      uint64_t index = (currentTick>>(levelBits*level))&slotMask;
+
+      Slot& slot = slots[level][index];
+      while(slot.head!=noEntry)
+      {
+        uint32_t e = slot.head;
+        unlink(e);
+        insert(e);
+      }
+
+      if(index!=0)
+        break;
+    }
+  }
+
+  //################################################################################################
+  //! Take the entries out of a list and add their IDs to the batch.
+  void take(Slot& slot, std::vector<uint64_t>& ids)
+  {
+    while(slot.head!=noEntry)
+    {
+      uint32_t e = slot.head;
+      unlink(e);
+      ids.push_back(makeID(e, entries[e].generation));
+    }
+  }
+
+  //################################################################################################
+  size_t fire(uint64_t id)
+  {
+    uint32_t e;
+    Entry* entry = find(id, e);
+
+    // Cancelled by an earlier callback in the same tick.
+    if(!entry)
+      return 0;
+
+    if(entry->deadlineTick>currentTick)
+    {
+      insert(e);
+      return 0;
+    }
+
+    if(entry->periodTicks)
+    {
+      // Skip any periods that were missed so a late advance() does not cause a burst.
+      uint64_t missed = (std::max(currentTick, targetTick)-entry->deadlineTick)/entry->periodTicks;
+      entry->deadlineTick += (missed+1)*entry->periodTicks;
+      insert(e);
+
+      // Copy the callback, it may cancel its own timer.
+      std::function<void()> callback = entry->callback;
+      callback();
+    }
+    else
+    {
+      std::function<void()> callback = std::move(entry->callback);
+      release(e);
+      callback();
+    }
+
+    return 1;
+  }
+
+  //################################################################################################
+  //! Fire the due list and the level 0 slot for the current tick, in the order they were added.
+  size_t fireTick()
+  {
+    std::vector<uint64_t> ids;
+    ids.swap(batch);
+
+    take(due, ids);
+    take(slots[0][currentTick&slotMask], ids);
+
+    // Cascaded timers are appended after the timers that were placed in level 0 directly.
+    if(ids.size()>1)
+      std::sort(ids.begin(), ids.end(), [&](uint64_t a, uint64_t b)
+      {
+        return entries[uint32_t(a&0xFFFFFFFFu)-1].sequence<entries[uint32_t(b&0xFFFFFFFFu)-1].sequence;
+      });
+
+    size_t fired=0;
+    for(uint64_t id : ids)
+      fired += fire(id);
+
+    ids.clear();
+    if(ids.capacity()>batch.capacity())
+      batch.swap(ids);
+    return fired;
+  }
+};
+
+//##################################################################################################
+TimerWheel::TimerWheel(int64_t startNS, int64_t resolutionNS):
+  d(new Private(startNS, resolutionNS))
+{
+
+}
+
+//##################################################################################################
+TimerWheel::~TimerWheel()
+{
+  delete d;
+}
+
+//##################################################################################################
+uint64_t TimerWheel::add(int64_t deadlineNS, int64_t periodNS, const std::function<void()>& callback)
+{
+  uint32_t e;
+  if(!d->freeEntries.empty())
+  {
+    e = d->freeEntries.back();
+    d->freeEntries.pop_back();
+  }
+  else
+  {
+    e = uint32_t(d->entries.size());
+    d->entries.emplace_back();
+  }
+
+  Entry& entry = d->entries[e];
+  entry.active = true;
+  entry.sequence = d->nextSequence++;
+  entry.deadlineTick = d->tickAtOrAfter(deadlineNS);
+  entry.periodTicks = (periodNS>0)?std::max(uint64_t(1), uint64_t((periodNS+d->resolutionNS-1)/d->resolutionNS)):0;
+  entry.callback = callback;
+  d->activeCount++;
+  d->insert(e);
+
+  return makeID(e, entry.generation);
+}
+
+//##################################################################################################
+bool TimerWheel::cancel(uint64_t id)
+{
+  uint32_t e;
+  if(!d->find(id, e))
+    return false;
+
+  // An entry taken by advance() for the current tick is not in a list and is skipped when reached.
+  d->unlink(e);
+  d->release(e);
+  return true;
+}
+
+//##################################################################################################
+size_t TimerWheel::advance(int64_t nowNS)
+{
+  uint64_t targetTick = (nowNS<=d->startNS)?0:uint64_t((nowNS-d->startNS)/d->resolutionNS);
+  d->targetTick = targetTick;
+
+  size_t fired = (d->due.head!=noEntry)?d->fireTick():0;
+
+  while(d->currentTick<targetTick)
+  {
+    // Jump over the ticks where there are no slots to fire or cascade.
+    uint64_t next = d->activeCount?d->nextEventTick():std::numeric_limits<uint64_t>::max();
+    if(next>targetTick)
+    {
+      d->currentTick = targetTick;
+      break;
+    }
+
+    d->currentTick = next;
+
+    // Cascading can place timers that are due on this tick in the due list.
+    if((d->currentTick&slotMask)==0)
+      d->cascade();
+
+    fired += d->fireTick();
+  }
+
+  return fired;
+}
+
+//##################################################################################################
+size_t TimerWheel::size() const
+{
+  return d->activeCount;
+}
+
+}
@@ -0,0 +1,206 @@
+#include "tp_control/WorkStealingPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tp_control
+{
+
+namespace
+{
+//##################################################################################################
+struct Queue
+{
+  std::mutex mutex;
+  std::deque<std::function<void()>> tasks;
+};
+}
+
+//##################################################################################################
+struct WorkStealingPool::Private
+{
+  TP_NONCOPYABLE(Private);
+  Private()=default;
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> threads;
+
+  std::atomic<size_t> queued{0};
+  std::atomic<size_t> nextQueue{0};
+
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  bool stopping{false};
+
+  // The pool and queue index of the calling thread if it is a worker.
+  static thread_local Private* currentPool;
+  static thread_local size_t currentIndex;
+
+  //################################################################################################
+  void push(std::function<void()>&& task)
+  {
+    size_t index = (currentPool==this)?currentIndex:(nextQueue++%queues.size());
+    {
+      Queue& queue = *queues.at(index);
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(std::move(task));
+    }
+    queued++;
+
+    // Take the lock so that a worker that has just found nothing to do can't miss the wake.
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_one();
+  }
+
+  //################################################################################################
+  //! Take a task, the newest from queue self if that is a valid index, otherwise the oldest of another.
+  bool pop(size_t self, std::function<void()>& task)
+  {
+    if(queued==0)
+      return false;
+
+    size_t count = queues.size();
+    if(self<count)
+    {
+      Queue& queue = *queues.at(self);
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if(!queue.tasks.empty())
+      {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        queued--;
+        return true;
+      }
+    }
+
+    size_t start = (self<count)?(self+1):nextQueue.load();
+    for(size_t i=0; i<count; i++)
+    {
+      Queue& queue = *queues.at((start+i)%count);
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if(!queue.tasks.empty())
+      {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        queued--;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  //################################################################################################
+  bool runOne()
+  {
+    std::function<void()> task;
+    if(!pop((currentPool==this)?currentIndex:queues.size(), task))
+      return false;
+
+    task();
+    return true;
+  }
+
+  //################################################################################################
+  void run(size_t index)
+  {
+    currentPool = this;
+    currentIndex = index;
+
+    for(;;)
+    {
+      if(runOne())
+        continue;
+
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      wake.wait(lock, [&]{return stopping || queued>0;});
+      if(stopping && queued==0)
+        return;
+    }
+  }
+};
+
+thread_local WorkStealingPool::Private* WorkStealingPool::Private::currentPool{nullptr};
+thread_local size_t WorkStealingPool::Private::currentIndex{0};
+
+//##################################################################################################
+WorkStealingPool::WorkStealingPool(size_t threadCount):
+  d(new Private())
+{
+  if(threadCount==0)
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+  for(size_t i=0; i<threadCount; i++)
+    d->queues.emplace_back(new Queue());
+
+  for(size_t i=0; i<threadCount; i++)
+    d->threads.emplace_back([this, i]{d->run(i);});
+}
+
+//##################################################################################################
+WorkStealingPool::~WorkStealingPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(d->sleepMutex);
+    d->stopping = true;
+  }
+  d->wake.notify_all();
+
+  for(auto& thread : d->threads)
+    thread.join();
+
+  delete d;
+}
+
+//##################################################################################################
+size_t WorkStealingPool::threadCount() const
+{
+  return d->threads.size();
+}
+
+//##################################################################################################
+void WorkStealingPool::submit(const std::function<void()>& task)
+{
+  d->push(std::function<void()>(task));
+}
+
+//##################################################################################################
+void WorkStealingPool::parallelFor(size_t count, const std::function<void(size_t index)>& task)
+{
+  if(count==0)
+    return;
+
+  std::atomic<size_t> remaining{count};
+  for(size_t i=1; i<count; i++)
+  {
+    d->push([&task, &remaining, i]
+    {
+      task(i);
+      remaining--;
+    });
+  }
+
+  // The calling thread takes the first index and then helps with the rest.
+  task(0);
+  remaining--;
+
+  while(remaining>0)
+    if(!d->runOne())
+      std::this_thread::yield();
+}
+
+//##################################################################################################
+bool WorkStealingPool::runPendingTask()
+{
+  return d->runOne();
+}
+
+}
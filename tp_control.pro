@@ -1,3 +1,13 @@
 include(vars.pri)
 include(dependencies.pri)
 include(../tp_build/qmake/project_tp.pri)
+
+# "make tests" builds tp_control_tests against this library and runs it.
+tests.commands = mkdir -p tp_control_tests && cd tp_control_tests && $$QMAKE_QMAKE $$PWD/tp_control_tests/tp_control_tests.pro && $(MAKE) && ./tp_control_tests
+tests.depends = $(TARGET)
+
+# "make benchmarks" builds tp_control_benchmarks, run it with --baseline to compare against a saved run.
+benchmarks.commands = mkdir -p tp_control_benchmarks && cd tp_control_benchmarks && $$QMAKE_QMAKE $$PWD/tp_control_benchmarks/tp_control_benchmarks.pro && $(MAKE)
+benchmarks.depends = $(TARGET)
+
+QMAKE_EXTRA_TARGETS += tests benchmarks
@@ -0,0 +1,703 @@
+#include "Benchmarks.h"
+
+#include "tp_control/CoreInterface.h"
+#include "tp_control/CoreInterfaceBridge.h"
+#include "tp_control/CoreInterfaceCodecs.h"
+#include "tp_control/CoreInterfaceState.h"
+#include "tp_control/ScalarGroup.h"
+#include "tp_control/WorkStealingPool.h"
+
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#include <sys/socket.h>
+#include <sys/resource.h>
+#define TP_CONTROL_BRIDGE_BENCHMARKS
+#define TP_CONTROL_RUSAGE
+#endif
+
+namespace tp_control_benchmarks
+{
+using namespace tp_control;
+
+namespace
+{
+//##################################################################################################
+struct BenchmarkData : public CoreInterfaceData
+{
+  size_t value;
+  BenchmarkData(size_t value_):value(value_){}
+};
+
+//##################################################################################################
+struct Runner
+{
+  const CoreInterfaceBenchmarkParams& params;
+  nlohmann::json results = nlohmann::json::array();
+
+  // Time spent in Untimed scopes during the current pass, this is not counted.
+  int64_t untimedNS{0};
+
+  //################################################################################################
+  //! Excludes setup work inside a benchmark body from the time measured.
+  struct Untimed
+  {
+    TP_NONCOPYABLE(Untimed);
+    Runner& runner;
+    std::chrono::steady_clock::time_point start{std::chrono::steady_clock::now()};
+    Untimed(Runner& runner_):runner(runner_){}
+    ~Untimed(){runner.untimedNS += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count();}
+  };
+
+  //################################################################################################
+  Runner(const CoreInterfaceBenchmarkParams& params_):
+    params(params_)
+  {
+
+  }
+
+  //################################################################################################
+  //! body performs n iterations and returns the number of operations that it performed.
+  void run(const std::string& name, nlohmann::json scale, const std::function<size_t(size_t n)>& body)
+  {
+    size_t n=1;
+    size_t ops=0;
+    double elapsedNS=0.0;
+    for(;;)
+    {
+      untimedNS = 0;
+      auto start = std::chrono::steady_clock::now();
+      ops = body(n);
+      elapsedNS = double(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count()-untimedNS);
+
+      if(elapsedNS>=params.minTimeMS*1000000.0 || n>=(size_t(1)<<30))
+        break;
+
+      // Aim to land just past the minimum time on the next pass.
+      double scaleBy = (elapsedNS>0.0)?(params.minTimeMS*1200000.0/elapsedNS):100.0;
+      n = std::max(n*2, size_t(double(n)*std::min(scaleBy, 100.0)));
+    }
+
+    nlohmann::json j;
+    j["name"] = name;
+    j["scale"] = std::move(scale);
+    j["iterations"] = ops;
+    j["nsPerOp"] = (ops>0)?(elapsedNS/double(ops)):0.0;
+    results.push_back(std::move(j));
+  }
+};
+
+//##################################################################################################
+struct Channels
+{
+  tp_utils::StringID typeID{"benchmark_type"};
+  std::vector<tp_utils::StringID> nameIDs;
+  std::vector<CoreInterfaceHandle> handles;
+
+  //################################################################################################
+  Channels(size_t count)
+  {
+    nameIDs.reserve(count);
+    for(size_t i=0; i<count; i++)
+      nameIDs.emplace_back("channel_" + std::to_string(i));
+  }
+
+  //################################################################################################
+  void create(CoreInterface& coreInterface)
+  {
+    handles.clear();
+    handles.reserve(nameIDs.size());
+    for(const auto& nameID : nameIDs)
+      handles.push_back(coreInterface.handle(typeID, nameID));
+  }
+};
+
+//##################################################################################################
+void benchmarkHandle(Runner& runner, size_t channelCount)
+{
+  Channels channels(channelCount);
+  nlohmann::json scale{{"channels", channelCount}};
+
+  runner.run("handle_create", scale, [&](size_t n)
+  {
+    ChannelListChangedCallback callback = []{};
+    for(size_t i=0; i<n; i++)
+    {
+      CoreInterface coreInterface;
+      coreInterface.registerCallback(&callback);
+      channels.create(coreInterface);
+      coreInterface.unregisterCallback(&callback);
+    }
+    return n*channelCount;
+  });
+
+  CoreInterface coreInterface;
+  channels.create(coreInterface);
+
+  runner.run("handle_lookup", scale, [&](size_t n)
+  {
+    size_t count = channels.nameIDs.size();
+    for(size_t i=0; i<n; i++)
+      coreInterface.handle(channels.typeID, channels.nameIDs[i%count]);
+    return n;
+  });
+
+  // Callers that hold plain strings, either interning them or looking them up by key.
+  std::vector<std::string> names;
+  std::vector<CoreInterfaceChannelKey> keys;
+  names.reserve(channelCount);
+  keys.reserve(channelCount);
+  for(const auto& nameID : channels.nameIDs)
+    names.push_back(nameID.toString());
+  for(const auto& name : names)
+    keys.emplace_back(channels.typeID.toString(), name);
+
+  runner.run("handle_lookup_intern", scale, [&](size_t n)
+  {
+    size_t count = names.size();
+    for(size_t i=0; i<n; i++)
+      coreInterface.handle(channels.typeID, tp_utils::StringID(names[i%count]));
+    return n;
+  });
+
+  runner.run("find_handle_key", scale, [&](size_t n)
+  {
+    size_t count = keys.size();
+    for(size_t i=0; i<n; i++)
+      coreInterface.findHandle(keys[i%count]);
+    return n;
+  });
+
+  runner.run("find_handle_cached", scale, [&](size_t n)
+  {
+    thread_local CoreInterfaceCachedHandle cached("benchmark_type", "channel_0");
+    size_t found=0;
+    for(size_t i=0; i<n; i++)
+      found += cached.get(&coreInterface).typeID().isValid()?1:0;
+    return found;
+  });
+
+  runner.run("less_than_sort", scale, [&](size_t n)
+  {
+    size_t comparisons=0;
+    auto lessThan = [&](const CoreInterfaceHandle& lhs, const CoreInterfaceHandle& rhs)
+    {
+      comparisons++;
+      return lessThanCoreInterfaceHandle(lhs, rhs);
+    };
+
+    std::vector<CoreInterfaceHandle> handles;
+    for(size_t i=0; i<n; i++)
+    {
+      {
+        Runner::Untimed untimed(runner);
+        handles = channels.handles;
+      }
+      std::sort(handles.begin(), handles.end(), lessThan);
+    }
+    return comparisons;
+  });
+}
+
+//##################################################################################################
+//! Create every channel in a new interface with subscribers that rebuild a list of the channels.
+void benchmarkStartup(Runner& runner, size_t channelCount, size_t subscriberCount)
+{
+  Channels channels(channelCount);
+  nlohmann::json scale{{"channels", channelCount}, {"subscribers", subscriberCount}};
+
+  auto startup = [&](size_t n, bool coalesce)
+  {
+    size_t rebuilt=0;
+    for(size_t i=0; i<n; i++)
+    {
+      CoreInterface coreInterface;
+      std::vector<ChannelListChangedCallback> callbacks(subscriberCount, [&]
+      {
+        for(const auto& type : coreInterface.channels())
+          for(const auto& channel : type.second)
+            rebuilt += channel.second.nameID().isValid()?1:0;
+      });
+
+      for(const auto& callback : callbacks)
+        coreInterface.registerCallback(&callback);
+
+      {
+        std::unique_ptr<CoreInterfaceChannelListChanges> changes;
+        if(coalesce)
+          changes.reset(new CoreInterfaceChannelListChanges(&coreInterface));
+        channels.create(coreInterface);
+      }
+
+      for(const auto& callback : callbacks)
+        coreInterface.unregisterCallback(&callback);
+    }
+    return n*channelCount;
+  };
+
+  // Without coalescing this is quadratic in the number of channels, so it is skipped at large scales.
+  if(channelCount*subscriberCount<=100000)
+    runner.run("startup", scale, [&](size_t n){return startup(n, false);});
+
+  runner.run("startup_coalesced", scale, [&](size_t n){return startup(n, true);});
+}
+
+//##################################################################################################
+void benchmarkSetChannelData(Runner& runner, size_t channelCount, size_t subscriberCount)
+{
+  Channels channels(channelCount);
+  CoreInterface coreInterface;
+  channels.create(coreInterface);
+
+  size_t sum=0;
+  std::vector<ChannelChangedCallback> callbacks(subscriberCount, [&](const tp_utils::StringID&, const tp_utils::StringID&, const CoreInterfaceData* data)
+  {
+    sum += static_cast<const BenchmarkData*>(data)->value;
+  });
+
+  for(const auto& callback : callbacks)
+    coreInterface.registerCallback(&callback);
+
+  runner.run("set_channel_data", {{"channels", channelCount}, {"subscribers", subscriberCount}}, [&](size_t n)
+  {
+    size_t count = channels.handles.size();
+    for(size_t i=0; i<n; i++)
+      coreInterface.setChannelData(channels.handles[i%count], new BenchmarkData(i));
+    return n;
+  });
+
+  for(const auto& callback : callbacks)
+    coreInterface.unregisterCallback(&callback);
+}
+
+//##################################################################################################
+//! Publish frames where one scalar in ten changes, timed per scalar so it compares to set_channel_data.
+void benchmarkScalarGroup(Runner& runner, size_t channelCount, size_t subscriberCount)
+{
+  ScalarGroup group;
+  for(size_t i=0; i<channelCount; i++)
+    group.addScalar("scalar_" + std::to_string(i));
+
+  size_t sum=0;
+  std::vector<ScalarGroupChangedCallback> callbacks(subscriberCount, [&](const ScalarGroup&, const std::vector<size_t>& changed)
+  {
+    sum += changed.size();
+  });
+
+  for(const auto& callback : callbacks)
+    group.registerCallback(&callback);
+
+  std::vector<std::vector<double>> frames(2, std::vector<double>(channelCount, 0.0));
+  std::vector<size_t> indices(channelCount);
+  for(size_t i=0; i<channelCount; i++)
+  {
+    indices[i] = i;
+    frames[1][i] = (i%10)?0.0:1.0;
+  }
+
+  nlohmann::json scale{{"channels", channelCount}, {"subscribers", subscriberCount}};
+
+  runner.run("scalar_group_set_range", scale, [&](size_t n)
+  {
+    size_t frameCount = std::max(size_t(1), n/channelCount);
+    for(size_t i=0; i<frameCount; i++)
+      group.setRange(0, frames[i%2].data(), channelCount);
+    return frameCount*channelCount;
+  });
+
+  runner.run("scalar_group_set_bulk", scale, [&](size_t n)
+  {
+    size_t frameCount = std::max(size_t(1), n/channelCount);
+    for(size_t i=0; i<frameCount; i++)
+      group.setBulk(indices.data(), frames[i%2].data(), channelCount);
+    return frameCount*channelCount;
+  });
+
+  for(const auto& callback : callbacks)
+    group.unregisterCallback(&callback);
+}
+
+//##################################################################################################
+//! A JSON codec for BenchmarkData.
+void addStateCodec(CoreInterfaceCodecs& codecs, const tp_utils::StringID& typeID)
+{
+  CoreInterfaceCodec codec;
+  codec.saveState = [](const CoreInterfaceData* data)
+  {
+    return nlohmann::json(static_cast<const BenchmarkData*>(data)->value);
+  };
+  codec.loadState = [](const nlohmann::json& j) -> CoreInterfaceData*
+  {
+    return j.is_number_unsigned()?new BenchmarkData(j.get<size_t>()):nullptr;
+  };
+  codecs.addCodec(typeID, codec);
+}
+
+//##################################################################################################
+//! The JSON state of an interface with channelCount channels, in the form saveCoreInterfaceState() writes.
+/*!
+This is written directly rather than from an interface so that building it does not raise the peak
+memory of the process above what loading it needs.
+*/
+std::string makeState(size_t channelCount, CoreInterfaceCodecs& codecs)
+{
+  tp_utils::StringID typeID("benchmark_type");
+  addStateCodec(codecs, typeID);
+
+  std::string state = "{\"channels\":[";
+  for(size_t i=0; i<channelCount; i++)
+  {
+    if(i)
+      state += ',';
+    std::string n = std::to_string(i);
+    state += "{\"typeID\":\"" + typeID.toString() + "\",\"nameID\":\"channel_" + n + "\",\"data\":" + n + "}";
+  }
+  state += "]}";
+  return state;
+}
+
+//##################################################################################################
+//! Load a saved state into a new interface, parsed into a DOM first or streamed, timed per channel.
+void benchmarkLoadState(Runner& runner, size_t channelCount)
+{
+  CoreInterfaceCodecs codecs;
+  std::string state = makeState(channelCount, codecs);
+  nlohmann::json scale{{"channels", channelCount}};
+
+  runner.run("load_state_dom", scale, [&](size_t n)
+  {
+    for(size_t i=0; i<n; i++)
+    {
+      CoreInterface coreInterface;
+      loadCoreInterfaceState(&coreInterface, &codecs, nlohmann::json::parse(state));
+      Runner::Untimed untimed(runner);
+    }
+    return n*channelCount;
+  });
+
+  runner.run("load_state_stream", scale, [&](size_t n)
+  {
+    for(size_t i=0; i<n; i++)
+    {
+      CoreInterface coreInterface;
+      std::istringstream stream(state);
+      loadCoreInterfaceState(&coreInterface, &codecs, stream);
+      Runner::Untimed untimed(runner);
+    }
+    return n*channelCount;
+  });
+}
+
+//##################################################################################################
+//! The peak resident set size of this process in bytes, or 0 if it is not available.
+size_t peakRSSBytes()
+{
+#ifdef TP_CONTROL_RUSAGE
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF, &usage)!=0)
+    return 0;
+#ifdef __APPLE__
+  return size_t(usage.ru_maxrss);
+#else
+  return size_t(usage.ru_maxrss)*1024;
+#endif
+#else
+  return 0;
+#endif
+}
+
+//##################################################################################################
+void benchmarkSendSignal(Runner& runner, size_t subscriberCount)
+{
+  CoreInterface coreInterface;
+  tp_utils::StringID typeID("benchmark_signal");
+
+  size_t sum=0;
+  std::vector<SignalCallback> callbacks(subscriberCount, [&](const tp_utils::StringID&, const CoreInterfaceData* data)
+  {
+    sum += static_cast<const BenchmarkData*>(data)->value;
+  });
+
+  for(const auto& callback : callbacks)
+    coreInterface.registerCallback(&callback, typeID);
+
+  runner.run("send_signal", {{"subscribers", subscriberCount}}, [&](size_t n)
+  {
+    for(size_t i=0; i<n; i++)
+      coreInterface.sendSignal(typeID, new BenchmarkData(1));
+    return n;
+  });
+
+  runner.run("register_callback", {{"subscribers", subscriberCount}}, [&](size_t n)
+  {
+    SignalCallback callback = [](const tp_utils::StringID&, const CoreInterfaceData*){};
+    ChannelChangedCallback channelCallback = [](const tp_utils::StringID&, const tp_utils::StringID&, const CoreInterfaceData*){};
+    for(size_t i=0; i<n; i++)
+    {
+      coreInterface.registerCallback(&callback, typeID);
+      coreInterface.unregisterCallback(&callback, typeID);
+      coreInterface.registerCallback(&channelCallback);
+      coreInterface.unregisterCallback(&channelCallback);
+    }
+    return n;
+  });
+
+  for(const auto& callback : callbacks)
+    coreInterface.unregisterCallback(&callback, typeID);
+}
+
+//##################################################################################################
+//! Fan a signal out to subscribers that each do a fixed amount of work, threadCount 0 runs them serially.
+void benchmarkParallelSignal(Runner& runner, size_t threadCount, size_t subscriberCount)
+{
+  tp_utils::StringID typeID("benchmark_parallel_signal");
+  std::unique_ptr<WorkStealingPool> pool;
+  if(threadCount)
+    pool.reset(new WorkStealingPool(threadCount));
+
+  CoreInterface coreInterface;
+  coreInterface.setSignalPool(pool.get());
+
+  std::atomic<size_t> sum{0};
+  std::vector<SignalCallback> callbacks(subscriberCount, [&](const tp_utils::StringID&, const CoreInterfaceData* data)
+  {
+    // Roughly 10us of work, like decoding a small frame.
+    size_t value = static_cast<const BenchmarkData*>(data)->value;
+    for(size_t i=0; i<10000; i++)
+      value = value*6364136223846793005ull + 1442695040888963407ull;
+    sum += value;
+  });
+
+  for(const auto& callback : callbacks)
+    coreInterface.registerParallelCallback(&callback, typeID);
+
+  runner.run("send_signal_parallel", {{"threads", threadCount}, {"subscribers", subscriberCount}}, [&](size_t n)
+  {
+    for(size_t i=0; i<n; i++)
+      coreInterface.sendSignal(typeID, new BenchmarkData(i));
+    return n;
+  });
+
+  for(const auto& callback : callbacks)
+    coreInterface.unregisterCallback(&callback, typeID);
+}
+
+#ifdef TP_CONTROL_BRIDGE_BENCHMARKS
+//##################################################################################################
+struct BridgeData : public CoreInterfaceData
+{
+  std::string bytes;
+};
+
+//##################################################################################################
+void benchmarkBridge(Runner& runner, size_t payloadBytes)
+{
+  tp_utils::StringID typeID("benchmark_bridge");
+
+  CoreInterfaceCodec codec;
+  codec.encode = [](const CoreInterfaceData* data, std::string& result)
+  {
+    result += static_cast<const BridgeData*>(data)->bytes;
+  };
+  codec.decode = [](const char* encoded, size_t size)
+  {
+    auto data = new BridgeData();
+    data->bytes.assign(encoded, size);
+    return data;
+  };
+
+  CoreInterfaceCodecs codecs;
+  codecs.addCodec(typeID, codec);
+
+  int fds[2];
+  if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds)!=0)
+    return;
+
+  CoreInterface sender;
+  CoreInterface receiver;
+  CoreInterfaceBridge senderBridge(&sender, &codecs);
+  CoreInterfaceBridge receiverBridge(&receiver, &codecs);
+  senderBridge.attach(fds[0]);
+  receiverBridge.attach(fds[1]);
+  senderBridge.addSignalType(typeID);
+  senderBridge.setMaxPendingBytes(64<<20);
+
+  size_t received=0;
+  SignalCallback callback = [&](const tp_utils::StringID&, const CoreInterfaceData*){received++;};
+  receiver.registerCallback(&callback, typeID);
+
+  BridgeData data;
+  data.bytes.resize(payloadBytes, 'x');
+
+  // Pump both ends until the receiver has everything, giving up if the bridge stalls.
+  auto pump = [&](size_t target)
+  {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while(received<target && std::chrono::steady_clock::now()<deadline)
+    {
+      senderBridge.poll();
+      receiverBridge.poll();
+    }
+  };
+
+  nlohmann::json scale{{"payloadBytes", payloadBytes}};
+
+  runner.run("bridge_signal_latency", scale, [&](size_t n)
+  {
+    for(size_t i=0; i<n; i++)
+    {
+      sender.sendSignal(typeID, new BridgeData(data));
+      pump(received+1);
+    }
+    return n;
+  });
+
+  runner.run("bridge_signal_throughput", scale, [&](size_t n)
+  {
+    size_t target = received+n;
+    for(size_t i=0; i<n; i++)
+    {
+      sender.sendSignal(typeID, new BridgeData(data));
+      if((i%256)==255)
+        senderBridge.poll();
+    }
+    pump(target);
+    return n;
+  });
+
+  receiver.unregisterCallback(&callback, typeID);
+}
+#endif
+}
+
+//##################################################################################################
+nlohmann::json runCoreInterfaceBenchmarks(const CoreInterfaceBenchmarkParams& params)
+{
+  Runner runner(params);
+
+  for(size_t channelCount : params.channelCounts)
+    benchmarkHandle(runner, channelCount);
+
+  for(size_t channelCount : params.channelCounts)
+    for(size_t subscriberCount : params.subscriberCounts)
+      benchmarkStartup(runner, channelCount, subscriberCount);
+
+  for(size_t channelCount : params.channelCounts)
+    for(size_t subscriberCount : params.subscriberCounts)
+      benchmarkSetChannelData(runner, channelCount, subscriberCount);
+
+  for(size_t channelCount : params.channelCounts)
+    for(size_t subscriberCount : params.subscriberCounts)
+      benchmarkScalarGroup(runner, channelCount, subscriberCount);
+
+  for(size_t channelCount : params.channelCounts)
+    benchmarkLoadState(runner, channelCount);
+
+  for(size_t subscriberCount : params.subscriberCounts)
+    benchmarkSendSignal(runner, subscriberCount);
+
+  // Scale from serial, through one worker, to one worker per hardware thread.
+  {
+    size_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> threadCounts{0};
+    for(size_t t=1; t<hardwareThreads; t*=2)
+      threadCounts.push_back(t);
+    threadCounts.push_back(hardwareThreads);
+
+    for(size_t threadCount : threadCounts)
+      benchmarkParallelSignal(runner, threadCount, 16);
+  }
+
+#ifdef TP_CONTROL_BRIDGE_BENCHMARKS
+  for(size_t payloadBytes : {size_t(8), size_t(1024)})
+    benchmarkBridge(runner, payloadBytes);
+#endif
+
+  nlohmann::json j;
+  j["benchmarks"] = std::move(runner.results);
+  return j;
+}
+
+//##################################################################################################
+nlohmann::json measureStateLoadMemory(bool streaming, size_t channelCount)
+{
+  CoreInterfaceCodecs codecs;
+  std::string state = makeState(channelCount, codecs);
+
+  // The state document and the allocator's high water mark from building it are in the baseline.
+  size_t baseline = peakRSSBytes();
+
+  CoreInterface coreInterface;
+  size_t count;
+  if(streaming)
+  {
+    std::istringstream stream(state);
+    count = loadCoreInterfaceState(&coreInterface, &codecs, stream);
+  }
+  else
+    count = loadCoreInterfaceState(&coreInterface, &codecs, nlohmann::json::parse(state));
+
+  size_t peak = peakRSSBytes();
+
+  nlohmann::json j;
+  j["mode"] = streaming?"stream":"dom";
+  j["channels"] = count;
+  j["stateBytes"] = state.size();
+  j["baselinePeakRSSBytes"] = baseline;
+  j["peakRSSBytes"] = peak;
+  j["loadPeakRSSGrowthBytes"] = (peak>baseline)?(peak-baseline):0;
+  return j;
+}
+
+//##################################################################################################
+nlohmann::json compareCoreInterfaceBenchmarks(const nlohmann::json& baseline, const nlohmann::json& current)
+{
+  nlohmann::json comparisons = nlohmann::json::array();
+
+  auto find = [](const nlohmann::json& results, const nlohmann::json& benchmark) -> const nlohmann::json*
+  {
+    auto i = results.find("benchmarks");
+    if(i==results.end() || !i->is_array())
+      return nullptr;
+
+    for(const auto& b : *i)
+      if(b.value("name", "")==benchmark.value("name", "") && b.value("scale", nlohmann::json())==benchmark.value("scale", nlohmann::json()))
+        return &b;
+
+    return nullptr;
+  };
+
+  auto i = current.find("benchmarks");
+  if(i!=current.end() && i->is_array())
+  {
+    for(const auto& c : *i)
+    {
+      const nlohmann::json* b = find(baseline, c);
+      if(!b)
+        continue;
+
+      double baselineNS = b->value("nsPerOp", 0.0);
+      double currentNS = c.value("nsPerOp", 0.0);
+
+      nlohmann::json j;
+      j["name"] = c.value("name", "");
+      j["scale"] = c.value("scale", nlohmann::json());
+      j["baselineNSPerOp"] = baselineNS;
+      j["currentNSPerOp"] = currentNS;
+      j["ratio"] = (baselineNS>0.0)?(currentNS/baselineNS):0.0;
+      comparisons.push_back(std::move(j));
+    }
+  }
+
+  nlohmann::json j;
+  j["comparisons"] = std::move(comparisons);
+  return j;
+}
+
+}
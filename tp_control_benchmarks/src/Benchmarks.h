@@ -0,0 +1,65 @@
+#ifndef tp_control_benchmarks_Benchmarks_h
+#define tp_control_benchmarks_Benchmarks_h
+
+#include "json.hpp"
+
+#include <vector>
+
+namespace tp_control_benchmarks
+{
+
+//##################################################################################################
+//! The scales that the core interface benchmarks are run at
+struct CoreInterfaceBenchmarkParams
+{
+  std::vector<size_t> channelCounts{10, 1000, 100000};  //!< The number of channels in the interface.
+  std::vector<size_t> subscriberCounts{0, 1, 10, 100};  //!< The number of callbacks registered.
+  double minTimeMS{50.0};                               //!< Each benchmark runs for at least this long.
+};
+
+//##################################################################################################
+//! Run the micro benchmarks for the CoreInterface hot paths
+/*!
+This times handle(), findHandle(), setChannelData(), sendSignal(), callback registration,
+lessThanCoreInterfaceHandle(), creating channels at startup with and without coalescing the channel
+list changed callbacks, bulk updates of a ScalarGroup, and loading a saved JSON state both through a
+DOM and streamed, at each of the scales in params. Parallel signal fan-out is measured from 1 to N
+worker threads, where N is the number of hardware threads. Where Unix domain sockets are available
+the latency and throughput of CoreInterfaceBridge are measured over a socketpair() loopback.
+
+The result is a JSON object with a "benchmarks" array, each entry has a "name", the scale it was
+run at, the number of "iterations", and the time in "nsPerOp".
+
+\param params - The scales to run the benchmarks at.
+\return The results as JSON.
+*/
+nlohmann::json runCoreInterfaceBenchmarks(const CoreInterfaceBenchmarkParams& params=CoreInterfaceBenchmarkParams());
+
+//##################################################################################################
+//! Measure the peak memory used to load a saved JSON state
+/*!
+A state of channelCount channels is written to a string and then loaded into a new interface, either
+parsed into a DOM first or streamed with the SAX loader. The peak RSS of a process only grows, so
+run this once in a fresh process for each mode to compare them.
+
+\param streaming - Stream the state rather than parsing it into a DOM.
+\param channelCount - The number of channels in the state.
+\return A JSON object with the size of the state and the growth in peak RSS during the load.
+*/
+nlohmann::json measureStateLoadMemory(bool streaming, size_t channelCount);
+
+//##################################################################################################
+//! Compare two sets of results produced by runCoreInterfaceBenchmarks()
+/*!
+Results are matched by name and scale, each match is returned with the baseline and current times
+and the "ratio" of current to baseline, so a ratio greater than 1 is a regression.
+
+\param baseline - The results to compare against.
+\param current - The new results.
+\return A JSON object with a "comparisons" array.
+*/
+nlohmann::json compareCoreInterfaceBenchmarks(const nlohmann::json& baseline, const nlohmann::json& current);
+
+}
+
+#endif
@@ -0,0 +1,61 @@
+#include "Benchmarks.h"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+//##################################################################################################
+// Usage: tp_control_benchmarks [--quick] [--baseline results.json]
+//        tp_control_benchmarks --state-memory dom|stream channelCount
+//
+// Prints the benchmark results as JSON, or a comparison against the baseline if one is given. With
+// --state-memory a single state load is measured instead, see measureStateLoadMemory().
+int main(int argc, char* argv[])
+{
+  tp_control_benchmarks::CoreInterfaceBenchmarkParams params;
+  std::string baselinePath;
+
+  for(int a=1; a<argc; a++)
+  {
+    std::string arg = argv[a];
+    if(arg=="--quick")
+    {
+      params.channelCounts = {10, 1000};
+      params.subscriberCounts = {0, 10};
+      params.minTimeMS = 10.0;
+    }
+    else if(arg=="--baseline" && (a+1)<argc)
+      baselinePath = argv[++a];
+    else if(arg=="--state-memory" && (a+2)<argc && (std::string(argv[a+1])=="dom" || std::string(argv[a+1])=="stream"))
+    {
+      bool streaming = (std::string(argv[a+1])=="stream");
+      size_t channelCount = size_t(std::stoull(argv[a+2]));
+      std::cout << tp_control_benchmarks::measureStateLoadMemory(streaming, channelCount).dump(2) << std::endl;
+      return 0;
+    }
+    else
+    {
+      std::cerr << "Usage: " << argv[0] << " [--quick] [--baseline results.json]" << std::endl;
+      std::cerr << "       " << argv[0] << " --state-memory dom|stream channelCount" << std::endl;
+      return 1;
+    }
+  }
+
+  nlohmann::json results = tp_control_benchmarks::runCoreInterfaceBenchmarks(params);
+
+  if(!baselinePath.empty())
+  {
+    std::ifstream in(baselinePath);
+    nlohmann::json baseline = nlohmann::json::parse(in, nullptr, false);
+    if(baseline.is_discarded())
+    {
+      std::cerr << "Failed to parse baseline: " << baselinePath << std::endl;
+      return 1;
+    }
+
+    results["comparison"] = tp_control_benchmarks::compareCoreInterfaceBenchmarks(baseline, results)["comparisons"];
+  }
+
+  std::cout << results.dump(2) << std::endl;
+  return 0;
+}
@@ -0,0 +1,7 @@
+TARGET = tp_control_benchmarks
+TEMPLATE = app
+
+SOURCES += src/main.cpp
+
+SOURCES += src/Benchmarks.cpp
+HEADERS += src/Benchmarks.h
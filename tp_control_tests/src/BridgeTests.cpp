@@ -0,0 +1,271 @@
+#include "Tests.h"
+
+#include "tp_control/CoreInterfaceBridge.h"
+#include "tp_control/CoreInterfaceCodecs.h"
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+
+using namespace tp_control;
+using namespace tp_control_tests;
+
+namespace
+{
+//##################################################################################################
+//! Two interfaces joined by bridges over a socketpair().
+struct Loopback
+{
+  CoreInterfaceCodecs codecs;
+  CoreInterface local;
+  CoreInterface remote;
+  CoreInterfaceBridge localBridge{&local, &codecs};
+  CoreInterfaceBridge remoteBridge{&remote, &codecs};
+  int fds[2]{-1, -1};
+
+  std::vector<std::string> received;
+
+  ChannelChangedCallback channelCallback = [&](const tp_utils::StringID&, const tp_utils::StringID& nameID, const CoreInterfaceData* data)
+  {
+    received.push_back(nameID.toString() + "=" + std::to_string(intValue(data)));
+  };
+
+  SignalCallback signalCallback = [&](const tp_utils::StringID& typeID, const CoreInterfaceData* data)
+  {
+    received.push_back(typeID.toString() + "!" + std::to_string(intValue(data)));
+  };
+
+  //################################################################################################
+  Loopback()
+  {
+    addIntCodec(codecs, "int");
+    addIntCodec(codecs, "event");
+    addIntCodec(codecs, "other");
+
+    remote.registerCallback(&channelCallback);
+    remote.registerCallback(&signalCallback, "event");
+
+    localBridge.addChannelType("int");
+    localBridge.addSignalType("event");
+    remoteBridge.addChannelType("int");
+    remoteBridge.addSignalType("event");
+  }
+
+  //################################################################################################
+  ~Loopback()
+  {
+    remote.unregisterCallback(&channelCallback);
+    remote.unregisterCallback(&signalCallback, "event");
+  }
+
+  //################################################################################################
+  bool connect()
+  {
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds)!=0)
+      return false;
+
+    return localBridge.attach(fds[0]) && remoteBridge.attach(fds[1]);
+  }
+
+  //################################################################################################
+  //! Poll both ends until the remote has received count updates in total.
+  void pump(size_t count)
+  {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while(remoteBridge.receivedCount()<count && std::chrono::steady_clock::now()<deadline)
+    {
+      localBridge.poll();
+      remoteBridge.poll();
+    }
+  }
+};
+
+//##################################################################################################
+//! Write a raw frame to a socket, the layout matches the bridge's packed FrameHeader.
+void writeFrame(int fd, uint32_t size, uint8_t kind, uint16_t typeSize, uint16_t nameSize, const std::string& body)
+{
+  char header[10];
+  memcpy(header, &size, 4);
+  header[4] = char(kind);
+  header[5] = 0;
+  memcpy(header+6, &typeSize, 2);
+  memcpy(header+8, &nameSize, 2);
+  TP_UNUSED(::write(fd, header, sizeof(header)));
+  TP_UNUSED(::write(fd, body.data(), body.size()));
+}
+}
+
+//##################################################################################################
+TP_TEST(bridgeSendsSnapshotOnConnect)
+{
+  Loopback loopback;
+  loopback.local.setChannelData(loopback.local.handle("int", "a"), new IntData(1));
+  loopback.local.setChannelData(loopback.local.handle("int", "b"), new IntData(2));
+  loopback.local.setChannelData(loopback.local.handle("other", "c"), new IntData(3));
+
+  TP_CHECK(loopback.connect());
+  loopback.pump(2);
+
+  TP_CHECK(loopback.remoteBridge.receivedCount()==2);
+  TP_CHECK(intValue(loopback.remote.findHandle("int", "a").data())==1);
+  TP_CHECK(intValue(loopback.remote.findHandle("int", "b").data())==2);
+  TP_CHECK(!loopback.remote.findHandle("other", "c").typeID().isValid());
+
+  // A type added once connected is sent straight away.
+  loopback.localBridge.addChannelType("other");
+  loopback.pump(3);
+  TP_CHECK(intValue(loopback.remote.findHandle("other", "c").data())==3);
+}
+
+//##################################################################################################
+TP_TEST(bridgeCoalescesChannelsAndKeepsOrder)
+{
+  Loopback loopback;
+  TP_CHECK(loopback.connect());
+
+  CoreInterfaceHandle a = loopback.local.handle("int", "a");
+  CoreInterfaceHandle b = loopback.local.handle("int", "b");
+
+  // Changes waiting in the same batch replace each other in the position of the first change.
+  for(int i=1; i<=100; i++)
+    loopback.local.setChannelData(a, new IntData(i));
+  loopback.local.setChannelData(b, new IntData(7));
+  loopback.local.sendSignal("event", new IntData(8));
+  loopback.local.sendSignal("event", new IntData(8));
+  loopback.local.setChannelData(a, new IntData(101));
+  loopback.pump(4);
+
+  TP_CHECK((loopback.received==std::vector<std::string>{"a=101", "b=7", "event!8", "event!8"}));
+
+  // Batches are applied in the order they were sent.
+  loopback.received.clear();
+  loopback.local.setChannelData(a, new IntData(1));
+  loopback.localBridge.poll();
+  loopback.local.setChannelData(a, new IntData(2));
+  loopback.localBridge.poll();
+  loopback.pump(6);
+
+  TP_CHECK((loopback.received==std::vector<std::string>{"a=1", "a=2"}));
+  TP_CHECK(intValue(loopback.remote.findHandle("int", "a").data())==2);
+
+  // Updates applied from the peer are not sent back.
+  loopback.localBridge.poll();
+  TP_CHECK(loopback.remoteBridge.pendingBytes()==0);
+  TP_CHECK(loopback.localBridge.receivedCount()==0);
+}
+
+//##################################################################################################
+TP_TEST(bridgeDropsSignalsUnderBackpressure)
+{
+  Loopback loopback;
+  TP_CHECK(loopback.connect());
+  loopback.localBridge.setMaxPendingBytes(64);
+
+  for(size_t i=0; i<100; i++)
+    loopback.local.sendSignal("event", new IntData(1));
+
+  TP_CHECK(loopback.localBridge.droppedSignals()>0);
+  TP_CHECK(loopback.localBridge.pendingBytes()<=64);
+}
+
+//##################################################################################################
+TP_TEST(bridgeAppliesFramesSentBeforeClose)
+{
+  Loopback loopback;
+  TP_CHECK(loopback.connect());
+
+  loopback.local.setChannelData(loopback.local.handle("int", "a"), new IntData(1));
+  loopback.local.sendSignal("event", new IntData(2));
+  loopback.localBridge.poll();
+  loopback.localBridge.close();
+
+  // The frames and the end of the stream arrive in the same poll.
+  TP_CHECK(!loopback.remoteBridge.poll());
+  TP_CHECK(!loopback.remoteBridge.isConnected());
+  TP_CHECK((loopback.received==std::vector<std::string>{"a=1", "event!2"}));
+}
+
+//##################################################################################################
+TP_TEST(bridgeDoesNotQueueWithoutPeer)
+{
+  Loopback loopback;
+  loopback.localBridge.setMaxPendingBytes(64);
+
+  // Nothing is queued or dropped before a peer connects.
+  CoreInterfaceHandle a = loopback.local.handle("int", "a");
+  for(size_t i=0; i<100; i++)
+    loopback.local.sendSignal("event", new IntData(1));
+  loopback.local.setChannelData(a, new IntData(1));
+  TP_CHECK(loopback.localBridge.droppedSignals()==0);
+  TP_CHECK(loopback.localBridge.pendingBytes()==0);
+
+  // The peer only gets the snapshot.
+  TP_CHECK(loopback.connect());
+  loopback.pump(1);
+  TP_CHECK((loopback.received==std::vector<std::string>{"a=1"}));
+
+  // Updates still waiting when the connection closes are not sent to the next peer.
+  loopback.local.setChannelData(a, new IntData(2));
+  loopback.local.sendSignal("event", new IntData(1));
+  TP_CHECK(loopback.localBridge.pendingBytes()>0);
+  loopback.localBridge.close();
+  TP_CHECK(loopback.localBridge.pendingBytes()==0);
+  TP_CHECK(!loopback.remoteBridge.poll());
+
+  loopback.received.clear();
+  TP_CHECK(loopback.connect());
+  loopback.pump(2);
+  loopback.localBridge.poll();
+  loopback.remoteBridge.poll();
+  TP_CHECK((loopback.received==std::vector<std::string>{"a=2"}));
+  TP_CHECK(loopback.localBridge.droppedSignals()==0);
+}
+
+//##################################################################################################
+TP_TEST(bridgeRejectsMalformedFrames)
+{
+  // IDs that run past the end of the frame.
+  {
+    Loopback loopback;
+    int fds[2];
+    TP_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds)==0);
+    TP_CHECK(loopback.remoteBridge.attach(fds[1]));
+
+    writeFrame(fds[0], 6+3+1, 1, 200, 200, "intab");
+    TP_CHECK(!loopback.remoteBridge.poll());
+    TP_CHECK(!loopback.remoteBridge.isConnected());
+    TP_CHECK(loopback.remoteBridge.receivedCount()==0);
+    ::close(fds[0]);
+  }
+
+  // A size that would have the bridge buffer forever.
+  {
+    Loopback loopback;
+    int fds[2];
+    TP_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds)==0);
+    TP_CHECK(loopback.remoteBridge.attach(fds[1]));
+
+    writeFrame(fds[0], 0xFFFFFFF0u, 1, 3, 1, "inta");
+    TP_CHECK(!loopback.remoteBridge.poll());
+    TP_CHECK(!loopback.remoteBridge.isConnected());
+    ::close(fds[0]);
+  }
+
+  // A valid frame is still accepted.
+  {
+    Loopback loopback;
+    int fds[2];
+    TP_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds)==0);
+    TP_CHECK(loopback.remoteBridge.attach(fds[1]));
+
+    writeFrame(fds[0], 6+3+1, 1, 3, 1, "inta");
+    TP_CHECK(loopback.remoteBridge.poll());
+    TP_CHECK(loopback.remoteBridge.receivedCount()==1);
+    TP_CHECK(loopback.remote.findHandle("int", "a").typeID().isValid());
+    ::close(fds[0]);
+  }
+}
+#endif
@@ -0,0 +1,69 @@
+#include "Tests.h"
+
+using namespace tp_control;
+using namespace tp_control_tests;
+
+namespace
+{
+//##################################################################################################
+//! Counts the channels that an observer is told about
+struct CreatedCounter : public CoreInterfaceObserver
+{
+  size_t created{0};
+
+  //################################################################################################
+  void handleCreated(const CoreInterfaceHandle&) override
+  {
+    created++;
+  }
+};
+}
+
+//##################################################################################################
+TP_TEST(channelListChangesNestedScopesNotifyOnce)
+{
+  CoreInterface coreInterface;
+  CreatedCounter observer;
+  coreInterface.registerObserver(&observer);
+
+  size_t notifications=0;
+  ChannelListChangedCallback callback = [&]{notifications++;};
+  coreInterface.registerCallback(&callback);
+
+  {
+    CoreInterfaceChannelListChanges outer(&coreInterface);
+    coreInterface.handle("int", "a");
+    {
+      CoreInterfaceChannelListChanges inner(&coreInterface);
+      coreInterface.handle("int", "b");
+      coreInterface.beginChannelListChanges();
+      coreInterface.handle("int", "c");
+      coreInterface.endChannelListChanges();
+      TP_CHECK(notifications==0);
+    }
+
+    // Closing the inner scopes does not notify while the outer scope is open.
+    coreInterface.handle("int", "d");
+    TP_CHECK(notifications==0);
+
+    // Observers are still told about each channel as it is created.
+    TP_CHECK(observer.created==4);
+  }
+  TP_CHECK(notifications==1);
+
+  // A scope that creates nothing, or only finds existing channels, does not notify.
+  {
+    CoreInterfaceChannelListChanges outer(&coreInterface);
+    CoreInterfaceChannelListChanges inner(&coreInterface);
+    coreInterface.handle("int", "a");
+  }
+  TP_CHECK(notifications==1);
+
+  // Outside of a scope each new channel notifies.
+  coreInterface.handle("int", "e");
+  coreInterface.handle("int", "f");
+  TP_CHECK(notifications==3);
+
+  coreInterface.unregisterCallback(&callback);
+  coreInterface.unregisterObserver(&observer);
+}
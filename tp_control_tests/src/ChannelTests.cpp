@@ -0,0 +1,87 @@
+#include "Tests.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace tp_control;
+using namespace tp_control_tests;
+
+namespace
+{
+std::atomic<size_t> allocationCount{0};
+}
+
+//##################################################################################################
+// Count allocations so that tests can check that a path does not allocate.
+void* operator new(size_t size)
+{
+  allocationCount++;
+  if(void* p = std::malloc(size?size:1))
+    return p;
+  throw std::bad_alloc();
+}
+
+//##################################################################################################
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+//##################################################################################################
+void operator delete(void* p, size_t) noexcept
+{
+  std::free(p);
+}
+
+//##################################################################################################
+TP_TEST(channelSetFromRawPointerDoesNotAllocate)
+{
+  CoreInterface coreInterface;
+  CoreInterfaceHandle handle = coreInterface.handle("int", "a");
+  coreInterface.setChannelData(handle, new IntData(0));
+
+  size_t allocations=0;
+  for(int i=1; i<=100; i++)
+  {
+    CoreInterfaceData* data = new IntData(i);
+    size_t before = allocationCount;
+    coreInterface.setChannelData(handle, data);
+    allocations += allocationCount-before;
+  }
+
+  TP_CHECK(allocations==0);
+  TP_CHECK(intValue(handle.data())==100);
+  TP_CHECK(handle.version()==101);
+}
+
+//##################################################################################################
+TP_TEST(channelSharedDataOutlivesLaterSets)
+{
+  CoreInterface coreInterface;
+  CoreInterfaceHandle handle = coreInterface.handle("int", "a");
+
+  // Data set from a raw pointer is shared on demand.
+  coreInterface.setChannelData(handle, new IntData(1));
+  std::shared_ptr<const CoreInterfaceData> first = handle.sharedData();
+  TP_CHECK(first.get()==handle.data());
+  TP_CHECK(handle.sharedData()==first);
+
+  // Data set from a shared_ptr keeps the producer's reference.
+  auto shared = std::make_shared<IntData>(2);
+  coreInterface.setChannelData(handle, shared);
+  TP_CHECK(handle.sharedData()==shared);
+  TP_CHECK(shared.use_count()==2);
+
+  coreInterface.setChannelData(handle, new IntData(3));
+  TP_CHECK(intValue(first.get())==1);
+  TP_CHECK(shared.use_count()==1);
+  TP_CHECK(intValue(handle.data())==3);
+
+  // Equal data is discarded without replacing the current value.
+  const CoreInterfaceData* current = handle.data();
+  coreInterface.setChannelData(handle, new IntData(3));
+  coreInterface.setChannelData(handle, std::make_shared<IntData>(3));
+  TP_CHECK(handle.data()==current);
+  TP_CHECK(handle.version()==3);
+}
@@ -0,0 +1,130 @@
+#include "Tests.h"
+
+#include <chrono>
+
+using namespace tp_control;
+using namespace tp_control_tests;
+
+namespace
+{
+//##################################################################################################
+//! Sum the integer inputs of a derived channel.
+CoreInterfaceData* sum(const std::vector<CoreInterfaceHandle>& inputs)
+{
+  int result=0;
+  for(const auto& input : inputs)
+    result += intValue(input.data());
+  return new IntData(result);
+}
+}
+
+//##################################################################################################
+TP_TEST(derivedComputesDiamondOnce)
+{
+  CoreInterface coreInterface;
+  CoreInterfaceHandle a = coreInterface.handle("int", "a");
+  CoreInterfaceHandle b = coreInterface.handle("int", "b");
+  CoreInterfaceHandle c = coreInterface.handle("int", "c");
+  CoreInterfaceHandle d = coreInterface.handle("int", "d");
+  coreInterface.setChannelData(a, new IntData(1));
+
+  size_t calls=0;
+  auto counted = [&](const std::vector<CoreInterfaceHandle>& inputs)
+  {
+    calls++;
+    return sum(inputs);
+  };
+
+  TP_CHECK(coreInterface.setDerivedChannel(b, {a}, counted));
+  TP_CHECK(coreInterface.setDerivedChannel(c, {a}, counted));
+  TP_CHECK(coreInterface.setDerivedChannel(d, {b, c}, counted));
+
+  // Nothing is computed until it is read.
+  TP_CHECK(calls==0);
+  TP_CHECK(intValue(d.data())==2);
+  TP_CHECK(calls==3);
+  TP_CHECK(intValue(d.data())==2);
+  TP_CHECK(calls==3);
+
+  coreInterface.setChannelData(a, new IntData(5));
+  TP_CHECK(intValue(d.data())==10);
+  TP_CHECK(calls==6);
+
+  // Cycles are rejected.
+  TP_CHECK(!coreInterface.setDerivedChannel(a, {d}, counted));
+}
+
+//##################################################################################################
+TP_TEST(derivedRejectsChangesWhileComputing)
+{
+  CoreInterface coreInterface;
+  CoreInterfaceHandle a = coreInterface.handle("int", "a");
+  CoreInterfaceHandle b = coreInterface.handle("int", "b");
+  CoreInterfaceHandle c = coreInterface.handle("int", "c");
+  coreInterface.setChannelData(a, new IntData(1));
+
+  bool replaced=true;
+  TP_CHECK(coreInterface.setDerivedChannel(b, {a}, [&](const std::vector<CoreInterfaceHandle>& inputs)
+  {
+    // Neither this channel nor the channel reading it can be changed from here.
+    replaced = coreInterface.setDerivedChannel(b, {a}, sum) || coreInterface.setDerivedChannel(c, {a}, sum);
+    coreInterface.removeDerivedChannel(b);
+    coreInterface.removeDerivedChannel(c);
+    return sum(inputs);
+  }));
+  TP_CHECK(coreInterface.setDerivedChannel(c, {b}, sum));
+
+  TP_CHECK(intValue(c.data())==1);
+  TP_CHECK(!replaced);
+
+  // Both are still derived.
+  coreInterface.setChannelData(a, new IntData(2));
+  TP_CHECK(intValue(c.data())==2);
+}
+
+//##################################################################################################
+TP_TEST(derivedFlushVisitsManyChannelsInOrder)
+{
+  CoreInterface coreInterface;
+  CoreInterfaceHandle source = coreInterface.handle("int", "source");
+  coreInterface.setChannelData(source, new IntData(1));
+
+  std::vector<std::string> changed;
+  ChannelChangedCallback callback = [&](const tp_utils::StringID&, const tp_utils::StringID& nameID, const CoreInterfaceData*)
+  {
+    changed.push_back(nameID.toString());
+  };
+
+  // A chain followed by many independent channels, sorting these should take well under a second.
+  CoreInterfaceHandle previous = source;
+  for(int i=0; i<100; i++)
+  {
+    CoreInterfaceHandle next = coreInterface.handle("int", "chain" + std::to_string(i));
+    TP_CHECK(coreInterface.setDerivedChannel(next, {previous}, sum, true));
+    previous = next;
+  }
+
+  size_t count = 20000;
+  for(size_t i=0; i<count; i++)
+    coreInterface.setDerivedChannel(coreInterface.handle("int", "leaf" + std::to_string(i)), {source}, sum, true);
+
+  coreInterface.registerCallback(&callback);
+  auto start = std::chrono::steady_clock::now();
+  coreInterface.flushDerivedChannels();
+  TP_CHECK(std::chrono::steady_clock::now()-start<std::chrono::seconds(1));
+  coreInterface.unregisterCallback(&callback);
+
+  TP_CHECK(changed.size()==count+100);
+  TP_CHECK(intValue(previous.data())==1);
+
+  size_t first=changed.size();
+  size_t last=0;
+  for(size_t i=0; i<changed.size(); i++)
+  {
+    if(changed.at(i)=="chain0")
+      first = i;
+    if(changed.at(i)=="chain99")
+      last = i;
+  }
+  TP_CHECK(first<last);
+}
@@ -0,0 +1,47 @@
+#include "Tests.h"
+
+#include <memory>
+
+using namespace tp_control;
+using namespace tp_control_tests;
+
+//##################################################################################################
+TP_TEST(equalSetsAreSuppressed)
+{
+  CoreInterface coreInterface;
+  CoreInterfaceHandle handle = coreInterface.handle("int", "a");
+
+  std::vector<int> values;
+  ChannelChangedCallback callback = [&](const tp_utils::StringID&, const tp_utils::StringID&, const CoreInterfaceData* data)
+  {
+    values.push_back(intValue(data));
+  };
+  coreInterface.registerCallback(&callback);
+
+  coreInterface.setChannelData(handle, new IntData(1));
+  const CoreInterfaceData* current = handle.data();
+
+  // An equal value runs no callbacks and keeps the data that is already held.
+  coreInterface.setChannelData(handle, new IntData(1));
+  coreInterface.setChannelData(handle, std::make_shared<IntData>(1));
+  TP_CHECK((values==std::vector<int>{1}));
+  TP_CHECK(handle.data()==current);
+  TP_CHECK(handle.version()==1);
+
+  // An unequal value still notifies.
+  coreInterface.setChannelData(handle, new IntData(2));
+  TP_CHECK((values==std::vector<int>{1, 2}));
+  TP_CHECK(handle.data()!=current);
+  TP_CHECK(intValue(handle.data())==2);
+  TP_CHECK(handle.version()==2);
+
+  // Data that does not implement equals() is never suppressed.
+  CoreInterfaceHandle other = coreInterface.handle("other", "b");
+  CoreInterfaceData* first = new CoreInterfaceData();
+  coreInterface.setChannelData(other, first);
+  coreInterface.setChannelData(other, new CoreInterfaceData());
+  TP_CHECK(values.size()==4);
+  TP_CHECK(other.data()!=first);
+
+  coreInterface.unregisterCallback(&callback);
+}
@@ -0,0 +1,170 @@
+#include "Tests.h"
+
+#include "tp_control/CoreInterfaceSeqlockChannel.h"
+
+using namespace tp_control;
+using namespace tp_control_tests;
+
+//##################################################################################################
+TP_TEST(handleDeferredHandlesCompareByName)
+{
+  CoreInterface coreInterface;
+  coreInterface.setDeferChannelCreation(true);
+
+  CoreInterfaceHandle a = coreInterface.handle("int", "a");
+  CoreInterfaceHandle b = coreInterface.handle("int", "b");
+  TP_CHECK(!(a==b));
+  TP_CHECK(a==coreInterface.handle("int", "a"));
+  TP_CHECK(!(a==CoreInterfaceHandle()));
+  TP_CHECK(!(CoreInterfaceHandle()==CoreInterfaceHandle()));
+
+  // Once created the channel matches the handle that was returned before it existed.
+  coreInterface.setChannelData(a, new IntData(1));
+  CoreInterfaceHandle created = coreInterface.handle("int", "a");
+  TP_CHECK(created.data());
+  TP_CHECK(created==a && a==created);
+  TP_CHECK(!(created==b));
+
+  // A seqlock channel sees its own sets.
+  CoreInterfaceSeqlockChannel<int> seqlock(&coreInterface, "int", "c", 5);
+  TP_CHECK(seqlock.read()==5);
+  seqlock.set(6);
+  TP_CHECK(seqlock.read()==6);
+  coreInterface.setChannelData(b, new IntData(7));
+  TP_CHECK(seqlock.read()==6);
+}
+
+//##################################################################################################
+TP_TEST(handleDeferredHandlesAreCreatedWhenConfigured)
+{
+  CoreInterface coreInterface;
+  coreInterface.setDeferChannelCreation(true);
+
+  CoreInterfaceHandle history = coreInterface.handle("int", "history");
+  coreInterface.setHistoryCapacity(history, 4);
+  TP_CHECK(coreInterface.history(coreInterface.findHandle("int", "history")));
+
+  CoreInterfaceHandle input = coreInterface.handle("int", "input");
+  CoreInterfaceHandle derived = coreInterface.handle("int", "derived");
+  TP_CHECK(coreInterface.setDerivedChannel(derived, {input}, [](const std::vector<CoreInterfaceHandle>& inputs)
+  {
+    return new IntData(intValue(inputs.front().data())*2);
+  }));
+  coreInterface.setChannelData(input, new IntData(3));
+  TP_CHECK(intValue(coreInterface.findHandle("int", "derived").data())==6);
+
+  // The task writes through the handle from before the channel existed.
+  CoreInterfaceHandle output = coreInterface.handle("int", "output");
+  CoreInterfaceHandle created = coreInterface.handle("int", "input");
+  ChannelTaskFunction task = [&](CoreInterfaceTaskWrites& writes)
+  {
+    writes.setChannelData(output, new IntData(intValue(created.data())+1));
+  };
+  coreInterface.registerChannelTask(&task, {input}, {output});
+  TP_CHECK(coreInterface.findHandle("int", "output").typeID().isValid());
+
+  coreInterface.setChannelData(input, new IntData(4));
+  TP_CHECK(coreInterface.flushChannelTasks()==1);
+  TP_CHECK(intValue(coreInterface.findHandle("int", "output").data())==5);
+  coreInterface.unregisterChannelTask(&task);
+}
+
+//##################################################################################################
+TP_TEST(handleDeferredHandlesAreRejectedOnceDisabled)
+{
+  CoreInterface coreInterface;
+  coreInterface.setDeferChannelCreation(true);
+  CoreInterfaceHandle a = coreInterface.handle("int", "a");
+  CoreInterfaceHandle b = coreInterface.handle("int", "b");
+  coreInterface.setDeferChannelCreation(false);
+
+  coreInterface.setChannelData(a, new IntData(1));
+  coreInterface.setChannelData(b, std::make_shared<IntData>(2));
+  coreInterface.setHistoryCapacity(a, 4);
+  TP_CHECK(!coreInterface.findHandle("int", "a").typeID().isValid());
+  TP_CHECK(!coreInterface.findHandle("int", "b").typeID().isValid());
+
+  // Handles from handle() work as normal.
+  CoreInterfaceHandle created = coreInterface.handle("int", "a");
+  coreInterface.setChannelData(created, new IntData(3));
+  TP_CHECK(intValue(created.data())==3);
+}
+
+//##################################################################################################
+TP_TEST(handleDataIsNotConst)
+{
+  CoreInterface coreInterface;
+  CoreInterfaceHandle handle = coreInterface.handle("int", "a");
+  coreInterface.setChannelData(handle, new IntData(1));
+
+  // Callers that own the type may cast to the mutable data through the handle.
+  IntData* data = dynamic_cast<IntData*>(handle.data());
+  TP_CHECK(data);
+  if(data)
+    data->value = 2;
+  TP_CHECK(intValue(handle.data())==2);
+}
+
+//##################################################################################################
+TP_TEST(handleCallbackOnlySeesItsChannel)
+{
+  CoreInterface coreInterface;
+  CoreInterfaceHandle a = coreInterface.handle("int", "a");
+  CoreInterfaceHandle b = coreInterface.handle("int", "b");
+
+  // The first callback removes itself and the second, the third must still be called.
+  std::vector<std::string> calls;
+  ChannelChangedCallback first;
+  ChannelChangedCallback second = [&](const tp_utils::StringID&, const tp_utils::StringID&, const CoreInterfaceData*){calls.push_back("second");};
+  ChannelChangedCallback third = [&](const tp_utils::StringID&, const tp_utils::StringID& nameID, const CoreInterfaceData* data)
+  {
+    calls.push_back("third " + nameID.toString() + " " + std::to_string(intValue(data)));
+  };
+  first = [&](const tp_utils::StringID&, const tp_utils::StringID&, const CoreInterfaceData*)
+  {
+    calls.push_back("first");
+    coreInterface.unregisterCallback(&first, a);
+    coreInterface.unregisterCallback(&second, a);
+  };
+  coreInterface.registerCallback(&first, a);
+  coreInterface.registerCallback(&second, a);
+  coreInterface.registerCallback(&third, a);
+
+  coreInterface.setChannelData(b, new IntData(1));
+  TP_CHECK(calls.empty());
+
+  coreInterface.setChannelData(a, new IntData(2));
+  TP_CHECK((calls==std::vector<std::string>{"first", "third a 2"}));
+
+  calls.clear();
+  coreInterface.setChannelData(a, new IntData(3));
+  TP_CHECK((calls==std::vector<std::string>{"third a 3"}));
+
+  calls.clear();
+  coreInterface.unregisterCallback(&third, a);
+  coreInterface.setChannelData(a, new IntData(4));
+  TP_CHECK(calls.empty());
+}
+
+//##################################################################################################
+TP_TEST(handleSeqlockTryRead)
+{
+  CoreInterface coreInterface;
+  CoreInterfaceSeqlockChannel<int> seqlock(&coreInterface, "int", "a", 1);
+
+  int value=0;
+  uint64_t version=0;
+  TP_CHECK(seqlock.tryRead(value, 1, &version));
+  TP_CHECK(value==1 && version==1);
+
+  // Sets from outside the seqlock are seen, through the handle or a fresh one.
+  coreInterface.setChannelData(coreInterface.handle("int", "a"), new IntData(2));
+  TP_CHECK(seqlock.tryRead(value, 1, &version));
+  TP_CHECK(value==2 && version==2);
+  TP_CHECK(seqlock.read(value)==2);
+
+  // No attempts leaves the value untouched.
+  value=0;
+  TP_CHECK(!seqlock.tryRead(value, 0));
+  TP_CHECK(value==0);
+}
@@ -0,0 +1,123 @@
+#include "Tests.h"
+
+#include "tp_control/CoreInterfaceHistory.h"
+
+using namespace tp_control;
+using namespace tp_control_tests;
+
+namespace
+{
+//##################################################################################################
+//! The values of a list of history entries.
+std::vector<int> values(const std::vector<CoreInterfaceHistoryEntry>& entries)
+{
+  std::vector<int> result;
+  for(const auto& e : entries)
+    result.push_back(intValue(e.data.get()));
+  return result;
+}
+
+//##################################################################################################
+//! A history with a value of i*10 at time i*100 for i in [first, last].
+void fill(CoreInterfaceHistory& history, int first, int last)
+{
+  for(int i=first; i<=last; i++)
+    history.append(i*100, std::make_shared<IntData>(i*10));
+}
+}
+
+//##################################################################################################
+TP_TEST(historyWrapsAtCapacity)
+{
+  CoreInterfaceHistory history(4);
+  TP_CHECK(history.capacity()==4);
+  TP_CHECK(history.size()==0);
+
+  fill(history, 1, 3);
+  TP_CHECK(history.size()==3);
+  TP_CHECK(intValue(history.at(0).data.get())==10);
+
+  // Once full each new value replaces the oldest.
+  fill(history, 4, 10);
+  TP_CHECK(history.size()==4);
+  TP_CHECK(history.at(0).timestampNS==700);
+  TP_CHECK((values(history.range(0, 2000))==std::vector<int>{70, 80, 90, 100}));
+  TP_CHECK(intValue(history.at(3).data.get())==100);
+
+  history.clear();
+  TP_CHECK(history.size()==0);
+  TP_CHECK(history.valueAt(1000)==nullptr);
+}
+
+//##################################################################################################
+TP_TEST(historyRangeQuery)
+{
+  CoreInterfaceHistory history(8);
+
+  // Wrap the ring so that the range crosses the end of the storage.
+  fill(history, 1, 11);
+
+  // Both ends are inclusive.
+  TP_CHECK((values(history.range(500, 800))==std::vector<int>{50, 60, 70, 80}));
+  TP_CHECK((values(history.range(450, 850))==std::vector<int>{50, 60, 70, 80}));
+  TP_CHECK((values(history.range(1100, 1100))==std::vector<int>{110}));
+
+  // Ranges outside the entries that are held.
+  TP_CHECK(history.range(0, 350).empty());
+  TP_CHECK(history.range(1200, 1300).empty());
+  TP_CHECK(history.range(800, 500).empty());
+  TP_CHECK(history.range(0, 400).size()==1);
+
+  TP_CHECK(history.lowerBound(0)==0);
+  TP_CHECK(history.lowerBound(450)==1);
+  TP_CHECK(history.lowerBound(1200)==history.size());
+}
+
+//##################################################################################################
+TP_TEST(historyValueAt)
+{
+  CoreInterfaceHistory history(4);
+  TP_CHECK(history.valueAt(0)==nullptr);
+
+  fill(history, 1, 6);
+
+  // Before the oldest entry that is held there is no value.
+  TP_CHECK(history.valueAt(0)==nullptr);
+  TP_CHECK(history.valueAt(299)==nullptr);
+
+  TP_CHECK(intValue(history.valueAt(300).get())==30);
+  TP_CHECK(intValue(history.valueAt(450).get())==40);
+  TP_CHECK(intValue(history.valueAt(600).get())==60);
+  TP_CHECK(intValue(history.valueAt(100000).get())==60);
+}
+
+//##################################################################################################
+TP_TEST(historyRecordsChannelSets)
+{
+  CoreInterface coreInterface;
+  CoreInterfaceHandle handle = coreInterface.handle("int", "a");
+  coreInterface.setHistoryCapacity(handle, 3);
+
+  for(int i=1; i<=5; i++)
+    coreInterface.setChannelData(handle, new IntData(i));
+
+  // Equal values are not set so are not recorded.
+  coreInterface.setChannelData(handle, new IntData(5));
+
+  const CoreInterfaceHistory* history = coreInterface.history(handle);
+  TP_CHECK(history && history->size()==3);
+  if(!history)
+    return;
+
+  TP_CHECK((values(history->range(0, CoreInterfaceHistory::nowNS()))==std::vector<int>{3, 4, 5}));
+  TP_CHECK(history->at(2).data.get()==handle.data());
+  TP_CHECK(intValue(history->valueAt(CoreInterfaceHistory::nowNS()).get())==5);
+
+  // Shrinking keeps the newest entries.
+  coreInterface.setHistoryCapacity(handle, 2);
+  history = coreInterface.history(handle);
+  TP_CHECK((values(history->range(0, CoreInterfaceHistory::nowNS()))==std::vector<int>{4, 5}));
+
+  coreInterface.setHistoryCapacity(handle, 0);
+  TP_CHECK(coreInterface.history(handle)==nullptr);
+}
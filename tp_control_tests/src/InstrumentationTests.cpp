@@ -0,0 +1,241 @@
+#include "Tests.h"
+
+#include "tp_control/CoreInterfaceStats.h"
+#include "tp_control/CoreInterfaceTrace.h"
+#include "tp_control/CoreInterfaceWatchdog.h"
+
+#include <chrono>
+#include <thread>
+
+using namespace tp_control;
+using namespace tp_control_tests;
+
+//##################################################################################################
+TP_TEST(instrumentationCountsSetsAndInvocations)
+{
+  CoreInterface coreInterface;
+
+  ChannelChangedCallback channelCallback = [](const tp_utils::StringID&, const tp_utils::StringID&, const CoreInterfaceData*){};
+  SignalCallback signalCallback = [](const tp_utils::StringID&, const CoreInterfaceData*){};
+  coreInterface.registerCallback(&channelCallback);
+  coreInterface.registerCallback(&signalCallback, "event");
+  coreInterface.setCallbackTag(&channelCallback, "channels");
+
+  CoreInterfaceHandle a = coreInterface.handle("int", "a");
+  CoreInterfaceHandle b = coreInterface.handle("int", "b");
+  coreInterface.setChannelData(a, new IntData(1));
+  coreInterface.setChannelData(a, new IntData(2));
+  coreInterface.setChannelData(a, new IntData(2));
+  coreInterface.setChannelData(b, new IntData(3));
+
+  coreInterface.sendSignal("event", new IntData(4));
+  coreInterface.sendSignal("event", new IntData(4));
+
+  CoreInterfaceStats stats = coreInterface.stats();
+  if(!instrumentationEnabled())
+  {
+    TP_CHECK(stats.channelTypes.empty() && stats.signals.empty() && stats.callbacks.empty());
+    TP_CHECK(stats.saveState()["instrumentationEnabled"]==false);
+  }
+  else
+  {
+    const ChannelStats& type = stats.channelTypes["int"];
+    TP_CHECK(type.setCount==3);
+    TP_CHECK(type.suppressedCount==1);
+    TP_CHECK(type.dispatch.count==3);
+    TP_CHECK(stats.channels["int"]["a"].setCount==2);
+    TP_CHECK(stats.channels["int"]["b"].setCount==1);
+
+    TP_CHECK(stats.signals["event"].sendCount==2);
+    TP_CHECK(stats.signals["event"].callbackInvocations==2);
+
+    TP_CHECK(stats.callbacks[&channelCallback].invocations==3);
+    TP_CHECK(stats.callbacks[&channelCallback].tag=="channels");
+    TP_CHECK(stats.callbacks[&channelCallback].latency.count==3);
+    TP_CHECK(stats.callbacks[&signalCallback].invocations==2);
+
+    // The JSON dump holds the same counts.
+    nlohmann::json j = stats.saveState();
+    TP_CHECK(j["instrumentationEnabled"]==true);
+    TP_CHECK(j["channelTypes"]["int"]["setCount"]==3);
+    TP_CHECK(j["channelTypes"]["int"]["suppressedCount"]==1);
+    TP_CHECK(j["channels"]["int"]["a"]["setCount"]==2);
+    TP_CHECK(j["signals"]["event"]["sendCount"]==2);
+    TP_CHECK(j["signals"]["event"]["dispatch"]["count"]==2);
+
+    size_t tagged=0;
+    for(const auto& c : j["callbacks"])
+      if(c.value("tag", "")=="channels" && c.value("invocations", 0)==3)
+        tagged++;
+    TP_CHECK(tagged==1);
+
+    // Counting starts again from zero after a reset.
+    coreInterface.resetStats();
+    coreInterface.setChannelData(a, new IntData(5));
+    stats = coreInterface.stats();
+    TP_CHECK(stats.channelTypes["int"].setCount==1);
+    TP_CHECK(stats.channels["int"]["a"].setCount==1);
+    TP_CHECK(stats.channels["int"]["b"].setCount==0);
+    TP_CHECK(stats.signals.empty());
+    TP_CHECK(stats.callbacks[&channelCallback].invocations==1);
+  }
+
+  coreInterface.unregisterCallback(&channelCallback);
+  coreInterface.unregisterCallback(&signalCallback, "event");
+}
+
+//##################################################################################################
+TP_TEST(instrumentationTraceHasMatchingBeginAndEnd)
+{
+  CoreInterface coreInterface;
+  CoreInterfaceHandle a = coreInterface.handle("int", "a");
+  CoreInterfaceHandle b = coreInterface.handle("int", "b");
+
+  // Nested dispatch, a change to a sets b and sends a signal from inside the callback.
+  ChannelChangedCallback channelCallback = [&](const tp_utils::StringID&, const tp_utils::StringID& nameID, const CoreInterfaceData*)
+  {
+    if(nameID==tp_utils::StringID("a"))
+    {
+      coreInterface.setChannelData(b, new IntData(intValue(a.data())));
+      coreInterface.sendSignal("event", new IntData(1));
+    }
+  };
+  SignalCallback signalCallback = [](const tp_utils::StringID&, const CoreInterfaceData*){};
+  coreInterface.registerCallback(&channelCallback);
+  coreInterface.registerCallback(&signalCallback, "event");
+  coreInterface.setCallbackTag(&channelCallback, "nested");
+
+  CoreInterfaceTrace::start();
+  for(int i=1; i<=3; i++)
+    coreInterface.setChannelData(a, new IntData(i));
+  CoreInterfaceTrace::stop();
+
+  nlohmann::json trace = CoreInterfaceTrace::saveChromeTrace(&coreInterface);
+  coreInterface.unregisterCallback(&channelCallback);
+  coreInterface.unregisterCallback(&signalCallback, "event");
+
+  if(!instrumentationEnabled())
+  {
+    TP_CHECK(trace["traceEvents"].empty());
+    return;
+  }
+
+  TP_CHECK(trace["otherData"]["droppedEvents"]==0);
+
+  // Each end closes the most recent open begin with the same name on the same thread.
+  std::unordered_map<int, std::vector<std::string>> open;
+  size_t begins=0;
+  size_t nestedBegins=0;
+  bool matched=true;
+  for(const auto& e : trace["traceEvents"])
+  {
+    std::string name = e.value("name", "") + "/" + e.value("cat", "");
+    std::vector<std::string>& stack = open[e.value("tid", 0)];
+    if(e.value("ph", "")=="B")
+    {
+      stack.push_back(name);
+      begins++;
+      if(e.value("name", "")=="nested")
+        nestedBegins++;
+    }
+    else if(e.value("ph", "")=="E")
+    {
+      if(stack.empty() || stack.back()!=name)
+        matched=false;
+      else
+        stack.pop_back();
+    }
+    else
+      matched=false;
+  }
+
+  for(const auto& i : open)
+    if(!i.second.empty())
+      matched=false;
+
+  TP_CHECK(matched);
+  TP_CHECK(trace["traceEvents"].size()==begins*2);
+
+  // The tagged callback is called for the changes to a and to b.
+  TP_CHECK(nestedBegins==6);
+}
+
+//##################################################################################################
+TP_TEST(watchdogReportsCallbacksOverBudget)
+{
+  CoreInterface coreInterface;
+  CoreInterfaceWatchdog watchdog(&coreInterface);
+  watchdog.setChannelBudget("int", 1000000);
+  watchdog.setSignalBudget("event", 1000000);
+
+  std::vector<SlowCallbackReport> reports;
+  watchdog.setHandler([&](const SlowCallbackReport& report)
+  {
+    reports.push_back(report);
+  });
+
+  ChannelChangedCallback channelCallback = [](const tp_utils::StringID&, const tp_utils::StringID& nameID, const CoreInterfaceData*)
+  {
+    if(nameID==tp_utils::StringID("slow"))
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  };
+  SignalCallback signalCallback = [](const tp_utils::StringID&, const CoreInterfaceData*)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  };
+  coreInterface.registerCallback(&channelCallback);
+  coreInterface.registerCallback(&signalCallback, "event");
+  coreInterface.registerCallback(&signalCallback, "other");
+  coreInterface.setCallbackTag(&channelCallback, "sleeper");
+
+  coreInterface.setChannelData(coreInterface.handle("int", "slow"), new IntData(1));
+  coreInterface.setChannelData(coreInterface.handle("int", "fast"), new IntData(1));
+  coreInterface.setChannelData(coreInterface.handle("int", "slow"), new IntData(2));
+
+  TP_CHECK(reports.size()==2);
+  if(reports.size()==2)
+  {
+    const SlowCallbackReport& report = reports.back();
+    TP_CHECK(report.kind==DispatchKind::Channel);
+    TP_CHECK(report.typeID==tp_utils::StringID("int"));
+    TP_CHECK(report.nameID==tp_utils::StringID("slow"));
+    TP_CHECK(report.tag=="sleeper");
+    TP_CHECK(report.callback==&channelCallback);
+    TP_CHECK(report.budgetNS==1000000);
+    TP_CHECK(report.durationNS>report.budgetNS);
+    TP_CHECK(reports.front().offenceCount==1);
+    TP_CHECK(report.offenceCount==2);
+    TP_CHECK(report.saveState()["tag"]=="sleeper");
+    TP_CHECK(report.saveState()["nameID"]=="slow");
+  }
+
+  // Types without a budget are not timed.
+  coreInterface.sendSignal("other", new IntData(1));
+  TP_CHECK(reports.size()==2);
+
+  coreInterface.sendSignal("event", new IntData(1));
+  TP_CHECK(reports.size()==3);
+  if(reports.size()==3)
+  {
+    TP_CHECK(reports.back().kind==DispatchKind::Signal);
+    TP_CHECK(reports.back().typeID==tp_utils::StringID("event"));
+    TP_CHECK(!reports.back().nameID.isValid());
+  }
+
+  // The repeat offender is listed first.
+  std::vector<SlowCallbackReport> offenders = watchdog.offenders();
+  TP_CHECK(offenders.size()==2);
+  if(offenders.size()==2)
+  {
+    TP_CHECK(offenders.front().callback==&channelCallback);
+    TP_CHECK(offenders.front().offenceCount==2);
+    TP_CHECK(offenders.back().offenceCount==1);
+  }
+
+  watchdog.clearOffenders();
+  TP_CHECK(watchdog.offenders().empty());
+
+  coreInterface.unregisterCallback(&channelCallback);
+  coreInterface.unregisterCallback(&signalCallback, "event");
+  coreInterface.unregisterCallback(&signalCallback, "other");
+}
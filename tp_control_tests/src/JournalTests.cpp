@@ -0,0 +1,305 @@
+#include "Tests.h"
+
+#include "tp_control/CoreInterfaceJournal.h"
+#include "tp_control/CoreInterfaceCodecs.h"
+#include "tp_control/MappedFile.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+using namespace tp_control;
+using namespace tp_control_tests;
+
+namespace
+{
+//##################################################################################################
+//! Copy the files of an open journal, as a crash would leave them on disk.
+void copyJournal(const std::string& from, const std::string& to)
+{
+  for(const char* suffix : {".checkpoint", ".journal"})
+    std::filesystem::copy_file(from + suffix, to + suffix, std::filesystem::copy_options::overwrite_existing);
+}
+}
+
+//##################################################################################################
+TP_TEST(journalRecoversAfterCrash)
+{
+  CoreInterfaceCodecs codecs;
+  addIntCodec(codecs, "int");
+  std::string path = tempPath("journal_live");
+  std::string crashPath = tempPath("journal_crash");
+
+  CoreInterface coreInterface;
+  coreInterface.setChannelData(coreInterface.handle("int", "a"), new IntData(1));
+
+  CoreInterfaceJournal journal(&coreInterface, &codecs);
+  TP_CHECK(journal.open(path));
+
+  // Changes after the checkpoint are only in the journal.
+  coreInterface.setChannelData(coreInterface.handle("int", "a"), new IntData(2));
+  coreInterface.setChannelData(coreInterface.handle("int", "b"), new IntData(3));
+  coreInterface.setChannelData(coreInterface.handle("opaque", "c"), new IntData(4));
+  TP_CHECK(journal.sync());
+
+  // The files are copied while the journal is still open, the way a crash would leave them.
+  copyJournal(path, crashPath);
+
+  CoreInterface recovered;
+  CoreInterfaceJournal recoveredJournal(&recovered, &codecs);
+  TP_CHECK(recoveredJournal.recover(crashPath)==3);
+  TP_CHECK(intValue(recovered.findHandle("int", "a").data())==2);
+  TP_CHECK(intValue(recovered.findHandle("int", "b").data())==3);
+  TP_CHECK(!recovered.findHandle("opaque", "c").typeID().isValid());
+}
+
+//##################################################################################################
+TP_TEST(journalIgnoresTornRecord)
+{
+  CoreInterfaceCodecs codecs;
+  addIntCodec(codecs, "int");
+  std::string path = tempPath("journal_torn_live");
+  std::string crashPath = tempPath("journal_torn");
+
+  CoreInterface coreInterface;
+  CoreInterfaceJournal journal(&coreInterface, &codecs);
+  TP_CHECK(journal.open(path));
+
+  CoreInterfaceHandle a = coreInterface.handle("int", "a");
+  coreInterface.setChannelData(a, new IntData(1));
+  coreInterface.setChannelData(a, new IntData(2));
+  size_t bytes = journal.journalBytes();
+  copyJournal(path, crashPath);
+
+  // Cut into the payload of the last record, past its padding, as if the machine went down part way
+  // through writing it.
+  std::filesystem::resize_file(crashPath + ".journal", bytes-6);
+
+  CoreInterface recovered;
+  CoreInterfaceJournal recoveredJournal(&recovered, &codecs);
+  TP_CHECK(recoveredJournal.recover(crashPath)==1);
+  TP_CHECK(intValue(recovered.findHandle("int", "a").data())==1);
+
+  // A journal that is not a journal is ignored.
+  {
+    std::ofstream out(crashPath + ".journal", std::ios::binary|std::ios::trunc);
+    out << "garbage";
+  }
+  CoreInterface empty;
+  CoreInterfaceJournal emptyJournal(&empty, &codecs);
+  TP_CHECK(emptyJournal.recover(crashPath)==0);
+}
+
+//##################################################################################################
+TP_TEST(journalStopsAtCorruptRecord)
+{
+  CoreInterfaceCodecs codecs;
+  addIntCodec(codecs, "int");
+  std::string path = tempPath("journal_crc_live");
+  std::string crashPath = tempPath("journal_crc");
+
+  CoreInterface coreInterface;
+  CoreInterfaceJournal journal(&coreInterface, &codecs);
+  TP_CHECK(journal.open(path));
+
+  CoreInterfaceHandle a = coreInterface.handle("int", "a");
+  CoreInterfaceHandle b = coreInterface.handle("int", "b");
+  coreInterface.setChannelData(a, new IntData(1));
+  coreInterface.setChannelData(b, new IntData(2));
+  coreInterface.setChannelData(a, new IntData(3));
+  size_t bytes = journal.journalBytes();
+  TP_CHECK(journal.sync());
+  copyJournal(path, crashPath);
+
+  // Flip a bit in the payload of the last record, its padding is the last 4 bytes.
+  {
+    MappedFile file;
+    TP_CHECK(file.open(crashPath + ".journal", MappedFile::Mode::ReadWrite));
+    TP_CHECK(file.size()>=bytes);
+    file.data()[bytes-8] ^= 0x01;
+  }
+
+  CoreInterface recovered;
+  CoreInterfaceJournal recoveredJournal(&recovered, &codecs);
+  TP_CHECK(recoveredJournal.recover(crashPath)==2);
+  TP_CHECK(intValue(recovered.findHandle("int", "a").data())==1);
+  TP_CHECK(intValue(recovered.findHandle("int", "b").data())==2);
+}
+
+//##################################################################################################
+TP_TEST(journalCompactsAndRecovers)
+{
+  CoreInterfaceCodecs codecs;
+  addIntCodec(codecs, "int");
+  std::string path = tempPath("journal_compact");
+
+  {
+    CoreInterface coreInterface;
+    CoreInterfaceJournal journal(&coreInterface, &codecs);
+    TP_CHECK(journal.open(path, 4096));
+
+    // Setting a channel only marks compaction as due, it is done by compact().
+    CoreInterfaceHandle a = coreInterface.handle("int", "a");
+    for(int i=0; i<1000; i++)
+      coreInterface.setChannelData(a, new IntData(i));
+    TP_CHECK(journal.compactionDue());
+    TP_CHECK(journal.journalBytes()>4096);
+    TP_CHECK(journal.compact());
+    TP_CHECK(!journal.compactionDue());
+    TP_CHECK(!journal.compact());
+
+    // Calling compact() regularly, as an owner loop would.
+    for(int i=1000; i<10000; i++)
+    {
+      coreInterface.setChannelData(a, new IntData(i));
+      journal.compact();
+    }
+    coreInterface.setChannelData(coreInterface.handle("int", "b"), new IntData(7));
+
+    // The journal was compacted into the checkpoint rather than growing to hold every change.
+    TP_CHECK(journal.journalBytes()<8192);
+  }
+
+  // A temporary file left by a crash during compaction does not affect recovery.
+  {
+    std::ofstream out(path + ".checkpoint.tmp", std::ios::binary|std::ios::trunc);
+    out << "partial";
+  }
+
+  CoreInterface recovered;
+  CoreInterfaceJournal journal(&recovered, &codecs);
+  TP_CHECK(journal.recover(path)>=2);
+  TP_CHECK(intValue(recovered.findHandle("int", "a").data())==9999);
+  TP_CHECK(intValue(recovered.findHandle("int", "b").data())==7);
+  std::filesystem::remove(path + ".checkpoint.tmp");
+}
+
+//##################################################################################################
+TP_TEST(checkpointDeltasMergeIntoCheckpoint)
+{
+  CoreInterfaceCodecs codecs;
+  addIntCodec(codecs, "int");
+  std::string base = tempPath("delta_base");
+  std::string delta1 = tempPath("delta_1");
+  std::string delta2 = tempPath("delta_2");
+  std::string merged = tempPath("delta_merged");
+
+  CoreInterface coreInterface;
+  coreInterface.setDirtyTracking(true);
+  coreInterface.setChannelData(coreInterface.handle("int", "a"), new IntData(1));
+  coreInterface.setChannelData(coreInterface.handle("int", "b"), new IntData(2));
+  TP_CHECK(writeCheckpoint(&coreInterface, &codecs, base));
+  TP_CHECK(coreInterface.dirtyChannels().empty());
+
+  coreInterface.setChannelData(coreInterface.handle("int", "a"), new IntData(10));
+  TP_CHECK(coreInterface.dirtyChannels().size()==1);
+  TP_CHECK(writeCheckpointDelta(&coreInterface, &codecs, delta1));
+
+  coreInterface.setChannelData(coreInterface.handle("int", "a"), new IntData(20));
+  coreInterface.setChannelData(coreInterface.handle("int", "c"), new IntData(30));
+  TP_CHECK(writeCheckpointDelta(&coreInterface, &codecs, delta2));
+  TP_CHECK(coreInterface.dirtyChannels().empty());
+
+  // A delta only holds the channels that changed.
+  {
+    CoreInterface partial;
+    TP_CHECK(loadCheckpoint(&partial, &codecs, delta1)==1);
+  }
+
+  TP_CHECK(mergeCheckpointDeltas(base, {delta1, delta2}, merged));
+
+  CoreInterface loaded;
+  TP_CHECK(loadCheckpoint(&loaded, &codecs, merged)==3);
+  TP_CHECK(intValue(loaded.findHandle("int", "a").data())==20);
+  TP_CHECK(intValue(loaded.findHandle("int", "b").data())==2);
+  TP_CHECK(intValue(loaded.findHandle("int", "c").data())==30);
+
+  // Merging into the base in place.
+  TP_CHECK(mergeCheckpointDeltas(base, {delta1, delta2}, base));
+  CoreInterface inPlace;
+  TP_CHECK(loadCheckpoint(&inPlace, &codecs, base)==3);
+  TP_CHECK(intValue(inPlace.findHandle("int", "a").data())==20);
+}
+
+//##################################################################################################
+TP_TEST(lazyCheckpointRebuildsIndexOfReplacedCheckpoint)
+{
+  CoreInterfaceCodecs codecs;
+  addIntCodec(codecs, "int");
+  std::string path = tempPath("lazy_replaced");
+  std::string indexPath = tempPath("lazy_replaced_custom.index");
+
+  CoreInterface coreInterface;
+  coreInterface.setChannelData(coreInterface.handle("int", "a"), new IntData(1));
+  coreInterface.setChannelData(coreInterface.handle("int", "b"), new IntData(2));
+  TP_CHECK(writeCheckpoint(&coreInterface, &codecs, path));
+
+  auto readIndex = [&]
+  {
+    std::ifstream in(indexPath, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  };
+
+  {
+    CoreInterfaceLazyCheckpoint lazy(&codecs);
+    TP_CHECK(lazy.open(path, indexPath));
+    TP_CHECK(lazy.size()==2);
+  }
+  std::string oldIndex = readIndex();
+
+  // Replace the checkpoint with one of exactly the same size, only path.index is removed.
+  coreInterface.setChannelData(coreInterface.handle("int", "a"), new IntData(3));
+  coreInterface.setChannelData(coreInterface.handle("int", "b"), new IntData(4));
+  TP_CHECK(writeCheckpoint(&coreInterface, &codecs, path));
+
+  CoreInterfaceLazyCheckpoint lazy(&codecs);
+  TP_CHECK(lazy.open(path, indexPath));
+  TP_CHECK(readIndex()!=oldIndex);
+
+  CoreInterface restored;
+  restored.setStateSource(&lazy);
+  TP_CHECK(restored.unloadedChannelCount()==0);
+  TP_CHECK(intValue(restored.handle("int", "a").data())==3);
+  TP_CHECK(intValue(restored.handle("int", "b").data())==4);
+  TP_CHECK(lazy.find("int", "c")==0);
+  restored.setStateSource(nullptr);
+}
+
+//##################################################################################################
+TP_TEST(lazyCheckpointRebuildsCorruptIndex)
+{
+  CoreInterfaceCodecs codecs;
+  addIntCodec(codecs, "int");
+  std::string path = tempPath("lazy_corrupt");
+
+  CoreInterface coreInterface;
+  for(int i=0; i<100; i++)
+    coreInterface.setChannelData(coreInterface.handle("int", "c" + std::to_string(i)), new IntData(i));
+  TP_CHECK(writeCheckpoint(&coreInterface, &codecs, path));
+
+  {
+    CoreInterfaceLazyCheckpoint lazy(&codecs);
+    TP_CHECK(lazy.open(path));
+  }
+
+  // Point every entry past the end of the checkpoint, leaving the header intact.
+  {
+    MappedFile index;
+    TP_CHECK(index.open(path + ".index", MappedFile::Mode::ReadWrite));
+    size_t headerSize = 56;
+    TP_CHECK(index.size()>headerSize);
+    memset(index.data()+headerSize, 0x7F, index.size()-headerSize);
+  }
+
+  CoreInterfaceLazyCheckpoint lazy(&codecs);
+  TP_CHECK(lazy.open(path));
+  uint64_t token = lazy.find("int", "c42");
+  TP_CHECK(token!=0);
+
+  std::unique_ptr<CoreInterfaceData> data(lazy.load("int", token));
+  TP_CHECK(intValue(data.get())==42);
+
+  // Tokens that don't point at a channel record are refused.
+  TP_CHECK(lazy.load("int", 1)==nullptr);
+  TP_CHECK(lazy.load("int", uint64_t(1)<<40)==nullptr);
+}
@@ -0,0 +1,220 @@
+#include "Tests.h"
+
+using namespace tp_control;
+using namespace tp_control_tests;
+
+namespace
+{
+// Long enough that the real clock does not reach a deadline while a test runs, the tests step
+// time forward with serviceTimers(nowNS).
+const int64_t interval = 1000000000;
+
+//##################################################################################################
+//! A rate limited channel callback that records the values it is called with
+struct Recorder
+{
+  CoreInterface& coreInterface;
+  std::vector<int> values;
+  ChannelChangedCallback callback;
+
+  //################################################################################################
+  Recorder(CoreInterface& coreInterface_, const RateLimit& rateLimit):
+    coreInterface(coreInterface_)
+  {
+    callback = [&](const tp_utils::StringID&, const tp_utils::StringID&, const CoreInterfaceData* data)
+    {
+      values.push_back(intValue(data));
+    };
+    coreInterface.registerCallback(&callback, rateLimit);
+  }
+
+  //################################################################################################
+  ~Recorder()
+  {
+    coreInterface.unregisterCallback(&callback);
+  }
+};
+
+//##################################################################################################
+RateLimit rateLimit(RateLimit::Mode mode, bool leading, bool trailing)
+{
+  RateLimit r;
+  r.mode = mode;
+  r.intervalNS = interval;
+  r.leading = leading;
+  r.trailing = trailing;
+  return r;
+}
+}
+
+//##################################################################################################
+TP_TEST(rateLimitThrottleLeadingAndTrailing)
+{
+  CoreInterface coreInterface;
+  int64_t t0 = CoreInterface::nowNS();
+  Recorder recorder(coreInterface, rateLimit(RateLimit::Mode::Throttle, true, true));
+  CoreInterfaceHandle a = coreInterface.handle("int", "a");
+
+  // The first change is delivered straight away, the last of the rest when the interval ends.
+  for(int i=1; i<=3; i++)
+    coreInterface.setChannelData(a, new IntData(i));
+  TP_CHECK((recorder.values==std::vector<int>{1}));
+
+  coreInterface.serviceTimers(t0+interval/2);
+  TP_CHECK((recorder.values==std::vector<int>{1}));
+
+  coreInterface.serviceTimers(t0+interval*3/2);
+  TP_CHECK((recorder.values==std::vector<int>{1, 3}));
+
+  // Delivering the trailing change started a new interval.
+  coreInterface.setChannelData(a, new IntData(4));
+  TP_CHECK((recorder.values==std::vector<int>{1, 3}));
+  coreInterface.serviceTimers(t0+interval*11/4);
+  TP_CHECK((recorder.values==std::vector<int>{1, 3, 4}));
+
+  // An interval with nothing pending closes the window, the next change is a leading edge.
+  coreInterface.serviceTimers(t0+interval*4);
+  coreInterface.setChannelData(a, new IntData(5));
+  TP_CHECK((recorder.values==std::vector<int>{1, 3, 4, 5}));
+}
+
+//##################################################################################################
+TP_TEST(rateLimitThrottleLeadingOnly)
+{
+  CoreInterface coreInterface;
+  int64_t t0 = CoreInterface::nowNS();
+  Recorder recorder(coreInterface, rateLimit(RateLimit::Mode::Throttle, true, false));
+  CoreInterfaceHandle a = coreInterface.handle("int", "a");
+  CoreInterfaceHandle b = coreInterface.handle("int", "b");
+
+  coreInterface.setChannelData(a, new IntData(1));
+  coreInterface.setChannelData(a, new IntData(2));
+
+  // Each channel is limited separately.
+  coreInterface.setChannelData(b, new IntData(10));
+  TP_CHECK((recorder.values==std::vector<int>{1, 10}));
+
+  // The suppressed change is dropped.
+  coreInterface.serviceTimers(t0+interval*2);
+  TP_CHECK((recorder.values==std::vector<int>{1, 10}));
+
+  coreInterface.setChannelData(a, new IntData(3));
+  TP_CHECK((recorder.values==std::vector<int>{1, 10, 3}));
+}
+
+//##################################################################################################
+TP_TEST(rateLimitDebounceTrailing)
+{
+  CoreInterface coreInterface;
+  int64_t t0 = CoreInterface::nowNS();
+  Recorder recorder(coreInterface, rateLimit(RateLimit::Mode::Debounce, false, true));
+  CoreInterfaceHandle a = coreInterface.handle("int", "a");
+
+  coreInterface.setChannelData(a, new IntData(1));
+  TP_CHECK(recorder.values.empty());
+
+  // Each change restarts the interval.
+  coreInterface.serviceTimers(t0+interval/2);
+  coreInterface.setChannelData(a, new IntData(2));
+  coreInterface.serviceTimers(t0+interval*6/5);
+  TP_CHECK(recorder.values.empty());
+
+  coreInterface.serviceTimers(t0+interval*8/5);
+  TP_CHECK((recorder.values==std::vector<int>{2}));
+
+  // The burst is over, nothing more is delivered.
+  coreInterface.serviceTimers(t0+interval*4);
+  TP_CHECK((recorder.values==std::vector<int>{2}));
+}
+
+//##################################################################################################
+TP_TEST(rateLimitSignalTrailingKeepsPayload)
+{
+  CoreInterface coreInterface;
+  int64_t t0 = CoreInterface::nowNS();
+
+  std::vector<int> values;
+  SignalCallback callback = [&](const tp_utils::StringID&, const CoreInterfaceData* data)
+  {
+    values.push_back(intValue(data));
+  };
+  coreInterface.registerCallback(&callback, "event", rateLimit(RateLimit::Mode::Throttle, true, true));
+
+  for(int i=1; i<=3; i++)
+    coreInterface.sendSignal("event", new IntData(i));
+  TP_CHECK((values==std::vector<int>{1}));
+
+  // The trailing call gets a copy of the last payload, the original was deleted by sendSignal().
+  coreInterface.serviceTimers(t0+interval*3/2);
+  TP_CHECK((values==std::vector<int>{1, 3}));
+
+  coreInterface.unregisterCallback(&callback, "event");
+}
+
+//##################################################################################################
+TP_TEST(rateLimitUnregisterWithTimerPending)
+{
+  CoreInterface coreInterface;
+  int64_t t0 = CoreInterface::nowNS();
+  CoreInterfaceHandle a = coreInterface.handle("int", "a");
+
+  std::vector<int> values;
+  ChannelChangedCallback callback = [&](const tp_utils::StringID&, const tp_utils::StringID&, const CoreInterfaceData* data)
+  {
+    values.push_back(intValue(data));
+  };
+  coreInterface.registerCallback(&callback, rateLimit(RateLimit::Mode::Throttle, true, true));
+
+  coreInterface.setChannelData(a, new IntData(1));
+  coreInterface.setChannelData(a, new IntData(2));
+  coreInterface.unregisterCallback(&callback);
+
+  // The pending trailing call is cancelled with the callback.
+  TP_CHECK(coreInterface.serviceTimers(t0+interval*2)==0);
+  TP_CHECK((values==std::vector<int>{1}));
+}
+
+//##################################################################################################
+TP_TEST(rateLimitUnregisterDuringDispatch)
+{
+  CoreInterface coreInterface;
+  CoreInterfaceHandle a = coreInterface.handle("int", "a");
+  RateLimit limit = rateLimit(RateLimit::Mode::Throttle, true, false);
+
+  // The second callback removes the first, the third must still be called.
+  std::vector<std::string> calls;
+  ChannelChangedCallback first = [&](const tp_utils::StringID&, const tp_utils::StringID&, const CoreInterfaceData*){calls.push_back("first");};
+  ChannelChangedCallback second = [&](const tp_utils::StringID&, const tp_utils::StringID&, const CoreInterfaceData*)
+  {
+    calls.push_back("second");
+    coreInterface.unregisterCallback(&first);
+  };
+  ChannelChangedCallback third = [&](const tp_utils::StringID&, const tp_utils::StringID&, const CoreInterfaceData*){calls.push_back("third");};
+  coreInterface.registerCallback(&first, limit);
+  coreInterface.registerCallback(&second, limit);
+  coreInterface.registerCallback(&third, limit);
+
+  coreInterface.setChannelData(a, new IntData(1));
+  TP_CHECK((calls==std::vector<std::string>{"first", "second", "third"}));
+
+  // The same for signals.
+  calls.clear();
+  SignalCallback signalFirst = [&](const tp_utils::StringID&, const CoreInterfaceData*){calls.push_back("first");};
+  SignalCallback signalSecond = [&](const tp_utils::StringID&, const CoreInterfaceData*)
+  {
+    calls.push_back("second");
+    coreInterface.unregisterCallback(&signalFirst, "event");
+  };
+  SignalCallback signalThird = [&](const tp_utils::StringID&, const CoreInterfaceData*){calls.push_back("third");};
+  coreInterface.registerCallback(&signalFirst, "event", limit);
+  coreInterface.registerCallback(&signalSecond, "event", limit);
+  coreInterface.registerCallback(&signalThird, "event", limit);
+
+  coreInterface.sendSignal("event", nullptr);
+  TP_CHECK((calls==std::vector<std::string>{"first", "second", "third"}));
+
+  coreInterface.unregisterCallback(&second);
+  coreInterface.unregisterCallback(&third);
+  coreInterface.unregisterCallback(&signalSecond, "event");
+  coreInterface.unregisterCallback(&signalThird, "event");
+}
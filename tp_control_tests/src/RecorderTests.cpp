@@ -0,0 +1,296 @@
+#include "Tests.h"
+
+#include "tp_control/CoreInterfaceRecorder.h"
+#include "tp_control/CoreInterfaceCodecs.h"
+#include "tp_control/MappedFile.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+using namespace tp_control;
+using namespace tp_control_tests;
+
+namespace
+{
+//##################################################################################################
+//! Records the values that a fresh interface receives during a replay.
+struct Subscriber
+{
+  CoreInterface* coreInterface;
+  tp_utils::StringID signalTypeID;
+  std::vector<int> channelValues;
+  std::vector<int> signalValues;
+  std::vector<std::string> order;
+
+  ChannelChangedCallback channelCallback = [&](const tp_utils::StringID&, const tp_utils::StringID& nameID, const CoreInterfaceData* data)
+  {
+    channelValues.push_back(intValue(data));
+    order.push_back("set " + nameID.toString());
+  };
+
+  SignalCallback signalCallback = [&](const tp_utils::StringID& typeID, const CoreInterfaceData* data)
+  {
+    signalValues.push_back(intValue(data));
+    order.push_back("signal " + typeID.toString());
+  };
+
+  Subscriber(CoreInterface* coreInterface_, const tp_utils::StringID& signalTypeID_):
+    coreInterface(coreInterface_),
+    signalTypeID(signalTypeID_)
+  {
+    coreInterface->registerCallback(&channelCallback);
+    coreInterface->registerCallback(&signalCallback, signalTypeID);
+  }
+
+  ~Subscriber()
+  {
+    coreInterface->unregisterCallback(&channelCallback);
+    coreInterface->unregisterCallback(&signalCallback, signalTypeID);
+  }
+};
+
+//##################################################################################################
+//! The offset of the nth record of a kind in a log, or 0. This follows the recorder's layout of an 8
+//! byte magic then 8 byte aligned records with a 24 byte header: kind, flags, reserved, size,
+//! timestamp, type index, name index.
+size_t findRecord(const MappedFile& file, uint8_t kind, size_t n=0)
+{
+  size_t offset = 8;
+  while(offset+24<=file.size() && file.data()[offset])
+  {
+    uint32_t size;
+    memcpy(&size, file.data()+offset+4, 4);
+    if(uint8_t(file.data()[offset])==kind && n--==0)
+      return offset;
+    offset += 24 + ((size+7)&~size_t(7));
+  }
+  return 0;
+}
+}
+
+//##################################################################################################
+TP_TEST(recorderReplaysEventsInOrder)
+{
+  CoreInterfaceCodecs codecs;
+  addIntCodec(codecs, "int");
+  std::string path = tempPath("recorder_order.log");
+
+  {
+    CoreInterface coreInterface;
+    CoreInterfaceRecorder recorder(&coreInterface, &codecs);
+    TP_CHECK(recorder.start(path));
+
+    CoreInterfaceHandle a = coreInterface.handle("int", "a");
+    CoreInterfaceHandle b = coreInterface.handle("int", "b");
+    coreInterface.setChannelData(a, new IntData(1));
+    coreInterface.setChannelData(b, new IntData(2));
+
+    coreInterface.sendSignal("int", new IntData(3));
+    coreInterface.setChannelData(a, new IntData(4));
+
+    TP_CHECK(recorder.isRecording());
+    TP_CHECK(recorder.eventCount()==6);
+  }
+
+  CoreInterface target;
+  Subscriber subscriber(&target, "int");
+
+  CoreInterfaceReplayer replayer(&codecs);
+  TP_CHECK(replayer.open(path));
+  TP_CHECK(replayer.replay(&target, 0.0)==6);
+  TP_CHECK(!replayer.isCorrupt());
+
+  TP_CHECK((subscriber.channelValues==std::vector<int>{1, 2, 4}));
+  TP_CHECK((subscriber.signalValues==std::vector<int>{3}));
+  TP_CHECK((subscriber.order==std::vector<std::string>{"set a", "set b", "signal int", "set a"}));
+  TP_CHECK(intValue(target.findHandle("int", "a").data())==4);
+  TP_CHECK(intValue(target.findHandle("int", "b").data())==2);
+}
+
+//##################################################################################################
+TP_TEST(recorderSkipsNestedEventsByDefault)
+{
+  CoreInterfaceCodecs codecs;
+  addIntCodec(codecs, "int");
+  std::string path = tempPath("recorder_nested.log");
+
+  {
+    CoreInterface coreInterface;
+
+    // Each change to a sends a signal from inside the callback.
+    ChannelChangedCallback callback = [&](const tp_utils::StringID&, const tp_utils::StringID&, const CoreInterfaceData*)
+    {
+      coreInterface.sendSignal("int", new IntData(10));
+    };
+    coreInterface.registerCallback(&callback);
+
+    CoreInterfaceRecorder recorder(&coreInterface, &codecs);
+    TP_CHECK(recorder.start(path));
+    coreInterface.setChannelData(coreInterface.handle("int", "a"), new IntData(1));
+    coreInterface.setChannelData(coreInterface.handle("int", "a"), new IntData(2));
+    recorder.stop();
+    TP_CHECK(recorder.eventCount()==5);
+
+    coreInterface.unregisterCallback(&callback);
+  }
+
+  {
+    CoreInterface target;
+    Subscriber subscriber(&target, "int");
+    CoreInterfaceReplayer replayer(&codecs);
+    TP_CHECK(replayer.open(path));
+    TP_CHECK(replayer.replay(&target, 0.0)==3);
+    TP_CHECK((subscriber.channelValues==std::vector<int>{1, 2}));
+    TP_CHECK(subscriber.signalValues.empty());
+  }
+
+  {
+    CoreInterface target;
+    Subscriber subscriber(&target, "int");
+    CoreInterfaceReplayer replayer(&codecs);
+    TP_CHECK(replayer.open(path));
+    TP_CHECK(replayer.replay(&target, 0.0, false)==5);
+    TP_CHECK((subscriber.signalValues==std::vector<int>{10, 10}));
+    TP_CHECK((subscriber.order==std::vector<std::string>{"set a", "signal int", "set a", "signal int"}));
+  }
+}
+
+//##################################################################################################
+TP_TEST(recorderGrowsLogAndHandlesTypesWithoutCodec)
+{
+  CoreInterfaceCodecs codecs;
+  addIntCodec(codecs, "int");
+  std::string path = tempPath("recorder_grow.log");
+
+  size_t count = 10000;
+  {
+    CoreInterface coreInterface;
+    CoreInterfaceRecorder recorder(&coreInterface, &codecs);
+    TP_CHECK(recorder.start(path, 4096));
+
+    CoreInterfaceHandle handle = coreInterface.handle("int", "a");
+    CoreInterfaceHandle opaque = coreInterface.handle("opaque", "b");
+    for(size_t i=0; i<count; i++)
+      coreInterface.setChannelData(handle, new IntData(int(i)));
+    coreInterface.setChannelData(opaque, new IntData(7));
+
+    TP_CHECK(recorder.bytesWritten()>4096);
+  }
+
+  CoreInterface target;
+  Subscriber subscriber(&target, "int");
+  CoreInterfaceReplayer replayer(&codecs);
+  TP_CHECK(replayer.open(path));
+  TP_CHECK(replayer.replay(&target, 0.0)==count+3);
+  TP_CHECK(subscriber.channelValues.size()==count+1);
+  TP_CHECK(subscriber.channelValues.at(count-1)==int(count-1));
+
+  // The opaque type had no codec so it was recorded without its payload.
+  TP_CHECK(subscriber.channelValues.back()==-1);
+  TP_CHECK(target.findHandle("opaque", "b").data()==nullptr);
+}
+
+//##################################################################################################
+TP_TEST(recorderReplaysAtAcceleratedSpeed)
+{
+  CoreInterfaceCodecs codecs;
+  addIntCodec(codecs, "int");
+  std::string path = tempPath("recorder_speed.log");
+
+  {
+    CoreInterface coreInterface;
+    CoreInterfaceRecorder recorder(&coreInterface, &codecs);
+    TP_CHECK(recorder.start(path));
+    CoreInterfaceHandle handle = coreInterface.handle("int", "a");
+    coreInterface.setChannelData(handle, new IntData(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    coreInterface.setChannelData(handle, new IntData(2));
+  }
+
+  CoreInterface target;
+  CoreInterfaceReplayer replayer(&codecs);
+  TP_CHECK(replayer.open(path));
+
+  // The 100ms gap is played back in at least 50ms at twice the speed.
+  auto start = std::chrono::steady_clock::now();
+  TP_CHECK(replayer.replay(&target, 2.0)==3);
+  auto elapsed = std::chrono::steady_clock::now()-start;
+  TP_CHECK(elapsed>=std::chrono::milliseconds(45));
+  TP_CHECK(intValue(target.findHandle("int", "a").data())==2);
+}
+
+//##################################################################################################
+TP_TEST(replayerRejectsOtherFiles)
+{
+  std::string path = tempPath("recorder_other.log");
+  {
+    std::ofstream out(path, std::ios::binary);
+    out << "not a core interface log";
+  }
+
+  CoreInterfaceReplayer replayer;
+  TP_CHECK(!replayer.open(path));
+  TP_CHECK(!replayer.open(tempPath("recorder_missing.log")));
+
+  CoreInterface target;
+  TP_CHECK(replayer.replay(&target, 0.0)==0);
+}
+
+//##################################################################################################
+TP_TEST(replayerStopsAtCorruptRecords)
+{
+  CoreInterfaceCodecs codecs;
+  addIntCodec(codecs, "int");
+  std::string path = tempPath("recorder_corrupt.log");
+
+  // Rewrite a field of a record in a fresh log of two sets, then replay it.
+  auto replayWith = [&](uint8_t kind, size_t n, size_t field, uint32_t value, size_t& played)
+  {
+    {
+      CoreInterface coreInterface;
+      CoreInterfaceRecorder recorder(&coreInterface, &codecs);
+      TP_CHECK(recorder.start(path));
+      coreInterface.setChannelData(coreInterface.handle("int", "a"), new IntData(1));
+      coreInterface.setChannelData(coreInterface.handle("int", "a"), new IntData(2));
+    }
+
+    {
+      MappedFile file;
+      TP_CHECK(file.open(path, MappedFile::Mode::ReadWrite));
+      size_t offset = findRecord(file, kind, n);
+      TP_CHECK(offset!=0);
+      if(field==0)
+        file.data()[offset] = char(value);
+      else
+        memcpy(file.data()+offset+field, &value, 4);
+    }
+
+    CoreInterface target;
+    CoreInterfaceReplayer replayer(&codecs);
+    TP_CHECK(replayer.open(path));
+    played = replayer.replay(&target, 0.0);
+    int result = intValue(target.findHandle("int", "a").data());
+    TP_CHECK(replayer.isCorrupt());
+    return result;
+  };
+
+  size_t played=0;
+
+  // A string index far past the table, this must not grow the table to reach it.
+  TP_CHECK(replayWith(1, 0, 16, 0xFFFFFFF0u, played)==-1);
+  TP_CHECK(played==0);
+
+  // A name index that was never written.
+  TP_CHECK(replayWith(3, 1, 20, 7, played)==1);
+  TP_CHECK(played==2);
+
+  // An unknown kind.
+  TP_CHECK(replayWith(3, 1, 0, 9, played)==1);
+  TP_CHECK(played==2);
+
+  // A size that runs past the end of the file.
+  TP_CHECK(replayWith(3, 0, 4, 0x7FFFFFF0u, played)==-1);
+  TP_CHECK(played==1);
+}
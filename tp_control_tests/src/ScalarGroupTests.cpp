@@ -0,0 +1,90 @@
+#include "Tests.h"
+
+#include "tp_control/ScalarGroup.h"
+
+#include <cmath>
+
+using namespace tp_control;
+using namespace tp_control_tests;
+
+namespace
+{
+//##################################################################################################
+//! Records the indices passed to each call of a scalar group callback.
+struct Listener
+{
+  ScalarGroup* group;
+  std::vector<std::vector<size_t>> calls;
+
+  ScalarGroupChangedCallback callback = [&](const ScalarGroup&, const std::vector<size_t>& changed)
+  {
+    calls.push_back(changed);
+  };
+
+  Listener(ScalarGroup* group_):
+    group(group_)
+  {
+    group->registerCallback(&callback);
+  }
+
+  ~Listener()
+  {
+    group->unregisterCallback(&callback);
+  }
+};
+}
+
+//##################################################################################################
+TP_TEST(scalarGroupBulkComparesWithValueBeforeBatch)
+{
+  ScalarGroup group;
+  TP_CHECK(group.addScalar("a", 1.0)==0);
+  TP_CHECK(group.addScalar("b", 2.0)==1);
+  TP_CHECK(group.addScalar("c", 3.0)==2);
+  TP_CHECK(group.addScalar("a")==0);
+
+  Listener listener(&group);
+
+  // a goes away and comes back, b ends on a new value, c is unchanged.
+  size_t indices[] = {0, 1, 0, 1, 2};
+  double values[] = {5.0, 5.0, 1.0, 6.0, 3.0};
+  TP_CHECK(group.setBulk(indices, values, 5)==1);
+  TP_CHECK((listener.calls==std::vector<std::vector<size_t>>{{1}}));
+  TP_CHECK(group.value(0)==1.0);
+  TP_CHECK(group.value(1)==6.0);
+  TP_CHECK(group.versions()[0]==0);
+  TP_CHECK(group.versions()[1]==1);
+
+  // Nothing changed so the callbacks are not called.
+  TP_CHECK(group.setBulk(indices, values, 5)==0);
+  TP_CHECK(listener.calls.size()==1);
+
+  // Out of range indices are skipped.
+  size_t bad[] = {7, 2};
+  double badValues[] = {1.0, 4.0};
+  TP_CHECK(group.setBulk(bad, badValues, 2)==1);
+  TP_CHECK(group.value(2)==4.0);
+}
+
+//##################################################################################################
+TP_TEST(scalarGroupRangeComparesBitwise)
+{
+  ScalarGroup group;
+  for(int i=0; i<20; i++)
+    group.addScalar("s" + std::to_string(i), std::nan(""));
+
+  Listener listener(&group);
+
+  std::vector<double> frame(20, std::nan(""));
+  frame[3] = 1.0;
+  frame[17] = -0.0;
+  TP_CHECK(group.setRange(0, frame.data(), frame.size())==2);
+  TP_CHECK((listener.calls==std::vector<std::vector<size_t>>{{3, 17}}));
+
+  // -0.0 and 0.0 compare equal but are different values.
+  double zero=0.0;
+  TP_CHECK(group.setRange(17, &zero, 1)==1);
+  TP_CHECK(group.setRange(17, &zero, 1)==0);
+  TP_CHECK(group.setRange(15, frame.data(), 10)==0);
+  TP_CHECK(group.size()==20);
+}
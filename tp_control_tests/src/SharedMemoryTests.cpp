@@ -0,0 +1,132 @@
+#include "Tests.h"
+
+#include "tp_control/CoreInterfaceSharedMemory.h"
+#include "tp_control/CoreInterfaceCodecs.h"
+#include "tp_control/MappedFile.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+
+using namespace tp_control;
+using namespace tp_control_tests;
+
+namespace
+{
+typedef CoreInterfaceSharedMemoryReader::ReadStatus ReadStatus;
+}
+
+//##################################################################################################
+TP_TEST(sharedMemoryMirrorsValues)
+{
+  CoreInterfaceCodecs codecs;
+  addIntCodec(codecs, "int");
+  std::string path = tempPath("shm_values");
+
+  CoreInterface coreInterface;
+  CoreInterfaceHandle a = coreInterface.handle("int", "a");
+  coreInterface.setChannelData(a, new IntData(1));
+
+  CoreInterfaceSharedMemoryMirror mirror(&coreInterface, &codecs);
+  TP_CHECK(mirror.open(path, 16, 64, 16));
+  mirror.addChannelType("int");
+
+  CoreInterfaceSharedMemoryReader reader;
+  TP_CHECK(reader.open(path));
+
+  // Values set before the type was added are published straight away.
+  int slot = reader.findSlot("int", "a");
+  TP_CHECK(slot==0);
+
+  int value=0;
+  uint64_t version=0;
+  TP_CHECK(reader.readValue(slot, value, &version)==ReadStatus::Ok);
+  TP_CHECK(value==1);
+  TP_CHECK(version==1);
+
+  uint64_t cursor=0;
+  std::vector<int> slots;
+  TP_CHECK(reader.pollChanges(cursor, slots));
+  slots.clear();
+
+  coreInterface.setChannelData(a, new IntData(2));
+  coreInterface.setChannelData(coreInterface.handle("int", "b"), new IntData(3));
+  coreInterface.setChannelData(coreInterface.handle("other", "c"), new IntData(4));
+
+  TP_CHECK(reader.pollChanges(cursor, slots));
+  TP_CHECK((slots==std::vector<int>{0, 1}));
+  TP_CHECK(reader.readValue(slot, value)==ReadStatus::Ok && value==2);
+  TP_CHECK(reader.findSlot("int", "b")==1);
+  TP_CHECK(reader.findSlot("other", "c")==-1);
+
+  char small=0;
+  size_t size=0;
+  TP_CHECK(reader.read(slot, &small, 1, size)==ReadStatus::TooLarge);
+  TP_CHECK(size==sizeof(int));
+  TP_CHECK(reader.read(5, &value, sizeof(int), size)==ReadStatus::NoData);
+}
+
+//##################################################################################################
+TP_TEST(sharedMemoryReopenDoesNotTruncateLiveReaders)
+{
+  CoreInterfaceCodecs codecs;
+  addIntCodec(codecs, "int");
+  std::string path = tempPath("shm_reopen");
+
+  CoreInterface coreInterface;
+  coreInterface.setChannelData(coreInterface.handle("int", "a"), new IntData(1));
+
+  CoreInterfaceSharedMemoryMirror mirror(&coreInterface, &codecs);
+  mirror.addChannelType("int");
+  TP_CHECK(mirror.open(path, 1024, 256, 1024));
+  size_t size = std::filesystem::file_size(path);
+
+  CoreInterfaceSharedMemoryReader reader;
+  TP_CHECK(reader.open(path));
+  int slot = reader.findSlot("int", "a");
+  TP_CHECK(slot==0);
+
+  // A smaller region must not shrink the file under the reader.
+  TP_CHECK(mirror.open(path, 4, 16, 4));
+  TP_CHECK(std::filesystem::file_size(path)==size);
+
+  int value=0;
+  TP_CHECK(reader.readValue(slot, value)==ReadStatus::Stale);
+  TP_CHECK(reader.findSlot("int", "a")==-1);
+
+  uint64_t cursor=0;
+  std::vector<int> slots;
+  TP_CHECK(!reader.pollChanges(cursor, slots));
+
+  TP_CHECK(reader.open(path));
+  TP_CHECK(reader.readValue(reader.findSlot("int", "a"), value)==ReadStatus::Ok);
+  TP_CHECK(value==1);
+}
+
+//##################################################################################################
+TP_TEST(sharedMemoryReadGivesUpOnDeadWriter)
+{
+  CoreInterfaceCodecs codecs;
+  addIntCodec(codecs, "int");
+  std::string path = tempPath("shm_dead_writer");
+
+  CoreInterface coreInterface;
+  CoreInterfaceSharedMemoryMirror mirror(&coreInterface, &codecs);
+  TP_CHECK(mirror.open(path, 4, 16, 4));
+  mirror.addChannelType("int");
+  coreInterface.setChannelData(coreInterface.handle("int", "a"), new IntData(1));
+
+  // Leave the sequence of the first slot odd, as a writer that died part way through would. The
+  // slots start at the first 64 byte boundary after the region header.
+  MappedFile file;
+  TP_CHECK(file.open(path, MappedFile::Mode::ReadWrite));
+  reinterpret_cast<std::atomic<uint32_t>*>(file.data()+64)->fetch_add(1);
+
+  CoreInterfaceSharedMemoryReader reader;
+  TP_CHECK(reader.open(path));
+
+  int value=0;
+  auto start = std::chrono::steady_clock::now();
+  TP_CHECK(reader.readValue(0, value)==ReadStatus::Busy);
+  TP_CHECK(std::chrono::steady_clock::now()-start<std::chrono::seconds(5));
+}
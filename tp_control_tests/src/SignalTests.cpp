@@ -0,0 +1,218 @@
+#include "Tests.h"
+
+#include "tp_control/CoreInterfaceStats.h"
+#include "tp_control/WorkStealingPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace tp_control;
+using namespace tp_control_tests;
+
+namespace
+{
+//##################################################################################################
+//! Signal data that counts how many copies are alive
+struct CountedData : public IntData
+{
+  static int alive;
+
+  //################################################################################################
+  CountedData(int value_):
+    IntData(value_)
+  {
+    alive++;
+  }
+
+  //################################################################################################
+  ~CountedData() override
+  {
+    alive--;
+  }
+};
+
+int CountedData::alive=0;
+
+//##################################################################################################
+//! Parallel callbacks that count their calls and record the threads that they were called on
+struct ParallelCallbacks
+{
+  CoreInterface& coreInterface;
+  std::vector<std::unique_ptr<SignalCallback>> callbacks;
+  std::unique_ptr<std::atomic<int>[]> calls;
+  std::vector<std::thread::id> threads;
+  std::mutex threadsMutex;
+
+  //################################################################################################
+  ParallelCallbacks(CoreInterface& coreInterface_, size_t count, int sleepMS):
+    coreInterface(coreInterface_),
+    calls(new std::atomic<int>[count])
+  {
+    for(size_t i=0; i<count; i++)
+    {
+      calls[i] = 0;
+      callbacks.emplace_back(new SignalCallback([this, i, sleepMS](const tp_utils::StringID&, const CoreInterfaceData* data)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(sleepMS));
+        if(intValue(data)==5)
+          calls[i]++;
+
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        threads.push_back(std::this_thread::get_id());
+      }));
+      coreInterface.registerParallelCallback(callbacks.back().get(), "event");
+    }
+  }
+
+  //################################################################################################
+  ~ParallelCallbacks()
+  {
+    for(const auto& callback : callbacks)
+      coreInterface.unregisterCallback(callback.get(), "event");
+  }
+
+  //################################################################################################
+  //! Returns true if every callback has been called count times
+  bool allCalled(int count) const
+  {
+    for(size_t i=0; i<callbacks.size(); i++)
+      if(calls[i]!=count)
+        return false;
+    return true;
+  }
+};
+}
+
+//##################################################################################################
+TP_TEST(signalPayloadsAreOwnedOnEverySendPath)
+{
+  CoreInterface coreInterface;
+
+  std::vector<int> values;
+  SignalCallback callback = [&](const tp_utils::StringID&, const CoreInterfaceData* data)
+  {
+    values.push_back(intValue(data));
+  };
+  coreInterface.registerCallback(&callback, "event");
+
+  // The payload is deleted once the callbacks have returned.
+  coreInterface.sendSignal("event", new CountedData(1));
+  TP_CHECK(CountedData::alive==0);
+
+  // Timed payloads are held until the timer fires or is cancelled.
+  coreInterface.sendSignalAt("event", new CountedData(2), CoreInterface::nowNS()-1);
+  uint64_t cancelled = coreInterface.sendSignalAt("event", new CountedData(3), CoreInterface::nowNS()+1000000000000);
+  TP_CHECK(CountedData::alive==2);
+  TP_CHECK(coreInterface.serviceTimers()==1);
+  TP_CHECK(CountedData::alive==1);
+  TP_CHECK(coreInterface.cancelTimer(cancelled));
+  TP_CHECK(CountedData::alive==0);
+
+  coreInterface.sendSignal("event", nullptr);
+  TP_CHECK((values==std::vector<int>{1, 2, -1}));
+
+  coreInterface.unregisterCallback(&callback, "event");
+}
+
+//##################################################################################################
+TP_TEST(signalParallelCallbacksCompleteBeforeSendReturns)
+{
+  CoreInterface coreInterface;
+  WorkStealingPool pool(4);
+  coreInterface.setSignalPool(&pool);
+
+  ParallelCallbacks parallel(coreInterface, 16, 1);
+
+  // Callbacks that are not parallel are called on the owner thread.
+  std::vector<std::thread::id> threads;
+  SignalCallback callback = [&](const tp_utils::StringID&, const CoreInterfaceData*)
+  {
+    threads.push_back(std::this_thread::get_id());
+  };
+  coreInterface.registerCallback(&callback, "event");
+
+  for(int i=1; i<=3; i++)
+  {
+    coreInterface.sendSignal("event", new IntData(5));
+    TP_CHECK(parallel.allCalled(i));
+  }
+
+  TP_CHECK(threads.size()==3);
+  for(const auto& id : threads)
+    TP_CHECK(id==std::this_thread::get_id());
+
+  coreInterface.unregisterCallback(&callback, "event");
+  coreInterface.setSignalPool(nullptr);
+}
+
+//##################################################################################################
+TP_TEST(signalAsyncCallbacksAreJoinedByWaitForSignals)
+{
+  CoreInterface coreInterface;
+  WorkStealingPool pool(4);
+  coreInterface.setSignalPool(&pool);
+
+  {
+    ParallelCallbacks parallel(coreInterface, 8, 20);
+
+    // The payload is kept alive by the tasks after the caller lets go of it.
+    coreInterface.sendSignalAsync("event", std::make_shared<IntData>(5));
+    coreInterface.sendSignalAsync("event", std::make_shared<IntData>(5));
+    coreInterface.waitForSignals();
+    TP_CHECK(parallel.allCalled(2));
+  }
+
+  coreInterface.setSignalPool(nullptr);
+}
+
+//##################################################################################################
+TP_TEST(signalParallelCallbacksWithoutAPool)
+{
+  CoreInterface coreInterface;
+
+  // Without a pool, or when built with TP_CONTROL_SINGLE_THREADED where the pool is ignored,
+  // parallel callbacks are called one after another on the owner thread.
+  WorkStealingPool pool(4);
+#ifdef TP_CONTROL_SINGLE_THREADED
+  coreInterface.setSignalPool(&pool);
+#endif
+
+  ParallelCallbacks parallel(coreInterface, 8, 0);
+  coreInterface.sendSignal("event", new IntData(5));
+  coreInterface.sendSignalAsync("event", std::make_shared<IntData>(5));
+  TP_CHECK(parallel.allCalled(2));
+
+  TP_CHECK(parallel.threads.size()==16);
+  for(const auto& id : parallel.threads)
+    TP_CHECK(id==std::this_thread::get_id());
+
+  coreInterface.setSignalPool(nullptr);
+}
+
+//##################################################################################################
+TP_TEST(signalCallbackCanUnregisterTheLastSubscriber)
+{
+  CoreInterface coreInterface;
+
+  size_t calls=0;
+  SignalCallback callback = [&](const tp_utils::StringID&, const CoreInterfaceData*)
+  {
+    calls++;
+    coreInterface.unregisterCallback(&callback, "event");
+  };
+  coreInterface.registerCallback(&callback, "event");
+
+  coreInterface.sendSignal("event", new IntData(1));
+  coreInterface.sendSignal("event", new IntData(2));
+  TP_CHECK(calls==1);
+
+  if(instrumentationEnabled())
+  {
+    CoreInterfaceStats stats = coreInterface.stats();
+    TP_CHECK(stats.signals["event"].sendCount==2);
+    TP_CHECK(stats.signals["event"].callbackInvocations==1);
+  }
+}
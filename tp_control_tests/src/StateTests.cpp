@@ -0,0 +1,131 @@
+#include "Tests.h"
+
+#include "tp_control/CoreInterfaceState.h"
+#include "tp_control/CoreInterfaceCodecs.h"
+
+#include <sstream>
+
+using namespace tp_control;
+using namespace tp_control_tests;
+
+namespace
+{
+//##################################################################################################
+//! An interface with a mix of channels that are and are not saved.
+void populate(CoreInterface& coreInterface)
+{
+  for(int i=0; i<100; i++)
+    coreInterface.setChannelData(coreInterface.handle("int", "c" + std::to_string(i)), new IntData(i));
+  coreInterface.setChannelData(coreInterface.handle("int", "null"), nullptr);
+  coreInterface.setChannelData(coreInterface.handle("opaque", "o"), new IntData(7));
+}
+
+//##################################################################################################
+//! Check that an interface holds the channels that populate() saves.
+void checkLoaded(TestContext& tpTestContext, const CoreInterface& coreInterface)
+{
+  bool values=true;
+  for(int i=0; i<100; i++)
+    values = values && intValue(coreInterface.findHandle("int", "c" + std::to_string(i)).data())==i;
+  TP_CHECK(values);
+
+  CoreInterfaceHandle null = coreInterface.findHandle("int", "null");
+  TP_CHECK(null.typeID().isValid());
+  TP_CHECK(null.data()==nullptr);
+  TP_CHECK(!coreInterface.findHandle("opaque", "o").typeID().isValid());
+}
+
+//##################################################################################################
+size_t loadString(CoreInterface& coreInterface, const CoreInterfaceCodecs& codecs, const std::string& state)
+{
+  std::istringstream stream(state);
+  return loadCoreInterfaceState(&coreInterface, &codecs, stream);
+}
+}
+
+//##################################################################################################
+TP_TEST(stateRoundTrips)
+{
+  CoreInterfaceCodecs codecs;
+  addIntCodec(codecs, "int");
+
+  CoreInterface source;
+  populate(source);
+
+  nlohmann::json dom = saveCoreInterfaceState(&source, &codecs);
+  std::ostringstream stream;
+  saveCoreInterfaceState(&source, &codecs, stream);
+
+  // Both writers produce the same document.
+  TP_CHECK(nlohmann::json::parse(stream.str())==dom);
+  TP_CHECK(dom["channels"].size()==101);
+
+  {
+    CoreInterface loaded;
+    TP_CHECK(loadCoreInterfaceState(&loaded, &codecs, dom)==101);
+    checkLoaded(tpTestContext, loaded);
+  }
+
+  {
+    CoreInterface loaded;
+    TP_CHECK(loadString(loaded, codecs, stream.str())==101);
+    checkLoaded(tpTestContext, loaded);
+  }
+
+  // Members other than channels are skipped, including ones that hold channels arrays themselves.
+  {
+    std::string wrapped = R"({"version":2,"other":{"channels":[{"typeID":"int","nameID":"x","data":1}]},"channels":)" + dom["channels"].dump() + R"(,"after":[1,2,{"a":[]}]})";
+    CoreInterface loaded;
+    TP_CHECK(loadString(loaded, codecs, wrapped)==101);
+    checkLoaded(tpTestContext, loaded);
+    TP_CHECK(!loaded.findHandle("int", "x").typeID().isValid());
+  }
+}
+
+//##################################################################################################
+TP_TEST(stateSkipsMalformedInput)
+{
+  CoreInterfaceCodecs codecs;
+  addIntCodec(codecs, "int");
+
+  // Documents that are not states at all.
+  for(const char* state : {"", "not json", "[]", "42", "null", R"({"channels":{}})", R"({"channels":7})"})
+  {
+    CoreInterface loaded;
+    TP_CHECK(loadString(loaded, codecs, state)==0);
+    TP_CHECK(loadCoreInterfaceState(&loaded, &codecs, nlohmann::json::parse(state, nullptr, false))==0);
+    TP_CHECK(loaded.channels().empty());
+  }
+
+  // Elements without a type or name, or that are not objects, are skipped.
+  std::string mixed = R"({"channels":[
+    {"typeID":"int","nameID":"a","data":1},
+    {"nameID":"b","data":2},
+    {"typeID":"int","data":3},
+    {"typeID":5,"nameID":"c","data":4},
+    [1,2,3],
+    "channel",
+    {"typeID":"int","nameID":"d","data":"not an int"},
+    {"typeID":"int","nameID":"e","data":{"nested":[1,{"x":2}]}},
+    {"typeID":"int","nameID":"f","data":6}
+  ]})";
+
+  for(int pass=0; pass<2; pass++)
+  {
+    CoreInterface loaded;
+    size_t count = pass?loadString(loaded, codecs, mixed):loadCoreInterfaceState(&loaded, &codecs, nlohmann::json::parse(mixed));
+    TP_CHECK(count==4);
+    TP_CHECK(intValue(loaded.findHandle("int", "a").data())==1);
+    TP_CHECK(loaded.findHandle("int", "d").data()==nullptr);
+    TP_CHECK(loaded.findHandle("int", "e").data()==nullptr);
+    TP_CHECK(intValue(loaded.findHandle("int", "f").data())==6);
+  }
+
+  // A truncated stream keeps the channels read before the error.
+  {
+    CoreInterface loaded;
+    TP_CHECK(loadString(loaded, codecs, R"({"channels":[{"typeID":"int","nameID":"a","data":1},{"typeID":"int","nameID":"b","da)")==1);
+    TP_CHECK(intValue(loaded.findHandle("int", "a").data())==1);
+    TP_CHECK(!loaded.findHandle("int", "b").typeID().isValid());
+  }
+}
@@ -0,0 +1,271 @@
+#include "Tests.h"
+
+#include "tp_control/WorkStealingPool.h"
+
+#include <memory>
+#include <mutex>
+
+using namespace tp_control;
+using namespace tp_control_tests;
+
+namespace
+{
+//##################################################################################################
+//! A set of tasks that each write the sum of their reads plus one, recording the order they run in.
+struct Graph
+{
+  CoreInterface& coreInterface;
+  std::vector<std::unique_ptr<ChannelTaskFunction>> tasks;
+  std::vector<std::string> order;
+  std::mutex orderMutex;
+
+  //################################################################################################
+  Graph(CoreInterface& coreInterface_):
+    coreInterface(coreInterface_)
+  {
+
+  }
+
+  //################################################################################################
+  ~Graph()
+  {
+    for(const auto& task : tasks)
+      coreInterface.unregisterChannelTask(task.get());
+  }
+
+  //################################################################################################
+  CoreInterfaceHandle channel(const std::string& name)
+  {
+    return coreInterface.handle("int", name);
+  }
+
+  //################################################################################################
+  void add(const std::string& name, const std::vector<std::string>& reads, const std::vector<std::string>& writes)
+  {
+    std::vector<CoreInterfaceHandle> readHandles;
+    for(const auto& r : reads)
+      readHandles.push_back(channel(r));
+
+    std::vector<CoreInterfaceHandle> writeHandles;
+    for(const auto& w : writes)
+      writeHandles.push_back(channel(w));
+
+    tasks.emplace_back(new ChannelTaskFunction([this, name, readHandles, writeHandles](CoreInterfaceTaskWrites& staged)
+    {
+      int sum=1;
+      for(const auto& h : readHandles)
+        sum += std::max(0, intValue(h.data()));
+
+      for(const auto& h : writeHandles)
+        staged.setChannelData(h, new IntData(sum));
+
+      std::lock_guard<std::mutex> lock(orderMutex);
+      order.push_back(name);
+    }));
+
+    coreInterface.registerChannelTask(tasks.back().get(), readHandles, writeHandles);
+  }
+
+  //################################################################################################
+  void set(const std::string& name, int value)
+  {
+    coreInterface.setChannelData(channel(name), new IntData(value));
+  }
+
+  //################################################################################################
+  int value(const std::string& name)
+  {
+    return intValue(channel(name).data());
+  }
+};
+}
+
+//##################################################################################################
+TP_TEST(taskWritersRunBeforeReaders)
+{
+  CoreInterface coreInterface;
+  Graph graph(coreInterface);
+
+  // Registered in reverse so that the order comes from the declared reads and writes.
+  graph.add("c", {"y"}, {"z"});
+  graph.add("b", {"x"}, {"y"});
+  graph.add("a", {"in"}, {"x"});
+
+  graph.set("in", 10);
+  TP_CHECK(coreInterface.flushChannelTasks()==3);
+  TP_CHECK((graph.order==std::vector<std::string>{"a", "b", "c"}));
+  TP_CHECK(graph.value("x")==11);
+  TP_CHECK(graph.value("y")==12);
+  TP_CHECK(graph.value("z")==13);
+
+  // Nothing has changed since the last flush.
+  graph.order.clear();
+  TP_CHECK(coreInterface.flushChannelTasks()==0);
+  TP_CHECK(graph.order.empty());
+
+  // A change part way down the chain only runs the tasks below it.
+  graph.set("x", 20);
+  TP_CHECK(coreInterface.flushChannelTasks()==2);
+  TP_CHECK((graph.order==std::vector<std::string>{"b", "c"}));
+  TP_CHECK(graph.value("z")==22);
+}
+
+//##################################################################################################
+TP_TEST(taskSkipsTasksWhoseReadsDidNotChange)
+{
+  CoreInterface coreInterface;
+  Graph graph(coreInterface);
+
+  // constant writes the same value each time, so the second set is discarded and c is not run.
+  graph.add("b", {"in"}, {});
+  graph.add("unrelated", {"other"}, {"out"});
+
+  ChannelTaskFunction constant = [&](CoreInterfaceTaskWrites& staged)
+  {
+    staged.setChannelData(graph.channel("x"), new IntData(7));
+    graph.order.push_back("constant");
+  };
+  coreInterface.registerChannelTask(&constant, {graph.channel("in")}, {graph.channel("x")});
+  graph.add("c", {"x"}, {"y"});
+
+  graph.set("in", 1);
+  TP_CHECK(coreInterface.flushChannelTasks()==3);
+  TP_CHECK((graph.order==std::vector<std::string>{"b", "constant", "c"}));
+
+  graph.order.clear();
+  graph.set("in", 2);
+  TP_CHECK(coreInterface.flushChannelTasks()==2);
+  TP_CHECK((graph.order==std::vector<std::string>{"b", "constant"}));
+  TP_CHECK(graph.value("out")==-1);
+
+  coreInterface.unregisterChannelTask(&constant);
+}
+
+//##################################################################################################
+TP_TEST(taskWritersOfTheSameChannelRunInRegistrationOrder)
+{
+  CoreInterface coreInterface;
+  Graph graph(coreInterface);
+
+  graph.add("reader", {"shared"}, {"out"});
+  graph.add("first", {"in"}, {"shared"});
+  graph.add("second", {"in", "extra"}, {"shared"});
+
+  graph.set("extra", 100);
+  graph.set("in", 1);
+  TP_CHECK(coreInterface.flushChannelTasks()==3);
+  TP_CHECK((graph.order==std::vector<std::string>{"first", "second", "reader"}));
+
+  // The reader runs once and sees the value from the last writer.
+  TP_CHECK(graph.value("shared")==102);
+  TP_CHECK(graph.value("out")==103);
+}
+
+//##################################################################################################
+TP_TEST(taskCycleIsBrokenInRegistrationOrder)
+{
+  CoreInterface coreInterface;
+  Graph graph(coreInterface);
+
+  graph.add("a", {"x"}, {"y"});
+  graph.add("b", {"y"}, {"x"});
+
+  graph.set("x", 1);
+  TP_CHECK(coreInterface.flushChannelTasks()==2);
+  TP_CHECK((graph.order==std::vector<std::string>{"a", "b"}));
+  TP_CHECK(graph.value("y")==2);
+  TP_CHECK(graph.value("x")==3);
+
+  // The write to x that a missed is picked up by the next flush.
+  graph.order.clear();
+  TP_CHECK(coreInterface.flushChannelTasks()==2);
+  TP_CHECK((graph.order==std::vector<std::string>{"a", "b"}));
+  TP_CHECK(graph.value("y")==4);
+}
+
+//##################################################################################################
+TP_TEST(taskRejectsUndeclaredWrites)
+{
+  CoreInterface coreInterface;
+  CoreInterfaceHandle in = coreInterface.handle("int", "in");
+  CoreInterfaceHandle declared = coreInterface.handle("int", "declared");
+  CoreInterfaceHandle undeclared = coreInterface.handle("int", "undeclared");
+
+  ChannelTaskFunction task = [&](CoreInterfaceTaskWrites& staged)
+  {
+    staged.setChannelData(declared, new IntData(1));
+    staged.setChannelData(undeclared, new IntData(2));
+  };
+  coreInterface.registerChannelTask(&task, {in}, {declared});
+
+  coreInterface.setChannelData(in, new IntData(0));
+  TP_CHECK(coreInterface.flushChannelTasks()==1);
+  TP_CHECK(intValue(declared.data())==1);
+  TP_CHECK(undeclared.data()==nullptr);
+
+  coreInterface.unregisterChannelTask(&task);
+}
+
+//##################################################################################################
+TP_TEST(taskUnregisteredDuringFlushDoesNotRun)
+{
+  CoreInterface coreInterface;
+  Graph graph(coreInterface);
+
+  graph.add("a", {"in"}, {"x"});
+  graph.add("b", {"x"}, {"y"});
+
+  // A channel callback for the first wave removes the task in the second.
+  ChannelTaskFunction* b = graph.tasks.back().get();
+  ChannelChangedCallback callback = [&](const tp_utils::StringID&, const tp_utils::StringID& nameID, const CoreInterfaceData*)
+  {
+    if(nameID==tp_utils::StringID("x"))
+      coreInterface.unregisterChannelTask(b);
+  };
+  coreInterface.registerCallback(&callback);
+
+  graph.set("in", 1);
+  TP_CHECK(coreInterface.flushChannelTasks()==1);
+  TP_CHECK((graph.order==std::vector<std::string>{"a"}));
+  TP_CHECK(graph.value("y")==-1);
+
+  coreInterface.unregisterCallback(&callback);
+}
+
+//##################################################################################################
+TP_TEST(taskResultsDoNotDependOnThePool)
+{
+  // A diamond of independent tasks feeding a single reader, run serially and on a pool.
+  auto run = [](WorkStealingPool* pool)
+  {
+    CoreInterface coreInterface;
+    coreInterface.setSignalPool(pool);
+    Graph graph(coreInterface);
+
+    std::vector<std::string> middle;
+    for(int i=0; i<32; i++)
+    {
+      std::string name = "m" + std::to_string(i);
+      graph.add(name, {"in"}, {name});
+      middle.push_back(name);
+    }
+    graph.add("sum", middle, {"out"});
+
+    std::vector<int> results;
+    for(int i=0; i<10; i++)
+    {
+      graph.set("in", i);
+      results.push_back(int(coreInterface.flushChannelTasks()));
+      results.push_back(graph.value("out"));
+    }
+
+    coreInterface.setSignalPool(nullptr);
+    return results;
+  };
+
+  WorkStealingPool pool(4);
+  std::vector<int> serial = run(nullptr);
+  TP_CHECK(serial.at(0)==33);
+  TP_CHECK(serial.at(1)==1+32*1);
+  TP_CHECK(run(&pool)==serial);
+}
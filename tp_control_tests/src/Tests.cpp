@@ -0,0 +1,86 @@
+#include "Tests.h"
+
+#include "tp_control/CoreInterfaceCodecs.h"
+
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+namespace tp_control_tests
+{
+
+//##################################################################################################
+void TestContext::check(bool ok, const char* expression, const char* file, int line)
+{
+  checks++;
+  if(ok)
+    return;
+
+  failures++;
+  std::cerr << file << ":" << line << ": " << testName << " failed: " << expression << std::endl;
+}
+
+//##################################################################################################
+std::vector<Test>& registeredTests()
+{
+  static std::vector<Test> tests;
+  return tests;
+}
+
+//##################################################################################################
+TestRegistration::TestRegistration(const char* name, const TestFunction& function)
+{
+  registeredTests().push_back({name, function});
+}
+
+//##################################################################################################
+int intValue(const tp_control::CoreInterfaceData* data)
+{
+  auto value = dynamic_cast<const IntData*>(data);
+  return value?value->value:-1;
+}
+
+//##################################################################################################
+void addIntCodec(tp_control::CoreInterfaceCodecs& codecs, const tp_utils::StringID& typeID)
+{
+  tp_control::CoreInterfaceCodec codec;
+
+  codec.encode = [](const tp_control::CoreInterfaceData* data, std::string& result)
+  {
+    int value = intValue(data);
+    result.append(reinterpret_cast<const char*>(&value), sizeof(int));
+  };
+
+  codec.decode = [](const char* encoded, size_t size) -> tp_control::CoreInterfaceData*
+  {
+    if(size!=sizeof(int))
+      return nullptr;
+
+    int value;
+    memcpy(&value, encoded, sizeof(int));
+    return new IntData(value);
+  };
+
+  codec.saveState = [](const tp_control::CoreInterfaceData* data)
+  {
+    return nlohmann::json(intValue(data));
+  };
+
+  codec.loadState = [](const nlohmann::json& j) -> tp_control::CoreInterfaceData*
+  {
+    return j.is_number_integer()?new IntData(j.get<int>()):nullptr;
+  };
+
+  codecs.addCodec(typeID, codec);
+}
+
+//##################################################################################################
+std::string tempPath(const std::string& name)
+{
+  std::filesystem::path path = std::filesystem::temp_directory_path() / ("tp_control_tests_" + name);
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+  return path.string();
+}
+
+}
@@ -0,0 +1,79 @@
+#ifndef tp_control_tests_Tests_h
+#define tp_control_tests_Tests_h
+
+#include "tp_control/CoreInterfaceValue.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace tp_control
+{
+class CoreInterfaceCodecs;
+}
+
+namespace tp_control_tests
+{
+
+//##################################################################################################
+//! Counts the checks made by a test and reports the ones that fail
+struct TestContext
+{
+  std::string testName;
+  size_t checks{0};
+  size_t failures{0};
+
+  //################################################################################################
+  void check(bool ok, const char* expression, const char* file, int line);
+};
+
+//##################################################################################################
+typedef std::function<void(TestContext& tpTestContext)> TestFunction;
+
+//##################################################################################################
+struct Test
+{
+  std::string name;
+  TestFunction function;
+};
+
+//##################################################################################################
+//! The tests in the order that they were registered
+std::vector<Test>& registeredTests();
+
+//##################################################################################################
+//! Adds a test to registeredTests(), use TP_TEST rather than this directly
+struct TestRegistration
+{
+  TestRegistration(const char* name, const TestFunction& function);
+};
+
+//##################################################################################################
+//! The channel and signal data used by the tests
+typedef tp_control::CoreInterfaceValue<int> IntData;
+
+//##################################################################################################
+//! Returns the value of IntData or -1 if data is nullptr
+int intValue(const tp_control::CoreInterfaceData* data);
+
+//##################################################################################################
+//! Add a binary and JSON codec for IntData
+void addIntCodec(tp_control::CoreInterfaceCodecs& codecs, const tp_utils::StringID& typeID);
+
+//##################################################################################################
+//! A path in the temp directory for files written by a test, any existing file is removed
+std::string tempPath(const std::string& name);
+
+}
+
+//##################################################################################################
+#define TP_TEST(name) \
+  static void name(tp_control_tests::TestContext& tpTestContext); \
+  static tp_control_tests::TestRegistration name##Registration(#name, name); \
+  static void name(tp_control_tests::TestContext& tpTestContext)
+
+//##################################################################################################
+#define TP_CHECK(expression) \
+  tpTestContext.check(bool(expression), #expression, __FILE__, __LINE__)
+
+#endif
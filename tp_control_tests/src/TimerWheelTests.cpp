@@ -0,0 +1,105 @@
+#include "Tests.h"
+
+#include "tp_control/TimerWheel.h"
+
+#include <chrono>
+
+using namespace tp_control;
+using namespace tp_control_tests;
+
+//##################################################################################################
+TP_TEST(timerWheelFiresInAddOrderAfterCascade)
+{
+  // One tick per nanosecond so that deadlines are ticks.
+  TimerWheel wheel(0, 1);
+  std::vector<std::string> fired;
+
+  // a is added first but is far enough out to start on level 1, b goes straight into level 0.
+  wheel.add(300, 0, [&]{fired.push_back("a");});
+  TP_CHECK(wheel.advance(100)==0);
+  wheel.add(300, 0, [&]{fired.push_back("b");});
+  wheel.add(299, 0, [&]{fired.push_back("c");});
+
+  TP_CHECK(wheel.advance(299)==1);
+  TP_CHECK(wheel.advance(300)==2);
+  TP_CHECK((fired==std::vector<std::string>{"c", "a", "b"}));
+  TP_CHECK(wheel.size()==0);
+
+  // Deadlines that have passed fire on the next advance, in the order they were added.
+  fired.clear();
+  wheel.add(10, 0, [&]{fired.push_back("d");});
+  wheel.add(400, 0, [&]{fired.push_back("e");});
+  wheel.add(5, 0, [&]{fired.push_back("f");});
+  TP_CHECK(wheel.advance(400)==3);
+  TP_CHECK((fired==std::vector<std::string>{"d", "f", "e"}));
+}
+
+//##################################################################################################
+TP_TEST(timerWheelCancels)
+{
+  TimerWheel wheel(0, 1);
+  size_t count=0;
+
+  std::vector<uint64_t> ids;
+  for(int i=0; i<1000; i++)
+    ids.push_back(wheel.add(10+i%300, 0, [&]{count++;}));
+
+  for(size_t i=0; i<ids.size(); i+=2)
+    TP_CHECK(wheel.cancel(ids.at(i)));
+  TP_CHECK(!wheel.cancel(ids.at(0)));
+  TP_CHECK(!wheel.cancel(0));
+  TP_CHECK(wheel.size()==500);
+
+  // A callback can cancel a timer due in the same tick.
+  uint64_t second=0;
+  wheel.add(1000, 0, [&]{wheel.cancel(second);});
+  second = wheel.add(1000, 0, [&]{count+=1000;});
+
+  TP_CHECK(wheel.advance(1000)==501);
+  TP_CHECK(count==500);
+  TP_CHECK(wheel.size()==0);
+
+  // The IDs of fired timers stay invalid when their entries are reused.
+  uint64_t reused = wheel.add(2000, 0, [&]{});
+  TP_CHECK(reused!=second);
+  TP_CHECK(!wheel.cancel(second));
+  TP_CHECK(wheel.cancel(reused));
+}
+
+//##################################################################################################
+TP_TEST(timerWheelPeriodicSkipsMissedPeriods)
+{
+  TimerWheel wheel(0, 1);
+  size_t count=0;
+  uint64_t id = wheel.add(10, 10, [&]{count++;});
+
+  TP_CHECK(wheel.advance(10)==1);
+  TP_CHECK(wheel.advance(35)==1);
+  TP_CHECK(wheel.advance(39)==0);
+  TP_CHECK(wheel.advance(40)==1);
+  TP_CHECK(count==3);
+
+  // A periodic timer can cancel itself.
+  wheel.cancel(id);
+  id = wheel.add(50, 5, [&]{count++; wheel.cancel(id);});
+  TP_CHECK(wheel.advance(100)==1);
+  TP_CHECK(wheel.size()==0);
+}
+
+//##################################################################################################
+TP_TEST(timerWheelJumpsOverLongGaps)
+{
+  TimerWheel wheel(0, 1);
+  size_t count=0;
+
+  // Beyond the range of the wheel, and one deep in the last level.
+  int64_t far = int64_t(1)<<40;
+  wheel.add(far, 0, [&]{count++;});
+  wheel.add(int64_t(3)<<24, 0, [&]{count++;});
+
+  auto start = std::chrono::steady_clock::now();
+  TP_CHECK(wheel.advance(far-1)==1);
+  TP_CHECK(wheel.advance(far)==1);
+  TP_CHECK(std::chrono::steady_clock::now()-start<std::chrono::seconds(1));
+  TP_CHECK(count==2);
+}
@@ -0,0 +1,37 @@
+#include "Tests.h"
+
+#include <iostream>
+#include <string>
+
+//##################################################################################################
+// Usage: tp_control_tests [name...]
+//
+// Runs the tests, or only those whose name contains one of the arguments. Returns 1 if any fail.
+int main(int argc, char* argv[])
+{
+  size_t run=0;
+  size_t failed=0;
+
+  for(const auto& test : tp_control_tests::registeredTests())
+  {
+    bool selected = (argc<2);
+    for(int a=1; a<argc && !selected; a++)
+      selected = (test.name.find(argv[a])!=std::string::npos);
+
+    if(!selected)
+      continue;
+
+    tp_control_tests::TestContext context;
+    context.testName = test.name;
+    test.function(context);
+
+    run++;
+    if(context.failures)
+      failed++;
+
+    std::cout << (context.failures?"FAIL ":"PASS ") << test.name << " (" << context.checks << " checks)" << std::endl;
+  }
+
+  std::cout << (run-failed) << " of " << run << " tests passed" << std::endl;
+  return (failed || !run)?1:0;
+}
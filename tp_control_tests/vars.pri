@@ -0,0 +1,41 @@
+TARGET = tp_control_tests
+TEMPLATE = app
+
+SOURCES += src/main.cpp
+
+SOURCES += src/Tests.cpp
+HEADERS += src/Tests.h
+
+SOURCES += src/RecorderTests.cpp
+
+SOURCES += src/SharedMemoryTests.cpp
+
+SOURCES += src/BridgeTests.cpp
+
+SOURCES += src/DerivedTests.cpp
+
+SOURCES += src/ChannelTests.cpp
+
+SOURCES += src/ScalarGroupTests.cpp
+
+SOURCES += src/TimerWheelTests.cpp
+
+SOURCES += src/JournalTests.cpp
+
+SOURCES += src/StateTests.cpp
+
+SOURCES += src/HandleTests.cpp
+
+SOURCES += src/TaskTests.cpp
+
+SOURCES += src/InstrumentationTests.cpp
+
+SOURCES += src/EqualityTests.cpp
+
+SOURCES += src/HistoryTests.cpp
+
+SOURCES += src/SignalTests.cpp
+
+SOURCES += src/RateLimitTests.cpp
+
+SOURCES += src/ChannelListTests.cpp
@@ -3,9 +3,63 @@ TEMPLATE = lib
 
 DEFINES += TP_CONTROL_LIBRARY
 
+# Collect counters, latency histograms, and traces of the callbacks called by CoreInterface.
+#DEFINES += TP_CONTROL_INSTRUMENTATION
+
+# Build CoreInterface for a single thread. This removes the owner thread check, makes the
+# interface's own counters plain integers, and compiles out the signal pool dispatch so parallel
+# signal callbacks and channel tasks run on the calling thread. shared_ptr reference counts stay
+# atomic and the per set work (observers, derived channels, rate limits, watchdog) is unchanged.
+#DEFINES += TP_CONTROL_SINGLE_THREADED
+
 #SOURCES += src/Globals.cpp
 HEADERS += inc/tp_control/Globals.h
 
 SOURCES += src/CoreInterface.cpp
 HEADERS += inc/tp_control/CoreInterface.h
 
+SOURCES += src/CoreInterfaceBridge.cpp
+HEADERS += inc/tp_control/CoreInterfaceBridge.h
+
+SOURCES += src/CoreInterfaceCodecs.cpp
+HEADERS += inc/tp_control/CoreInterfaceCodecs.h
+
+SOURCES += src/CoreInterfaceHistory.cpp
+HEADERS += inc/tp_control/CoreInterfaceHistory.h
+
+SOURCES += src/CoreInterfaceJournal.cpp
+HEADERS += inc/tp_control/CoreInterfaceJournal.h
+
+SOURCES += src/CoreInterfaceRecorder.cpp
+HEADERS += inc/tp_control/CoreInterfaceRecorder.h
+
+HEADERS += inc/tp_control/CoreInterfaceSeqlockChannel.h
+
+SOURCES += src/CoreInterfaceSharedMemory.cpp
+HEADERS += inc/tp_control/CoreInterfaceSharedMemory.h
+
+SOURCES += src/CoreInterfaceState.cpp
+HEADERS += inc/tp_control/CoreInterfaceState.h
+
+SOURCES += src/CoreInterfaceStats.cpp
+HEADERS += inc/tp_control/CoreInterfaceStats.h
+
+SOURCES += src/CoreInterfaceTrace.cpp
+HEADERS += inc/tp_control/CoreInterfaceTrace.h
+
+HEADERS += inc/tp_control/CoreInterfaceValue.h
+
+SOURCES += src/CoreInterfaceWatchdog.cpp
+HEADERS += inc/tp_control/CoreInterfaceWatchdog.h
+
+SOURCES += src/MappedFile.cpp
+HEADERS += inc/tp_control/MappedFile.h
+
+SOURCES += src/ScalarGroup.cpp
+HEADERS += inc/tp_control/ScalarGroup.h
+
+SOURCES += src/TimerWheel.cpp
+HEADERS += inc/tp_control/TimerWheel.h
+
+SOURCES += src/WorkStealingPool.cpp
+HEADERS += inc/tp_control/WorkStealingPool.h